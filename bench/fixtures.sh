@@ -0,0 +1,79 @@
+#!/usr/bin/env sh
+
+# Generate the benchmark fixtures used for profile guided optimization and
+# benchmarking: a large `runs` database, recorded API responses for a set of
+# runs and YouTube debug info blobs for retime.
+#
+# Usage: fixtures.sh [OUTPUT DIRECTORY] [NUMBER OF DATABASE LINES]
+
+set -e
+
+out=${1:-$(dirname "$0")/data}
+lines=${2:-200000}
+
+# Nothing to do if the fixtures were already generated with the same size
+if [ -f "$out/.lines" ] && [ "$(cat "$out/.lines")" = "$lines" ]; then
+	exit 0
+fi
+
+rm -rf "$out/api"
+mkdir -p "$out/api/runs" "$out/home/.local/share/drun" "$out/retime"
+
+# The runs database, in the same format drun writes it
+awk -v n="$lines" 'BEGIN {
+	srand(1);
+	a = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+	b = "abcdefghijklmnopqrstuvwxyz0123456789";
+	for (i = 0; i < n; i++) {
+		v = ""; r = "";
+		for (j = 0; j < 11; j++)
+			v = v substr(a, int(rand() * 64) + 1, 1);
+		for (j = 0; j < 8; j++)
+			r = r substr(b, int(rand() * 36) + 1, 1);
+		printf "https://youtu.be/%s https://www.speedrun.com/run/%s\n", v, r;
+	}
+}' >"$out/home/.local/share/drun/runs"
+
+# Recorded API responses. Every fourth run reuses a video that is already in
+# the database so that both the duplicate and the insert paths are trained.
+awk -v n="$lines" -v dir="$out/api/runs" 'BEGIN {
+	srand(2);
+	b = "abcdefghijklmnopqrstuvwxyz0123456789";
+} NR % int(n / 500 + 1) == 0 {
+	split($0, f, " ");
+	id = "";
+	for (j = 0; j < 8; j++)
+		id = id substr(b, int(rand() * 36) + 1, 1);
+	if (++k % 4 == 0)
+		uri = f[1];
+	else
+		uri = "https://www.youtube.com/watch?v=" substr(id id, 1, 11);
+	file = dir "/" id;
+	printf "{\"data\":{\"id\":\"%s\",", id >file;
+	printf "\"weblink\":\"https://www.speedrun.com/mcbe/run/%s\",", id >file;
+	printf "\"game\":\"yd4ovvg1\",\"level\":null,\"category\":\"%s\",",
+	       k % 2 ? "wkpn0vdr" : "7kjgmx3k" >file;
+	printf "\"videos\":{\"links\":[{\"uri\":\"%s\"}]},", uri >file;
+	printf "\"comment\":\"Run %d\",", k >file;
+	printf "\"status\":{\"status\":\"new\",\"examiner\":null," >file;
+	printf "\"verify-date\":null},\"players\":[{\"rel\":\"user\"," >file;
+	printf "\"id\":\"p%07d\",\"uri\":\"https://www.speedrun.com/api/v1/" \
+	       "users/p%07d\"}],", k % 97, k % 97 >file;
+	printf "\"date\":\"2021-03-%02d\",", k % 28 + 1 >file;
+	printf "\"submitted\":\"2021-03-%02dT12:%02d:00Z\",",
+	       k % 28 + 1, k % 60 >file;
+	printf "\"times\":{\"primary\":\"PT%dM%d.%03dS\",\"primary_t\":%d.%03d}}}",
+	       k % 60, k % 60, k, k % 60 * 61, k >file;
+	close(file);
+	print id >(dir "/../ids");
+}' "$out/home/.local/share/drun/runs"
+
+# YouTube debug info blobs, start and end of a run for each framerate
+for fps in 24 30 60; do
+	printf '%s\n' "$fps" \
+	    "{\"ns\":\"yt\",\"el\":\"detailpage\",\"cpn\":\"x\",\"ver\":2,\"cmt\":\"12.345\",\"fs\":\"0\",\"rt\":\"20.1\",\"euri\":\"\",\"lact\":3,\"cl\":\"1\",\"state\":\"4\",\"vm\":\"CAE\",\"volume\":100}" \
+	    "{\"ns\":\"yt\",\"el\":\"detailpage\",\"cpn\":\"x\",\"ver\":2,\"cmt\":\"4321.876\",\"fs\":\"0\",\"rt\":\"4400.2\",\"euri\":\"\",\"lact\":3,\"cl\":\"1\",\"state\":\"4\",\"vm\":\"CAE\",\"volume\":100}" \
+	    >"$out/retime/$fps"
+done
+
+echo "$lines" >"$out/.lines"
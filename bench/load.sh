@@ -0,0 +1,54 @@
+#!/usr/bin/env sh
+
+# Drive drun against the mock API server and report its throughput and the
+# latency percentiles of its requests. The runs are generated by the server
+# unless DIR is set, in which case the recorded responses of fixtures.sh are
+# replayed. Any arguments are passed on to the server, e.g. `-l 50 -e 5` for
+# 50ms responses of which 5% fail.
+#
+# Usage: [RUNS=N] [JOBS=N] [PORT=N] [DIR=bench/data/api] load.sh [SERVER OPTIONS]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+runs=${RUNS:-1000}
+jobs=${JOBS:-4}
+port=${PORT:-8089}
+
+[ -x "$root/bin/drun" ] || make -C "$root/src/drun" >/dev/null
+make -C "$root/bench" >/dev/null
+
+tmp=$(mktemp -d)
+trap 'kill "$server" 2>/dev/null; rm -rf "$tmp"' EXIT
+mkdir -p "$tmp/home/.local/share/drun"
+
+if [ -n "$DIR" ]; then
+	"$root/bin/mockapi" -p "$port" -d "$DIR" "$@" &
+	head -n "$runs" "$DIR/ids" >"$tmp/ids"
+else
+	"$root/bin/mockapi" -p "$port" "$@" &
+	awk -v n="$runs" 'BEGIN { for (i = 0; i < n; i++) printf "r%07d\n", i }' \
+	    >"$tmp/ids"
+fi
+server=$!
+sleep 0.2
+
+start=$(date +%s%N)
+HOME="$tmp/home" DRUN_API="http://127.0.0.1:$port/api/v1" \
+    "$root/bin/drun" -j "$jobs" -M "$tmp/metrics" <"$tmp/ids" >/dev/null
+end=$(date +%s%N)
+
+# Throughput, then the fetch quantiles and counters drun exported
+awk -v ms="$(((end - start) / 1000000))" '
+/^drun_runs_total/ { runs = $2 }
+/^drun_requests_total/ { requests = $2 }
+/^drun_retries_total/ { retries = $2 }
+/^drun_fetch_seconds\{/ {
+	split($1, q, "\"");
+	fetch = fetch sprintf(" p%g %.3fms", q[2] * 100, $2 * 1000);
+}
+END {
+	printf "%d runs in %dms, %.1f runs/s\n", runs, ms, runs * 1000 / ms;
+	printf "%d requests, %d retries\n", requests, retries;
+	printf "fetch%s\n", fetch;
+}' "$tmp/metrics"
@@ -0,0 +1,386 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+/* -h message */
+#define HELP_MSG                                                               \
+    "Usage: mockapi [OPTIONS]... \n"                                           \
+    "Serve /api/v1/runs/ID like the speedrun.com API, to test and measure \n"  \
+    "drun without the real API. Point drun at it with \n"                      \
+    "DRUN_API=http://127.0.0.1:PORT/api/v1 \n"                                 \
+    "\n"                                                                       \
+    "Options: \n"                                                              \
+    "  -p PORT                   listen on PORT of 127.0.0.1 \n"               \
+    "                              (default: 8080) \n"                         \
+    "  -d DIR                    serve the recorded responses in DIR/runs, \n" \
+    "                              e.g. bench/data/api, instead of \n"         \
+    "                              generating a run for every ID \n"           \
+    "  -u PERCENT                reuse the video of another generated run \n"  \
+    "                              for PERCENT% of the runs (default: 25) \n"  \
+    "  -l MS                     delay every response by MS milliseconds \n"   \
+    "  -J MS                     add up to MS milliseconds of random delay \n" \
+    "  -e PERCENT                fail PERCENT% of the requests with 503 \n"    \
+    "  -r RATE                   allow RATE requests per second, answer \n"    \
+    "                              429 to the rest like the real API does \n"  \
+    "  -h                        display this help text and exit \n"           \
+    "\n"                                                                       \
+    "Counts of the responses are printed to STDERR on SIGINT or SIGTERM."
+
+/* Size of a request head, anything larger is refused */
+#define REQ_MAX 8192
+
+/* Generated runs share their videos among this many */
+#define VIDEO_POOL 100
+
+static struct {
+    const char *dir;
+    unsigned int reuse;
+    long latency_ms, jitter_ms;
+    unsigned int error_pct;
+    double rate;
+} opts = {NULL, 25, 0, 0, 0, 0};
+
+/* Counts of the responses by status */
+enum { ST_OK, ST_NOT_FOUND, ST_THROTTLED, ST_ERROR, ST_BAD, NSTATUS };
+static const struct {
+    int code;
+    const char *reason;
+} statuses[NSTATUS] = {
+    [ST_OK] = {200, "OK"},
+    [ST_NOT_FOUND] = {404, "Not Found"},
+    [ST_THROTTLED] = {429, "Too Many Requests"},
+    [ST_ERROR] = {503, "Service Unavailable"},
+    [ST_BAD] = {400, "Bad Request"},
+};
+static uint64_t served[NSTATUS];
+
+/* Token bucket of the request rate, refilled by the time since last use */
+static pthread_mutex_t bucket_lock = PTHREAD_MUTEX_INITIALIZER;
+static double tokens;
+static uint64_t refilled;
+
+static volatile sig_atomic_t stop;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool take_token(void)
+{
+    if (opts.rate <= 0)
+        return true;
+
+    pthread_mutex_lock(&bucket_lock);
+    const uint64_t now = now_us();
+    tokens += (now - refilled) / 1e6 * opts.rate;
+    if (tokens > opts.rate)
+        tokens = opts.rate;
+    refilled = now;
+
+    const bool ok = tokens >= 1;
+    if (ok)
+        tokens--;
+    pthread_mutex_unlock(&bucket_lock);
+    return ok;
+}
+
+/* Write a run in the same shape as the responses of the real API */
+static size_t synthesize(const char *id, char *buf, const size_t size)
+{
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrs"
+                                "tuvwxyz0123456789-_";
+    uint64_t h = hash(id, strlen(id));
+    const unsigned int k = h % 100000;
+
+    /* Reused videos come from a small pool, so they repeat */
+    uint64_t v = h >> 7;
+    if (h % 100 < opts.reuse)
+        v = hash((const char *) &(uint64_t){v % VIDEO_POOL}, sizeof(v));
+    char video[12];
+    for (int i = 0; i < 11; i++, v /= 64)
+        video[i] = chars[v % 64];
+    video[11] = '\0';
+
+    const int ret = snprintf(
+        buf, size,
+        "{\"data\":{\"id\":\"%s\","
+        "\"weblink\":\"https://www.speedrun.com/run/%s\","
+        "\"game\":\"yd4ovvg1\",\"level\":null,\"category\":\"%s\","
+        "\"videos\":{\"links\":[{\"uri\":\"https://youtu.be/%s\"}]},"
+        "\"comment\":\"Run %u\","
+        "\"status\":{\"status\":\"new\",\"examiner\":null,"
+        "\"verify-date\":null},\"players\":[{\"rel\":\"user\","
+        "\"id\":\"p%07u\",\"uri\":\"https://www.speedrun.com/api/v1/"
+        "users/p%07u\"}],"
+        "\"date\":\"2021-03-%02u\",\"submitted\":\"2021-03-%02uT12:%02u:00Z\","
+        "\"times\":{\"primary\":\"PT%uM%u.%03uS\",\"primary_t\":%u.%03u}}}",
+        id, id, k % 2 ? "wkpn0vdr" : "7kjgmx3k", video, k, k % 97, k % 97,
+        k % 28 + 1, k % 28 + 1, k % 60, k % 60, k % 60, k % 1000,
+        k % 60 * 61, k % 1000);
+    return ret < 0 ? 0 : (size_t) ret < size ? (size_t) ret : size - 1;
+}
+
+/* Read a recorded response, the ID must not leave the directory */
+static char *load(const char *id, size_t *len)
+{
+    for (const char *c = id; *c != '\0'; c++)
+        if (*c == '/' || *c == '.')
+            return NULL;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/runs/%s", opts.dir, id);
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        const long size = ftell(fp);
+        rewind(fp);
+        if (size >= 0 && (buf = malloc(size + 1)) != NULL)
+            *len = fread(buf, 1, size, fp);
+    }
+    fclose(fp);
+    return buf;
+}
+
+static bool send_all(const int fd, const char *buf, size_t len,
+                     const int flags)
+{
+    while (len > 0) {
+        const ssize_t n = send(fd, buf, len, MSG_NOSIGNAL | flags);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n, len -= n;
+    }
+    return true;
+}
+
+static bool respond(const int fd, const int status, const char *body,
+                    const size_t len, const bool keep_alive)
+{
+    __atomic_fetch_add(&served[status], 1, __ATOMIC_RELAXED);
+
+    char head[256];
+    const int n =
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                 "Content-Length: %zu\r\n%s%s\r\n",
+                 statuses[status].code, statuses[status].reason, len,
+                 status == ST_THROTTLED ? "Retry-After: 1\r\n" : "",
+                 keep_alive ? "" : "Connection: close\r\n");
+    /* The head is held back so it leaves in one segment with the body */
+    return send_all(fd, head, n, MSG_MORE) && send_all(fd, body, len, 0);
+}
+
+/* Answer one request, the ID is the last component of the path */
+static bool serve(const int fd, char *path, const bool keep_alive,
+                  unsigned int *seed)
+{
+    long delay = opts.latency_ms;
+    if (opts.jitter_ms > 0)
+        delay += rand_r(seed) % (opts.jitter_ms + 1);
+    if (delay > 0) {
+        const struct timespec ts = {delay / 1000, delay % 1000 * 1000000};
+        nanosleep(&ts, NULL);
+    }
+
+    char *query = strchr(path, '?');
+    if (query != NULL)
+        *query = '\0';
+    const char *id = strrchr(path, '/');
+    if (strstr(path, "/runs/") == NULL || id == NULL || id[1] == '\0')
+        return respond(fd, ST_NOT_FOUND, "{}", 2, keep_alive);
+    id++;
+
+    if (!take_token())
+        return respond(fd, ST_THROTTLED, "{}", 2, keep_alive);
+    if ((unsigned int) (rand_r(seed) % 100) < opts.error_pct)
+        return respond(fd, ST_ERROR, "{}", 2, keep_alive);
+
+    if (opts.dir != NULL) {
+        size_t len = 0;
+        char *body = load(id, &len);
+        if (body == NULL)
+            return respond(fd, ST_NOT_FOUND, "{}", 2, keep_alive);
+        const bool ret = respond(fd, ST_OK, body, len, keep_alive);
+        free(body);
+        return ret;
+    }
+
+    char body[2048];
+    const size_t len = synthesize(id, body, sizeof(body));
+    return respond(fd, ST_OK, body, len, keep_alive);
+}
+
+/* Serve the requests of one connection until the client closes it */
+static void *connection(void *arg)
+{
+    const int fd = (intptr_t) arg;
+    unsigned int seed = (unsigned int) fd ^ (unsigned int) now_us();
+    char buf[REQ_MAX + 1];
+    size_t len = 0;
+
+    for (;;) {
+        char *end;
+        buf[len] = '\0';
+        while ((end = strstr(buf, "\r\n\r\n")) == NULL) {
+            if (len == REQ_MAX) {
+                respond(fd, ST_BAD, "{}", 2, false);
+                goto out;
+            }
+            const ssize_t n = recv(fd, buf + len, REQ_MAX - len, 0);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                goto out;
+            len += n;
+            buf[len] = '\0';
+        }
+        end += 4;
+
+        /* Only the request line and the Connection header matter */
+        char method[16], path[4096], version[16];
+        if (sscanf(buf, "%15s %4095s %15s", method, path, version) != 3) {
+            respond(fd, ST_BAD, "{}", 2, false);
+            goto out;
+        }
+        bool keep_alive = strcmp(version, "HTTP/1.0") != 0;
+        for (char *h = strstr(buf, "\r\n"); h != NULL && h + 2 < end;
+             h = strstr(h + 2, "\r\n"))
+            if (strncasecmp(h + 2, "Connection: close", 17) == 0)
+                keep_alive = false;
+
+        if (!serve(fd, path, keep_alive, &seed) || !keep_alive)
+            goto out;
+
+        /* Keep what was pipelined after this request */
+        len -= end - buf;
+        memmove(buf, end, len);
+    }
+
+out:
+    close(fd);
+    return NULL;
+}
+
+static void on_signal(const int sig)
+{
+    (void) sig;
+    stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8080;
+
+    int opt;
+    while ((opt = getopt(argc, argv, ":hp:d:u:l:J:e:r:")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            opts.dir = optarg;
+            break;
+        case 'u':
+            opts.reuse = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            opts.latency_ms = strtol(optarg, NULL, 10);
+            break;
+        case 'J':
+            opts.jitter_ms = strtol(optarg, NULL, 10);
+            break;
+        case 'e':
+            opts.error_pct = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            opts.rate = strtod(optarg, NULL);
+            break;
+        case 'h':
+            puts(HELP_MSG);
+            return EXIT_SUCCESS;
+        case ':':
+            fprintf(stderr,
+                    "mockapi: option requires an argument -- '%c' \nTry "
+                    "'mockapi -h' for more information.\n",
+                    optopt);
+            return EXIT_FAILURE;
+        default:
+            fprintf(stderr,
+                    "mockapi: invalid option -- '%c' \nTry 'mockapi -h' for "
+                    "more information.\n",
+                    optopt);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* accept() is interrupted by the signals so the counts can be printed */
+    struct sigaction sa = {0};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    const int srv = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (srv == -1
+        || setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1
+        || bind(srv, (struct sockaddr *) &addr, sizeof(addr)) == -1
+        || listen(srv, SOMAXCONN) == -1) {
+        perror("mockapi");
+        return EXIT_FAILURE;
+    }
+
+    tokens = opts.rate;
+    refilled = now_us();
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (!stop) {
+        const int fd = accept(srv, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("mockapi");
+            return EXIT_FAILURE;
+        }
+
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, connection, (void *) (intptr_t) fd)
+            != 0)
+            close(fd);
+    }
+
+    fprintf(stderr, "mockapi:");
+    for (int i = 0; i < NSTATUS; i++)
+        fprintf(stderr, " %" PRIu64 " %d%s",
+                __atomic_load_n(&served[i], __ATOMIC_RELAXED),
+                statuses[i].code, i + 1 < NSTATUS ? "," : "\n");
+    close(srv);
+    return EXIT_SUCCESS;
+}
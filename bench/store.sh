@@ -0,0 +1,58 @@
+#!/usr/bin/env sh
+
+# Compare the storage backends of drun on the same workload: the runs of the
+# fixtures are imported into an empty database, the recorded runs of the API
+# are checked against it and everything is listed again. The outputs of every
+# backend have to be the same. The sqlite backend is skipped unless drun was
+# built with SQLITE=1.
+#
+# Usage: [DIR=bench/data] [BACKENDS="text hashed sqlite"] store.sh
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+dir=${DIR:-$root/bench/data}
+backends=${BACKENDS:-text hashed sqlite}
+
+[ -x "$root/bin/drun" ] || make -C "$root/src/drun" >/dev/null
+[ -f "$dir/api/ids" ] || sh "$root/bench/fixtures.sh" "$dir"
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Milliseconds since the epoch
+now() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+printf '%-8s %10s %10s %10s\n' backend import check list
+for backend in $backends; do
+	home="$tmp/$backend"
+	mkdir -p "$home/.local/share/drun"
+	if ! HOME="$home" "$root/bin/drun" -B "$backend" -L >/dev/null 2>&1; then
+		echo "$backend: not built, skipped" >&2
+		continue
+	fi
+
+	start=$(now)
+	HOME="$home" "$root/bin/drun" -B "$backend" -I \
+	    <"$dir/home/.local/share/drun/runs" >/dev/null
+	imported=$(now)
+	HOME="$home" DRUN_API="file://$dir/api" "$root/bin/drun" -B "$backend" \
+	    <"$dir/api/ids" >"$tmp/$backend.check"
+	checked=$(now)
+	HOME="$home" "$root/bin/drun" -B "$backend" -L | sort >"$tmp/$backend.list"
+	listed=$(now)
+
+	printf '%-8s %8dms %8dms %8dms\n' "$backend" $((imported - start)) \
+	    $((checked - imported)) $((listed - checked))
+
+	if [ -n "$first" ]; then
+		cmp -s "$tmp/$first.check" "$tmp/$backend.check" \
+		    || echo "$backend: checks differ from $first" >&2
+		cmp -s "$tmp/$first.list" "$tmp/$backend.list" \
+		    || echo "$backend: runs differ from $first" >&2
+	else
+		first=$backend
+	fi
+done
@@ -0,0 +1,38 @@
+#ifndef __ALLOC_H_
+#define __ALLOC_H_
+
+#include <stddef.h>
+
+/*
+ * Allocation wrappers shared by all modutils. None of the tools can go on
+ * without the memory they asked for, so they exit with a message instead of
+ * returning NULL.
+ */
+
+/**
+ * @brief malloc() but with error checking
+ *
+ * @param size The number of bytes to allocate
+ * @return void* A pointer to the allocated memory
+ */
+void *xmalloc(const size_t size);
+
+/**
+ * @brief calloc() but with error checking
+ *
+ * @param n The number of elements to allocate
+ * @param size The size of every element
+ * @return void* A pointer to the zeroed memory
+ */
+void *xcalloc(const size_t n, const size_t size);
+
+/**
+ * @brief realloc() but with error checking
+ *
+ * @param ptr The memory to resize, or NULL
+ * @param size The new size, which may be 0
+ * @return void* A pointer to the resized memory
+ */
+void *xrealloc(void *ptr, const size_t size);
+
+#endif /* !__ALLOC_H_ */
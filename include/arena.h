@@ -0,0 +1,84 @@
+#ifndef __ARENA_H_
+#define __ARENA_H_
+
+#include <stddef.h>
+
+/* Alignment of every allocation, enough for any type drun uses */
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK (64 * 1024)
+
+/**
+ * @brief A block of memory allocations are carved out of
+ *
+ * @param next The next block
+ * @param size The number of usable bytes in the block
+ * @param used The number of bytes already allocated
+ */
+typedef struct block {
+    struct block *next;
+    size_t size;
+    size_t used;
+    char data[];
+} block_t;
+
+/**
+ * @brief A bump allocator whose allocations are all freed at once
+ *
+ * @param head The first block
+ * @param cur The block allocations are currently made from
+ * @param last The most recent allocation, which can be grown in place
+ */
+typedef struct {
+    block_t *head;
+    block_t *cur;
+    char *last;
+} arena_t;
+
+/**
+ * @brief Allocate memory from the arena, exits on allocation failure
+ *
+ * @param arena The arena
+ * @param size The number of bytes to allocate
+ * @return void* The allocated memory
+ */
+void *arena_alloc(arena_t *arena, const size_t size);
+
+/**
+ * @brief Resize an allocation, in place if it is the most recent one
+ *
+ * @param arena The arena
+ * @param ptr The allocation to resize
+ * @param old The current size of the allocation
+ * @param size The new size of the allocation
+ * @return void* The resized allocation
+ */
+void *arena_grow(arena_t *arena, void *ptr, const size_t old,
+                 const size_t size);
+
+/**
+ * @brief Copy a string into the arena
+ *
+ * @param arena The arena
+ * @param str The string to copy, which does not need to be NUL terminated
+ * @param len The length of `str`
+ * @return char* The NUL terminated copy
+ */
+char *arena_strndup(arena_t *arena, const char *str, const size_t len);
+
+/**
+ * @brief Free all allocations but keep the memory for reuse. If the arena
+ * needed more than one block, they are merged into one, so a workload that
+ * repeats does not allocate once it has been reset for the first time.
+ *
+ * @param arena The arena
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * @brief Give all memory of the arena back to the system
+ *
+ * @param arena The arena
+ */
+void arena_free(arena_t *arena);
+
+#endif /* !__ARENA_H_ */
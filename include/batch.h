@@ -0,0 +1,38 @@
+#ifndef __BATCH_H_
+#define __BATCH_H_
+
+#include "store.h"
+
+/*
+ * Checking a large batch of runs with one lookup per video costs a scan of
+ * the database per run with the text backend, and a random read per run with
+ * the others once the database no longer fits into memory. A batch is
+ * checked with a sort-merge join instead: the videos of all runs are sorted,
+ * the database is read once and sorted too, and both are merged in one
+ * sequential pass. Both sorts are external, so memory is bounded however
+ * large the database is, and grows by a few bytes per video of the batch
+ * only: lines of the database with YouTube videos that are not in the batch,
+ * most of them, are told apart by a set of packed IDs, see idset.h, and never
+ * sorted.
+ *
+ * The runs are collected while they are downloaded, and reported in the order
+ * of the input once the join is done. A video that is in the batch more than
+ * once is looked up the usual way for all but its first run, as that may have
+ * been added in the meantime.
+ */
+
+/* Bytes of lines every sort of a batch keeps in memory */
+#define BATCH_MEMORY (16 * 1024 * 1024)
+
+/**
+ * @brief Check every run read from STDIN as one batch against every shard of
+ * the database, like `pipeline()` followed by `store_run()` with -x
+ *
+ * @param store The database
+ * @param jobs The number of threads downloading runs
+ * @return bool false if a run could not be downloaded, the runs before it
+ * are still reported
+ */
+bool batch(store_t *store, const unsigned int jobs);
+
+#endif /* !__BATCH_H_ */
@@ -0,0 +1,122 @@
+#ifndef __BLOCKLIST_H_
+#define __BLOCKLIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A blocklist of videos known to be stolen, shared by other communities. It is
+ * an immutable file that is mapped into memory as it is, so opening it costs
+ * next to nothing however many videos it has.
+ *
+ * The videos are keyed by a minimal perfect hash function in the manner of
+ * BBHash: every level is a bit array that the keys are hashed into, a key
+ * whose bit no other key shares is placed there and the others are hashed
+ * into the next level. The index of a key is the rank of its bit over all
+ * levels, and a fingerprint stored at that index tells the videos of the
+ * blocklist from all others but one in 2^16.
+ */
+
+/* Magic number and version of blocklist files */
+#define BLOCKLIST_MAGIC   0x4c425244 /* "DRBL" */
+#define BLOCKLIST_VERSION 1
+
+/* Levels tried before the keys left over are given up on */
+#define BLOCKLIST_LEVELS 32
+
+/* Bits of a level per key hashed into it, more builds faster but is larger */
+#define BLOCKLIST_GAMMA 2
+
+/* Bits covered by every entry of the rank table */
+#define BLOCKLIST_RANK_BITS 512
+
+/**
+ * @brief The header of a blocklist file, followed by the levels, the bits of
+ * all levels, the rank table and the fingerprints
+ *
+ * @param magic `BLOCKLIST_MAGIC`
+ * @param version `BLOCKLIST_VERSION`
+ * @param nlevels The number of levels
+ * @param nkeys The number of videos
+ * @param nwords The number of 64 bit words of all levels
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nlevels;
+    uint32_t pad;
+    uint64_t nkeys;
+    uint64_t nwords;
+} bl_header_t;
+
+/**
+ * @brief A level of the hash function
+ *
+ * @param word The first word of the level
+ * @param bits The size of the level in bits, a multiple of 64
+ */
+typedef struct {
+    uint64_t word;
+    uint64_t bits;
+} bl_level_t;
+
+/**
+ * @brief An open blocklist, empty if there is no file
+ *
+ * @param map The mapped file
+ * @param size The size of the file
+ * @param hdr The header
+ * @param levels The levels
+ * @param bits The bits of all levels
+ * @param ranks The number of set bits before every `BLOCKLIST_RANK_BITS` bits
+ * @param fps The fingerprint of every video, by its index
+ */
+typedef struct {
+    void *map;
+    size_t size;
+    const bl_header_t *hdr;
+    const bl_level_t *levels;
+    const uint64_t *bits;
+    const uint64_t *ranks;
+    const uint16_t *fps;
+} blocklist_t;
+
+/**
+ * @brief Map the blocklist file into memory
+ *
+ * @param bl The blocklist to open
+ * @param path The blocklist file
+ * @return bool Whether there is a blocklist, a missing file is an empty one
+ */
+bool blocklist_open(blocklist_t *bl, const char *path);
+
+/**
+ * @brief Whether a video is on the blocklist, in constant time. A video that
+ * is not may be reported as one with a chance of 2^-16.
+ *
+ * @param bl The blocklist
+ * @param video_uri The canonical uri of the video, see canon.h
+ * @return bool Whether the video is on the blocklist
+ */
+bool blocklist_has(const blocklist_t *bl, const char *video_uri);
+
+/**
+ * @brief Build a blocklist from lists of videos, one per line, and replace the
+ * blocklist file with it. Videos are given by any URI, or by the bare ID of a
+ * YouTube video. Prints how large the blocklist is.
+ *
+ * @param path The blocklist file
+ * @param in The lists
+ */
+void blocklist_build(const char *path, FILE *in);
+
+/**
+ * @brief Unmap the blocklist
+ *
+ * @param bl The blocklist to close
+ */
+void blocklist_close(blocklist_t *bl);
+
+#endif /* !__BLOCKLIST_H_ */
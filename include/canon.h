@@ -0,0 +1,79 @@
+#ifndef __CANON_H_
+#define __CANON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The canonical form of a video URI is an URI itself, so that it can be shown
+ * as is and canonicalizing it again changes nothing:
+ *
+ *  YouTube   https://youtu.be/ID
+ *  Twitch    https://www.twitch.tv/videos/ID, https://clips.twitch.tv/SLUG
+ *  bilibili  https://www.bilibili.com/video/ID, with ?p=N past the first part
+ *  Vimeo     https://vimeo.com/ID
+ *
+ * Any other URI loses its scheme, a leading www. or m., its fragment and a
+ * trailing slash, and its host is lowercased.
+ */
+
+/* Room needed for the canonical form of an URI of `len` bytes */
+#define CANON_SIZE(len) ((len) + 32)
+
+/* Hosts longer than this are not recognized, and are kept as they are */
+#define CANON_HOST_MAX 253
+
+/**
+ * @brief Reduce a video URI to one key per video, so every link to the same
+ * video on a known platform compares equal. This is a single pass over the
+ * URI and never allocates.
+ *
+ * @param uri The URI, which does not need to be NUL terminated
+ * @param len The length of `uri`
+ * @param out Where to store the NUL terminated canonical form, at least
+ * `CANON_SIZE(len)` bytes
+ * @return size_t The length of the canonical form
+ */
+size_t canon_uri(const char *uri, const size_t len, char *out);
+
+/**
+ * @brief Like `canon_uri()`, but only for videos on the platforms above
+ *
+ * @param uri The URI, which does not need to be NUL terminated
+ * @param len The length of `uri`
+ * @param out Where to store the NUL terminated canonical form, at least
+ * `CANON_SIZE(len)` bytes
+ * @return size_t The length of the canonical form, 0 if `uri` is no video of
+ * a known platform
+ */
+size_t canon_video(const char *uri, const size_t len, char *out);
+
+/**
+ * @brief Whether a video URI as it was stored, maybe long before canon_uri()
+ * existed, is a link to the video with the canonical form `key`. Most URIs of
+ * other videos are told apart without canonicalizing them.
+ *
+ * @param video The URI as it was stored, which does not need to be NUL
+ * terminated
+ * @param len The length of `video`
+ * @param key The canonical form to compare with
+ * @param key_len The length of `key`
+ * @return bool Whether `video` canonicalizes to `key`
+ */
+bool canon_eq(const char *video, const size_t len, const char *key,
+              const size_t key_len);
+
+/**
+ * @brief Pack the ID of a YouTube video into 64 bits: 6 bits for each of its
+ * first 10 characters and 4 for the last one, which YouTube picks from 16
+ * characters only. Packed IDs sort like the canonical forms they came from.
+ *
+ * @param key The canonical form of the video
+ * @param len The length of `key`
+ * @param id Where to store the packed ID
+ * @return bool Whether `key` is a YouTube video with an ID that packs
+ */
+bool canon_pack(const char *key, const size_t len, uint64_t *id);
+
+#endif /* !__CANON_H_ */
@@ -0,0 +1,38 @@
+#ifndef __CLUSTER_H_
+#define __CLUSTER_H_
+
+#include "meta.h"
+#include "store.h"
+
+/*
+ * A stolen video rarely travels alone: it is submitted again by other
+ * accounts, often the same few, with other stolen videos. Such chains show
+ * as clusters of a graph of runs, linked when they share a video, and of
+ * players, linked to the runs in the stored metadata they played in. The
+ * clusters are its connected components.
+ *
+ * The pairs of a video and a run, from the database and from the metadata,
+ * which has the duplicates too, are sorted externally like a batch, so the
+ * runs of a video follow each other and are linked by an edge each. All edges
+ * are then merged by a union-find on all cores. It takes no locks: a root is
+ * only ever linked below the smaller of two roots, with compare-and-swap, so
+ * no cycle forms however the threads interleave, and paths are halved as
+ * they are followed.
+ */
+
+/* Bytes of pairs the sort keeps in memory */
+#define CLUSTER_MEMORY (16 * 1024 * 1024)
+
+/**
+ * @brief Print the clusters of at least two runs, largest first, one per
+ * line: the number of runs and players, the run IDs and the players
+ *
+ * @param store The database
+ * @param meta The stored metadata
+ * @param filter Only print the clusters with a run that matches it
+ * @return int EXIT_SUCCESS
+ */
+int cluster_query(store_t *store, const meta_db_t *meta,
+                  const meta_filter_t *filter);
+
+#endif /* !__CLUSTER_H_ */
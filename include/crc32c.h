@@ -0,0 +1,27 @@
+#ifndef __CRC32C_H_
+#define __CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC32C, the Castagnoli CRC of iSCSI and ext4, which x86 computes in
+ * hardware since SSE 4.2. The instruction is used when the CPU has it, so
+ * drun still runs on any x86-64 without being built for a newer one, and a
+ * table driven version slicing 8 bytes at a time otherwise.
+ */
+
+/* The reversed Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+/**
+ * @brief Compute the CRC32C of a buffer, or continue one
+ *
+ * @param crc The CRC of the bytes before `buf`, 0 to start
+ * @param buf The bytes
+ * @param len The number of bytes
+ * @return uint32_t The CRC of the bytes so far
+ */
+uint32_t crc32c(const uint32_t crc, const void *buf, size_t len);
+
+#endif /* !__CRC32C_H_ */
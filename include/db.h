@@ -0,0 +1,336 @@
+#ifndef __DB_H_
+#define __DB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "arena.h"
+
+/* How the runs database is partitioned into shards */
+enum { SHARD_NONE, SHARD_GAME, SHARD_CATEGORY };
+
+/* Magic number and version of shard index files */
+#define DB_IDX_MAGIC   0x58495244 /* "DRIX" */
+#define DB_IDX_VERSION 4
+
+/* Magic number and version of cold segment files */
+#define DB_SEG_MAGIC   0x47535244 /* "DRSG" */
+#define DB_SEG_VERSION 2
+
+/*
+ * Cold segments are compressed in blocks of about DB_BLOCK bytes of lines,
+ * every block has a bloom filter of DB_FILTER_BITS bits per video and run
+ */
+#define DB_BLOCK         (64 * 1024)
+#define DB_FILTER_BITS   10
+#define DB_FILTER_HASHES 7
+
+/*
+ * Every line is sealed with a CRC32C, so that bit rot is found by
+ * `db_reindex()`. A line is `VIDEO RUN_URI\tCRC\n`, the CRC of `VIDEO RUN_URI`
+ * in DB_CRC_DIGITS hexadecimal digits. Lines of older versions have none. A
+ * tombstone is the line it removes prefixed by '-', CRC and all.
+ */
+#define DB_CRC_DIGITS 8
+
+/* What the CRC of a line says, see `db_check()` */
+enum { DB_LINE_OK, DB_LINE_BAD, DB_LINE_UNSEALED };
+
+/* Bytes of a shard per thread rebuilding its index, fewer take one thread */
+#define DB_REINDEX_CHUNK (4 * 1024 * 1024)
+
+/* Flags of indexed lines */
+#define DB_TOMBSTONE 0x01 /* The line removes an older line */
+#define DB_DEAD      0x02 /* The line was removed by a newer tombstone */
+
+/**
+ * @brief A compressed block of a cold segment
+ *
+ * @param off The offset of the block in the segment file
+ * @param size The compressed size of the block
+ * @param raw The uncompressed size of the block
+ */
+typedef struct {
+    uint64_t off;
+    uint32_t size;
+    uint32_t raw;
+} seg_block_t;
+
+/**
+ * @brief An immutable cold segment holding the oldest lines of a shard in
+ * compressed blocks. Only the block table and the filters are mapped, a block
+ * is read and decompressed when its filter matches.
+ *
+ * @param fd The segment file
+ * @param version The version of the segment file, the filters of version 1
+ * only have the videos
+ * @param nblocks The number of blocks
+ * @param filter_bytes The size of the filter of every block
+ * @param blocks The block table
+ * @param filters The filter of every block
+ */
+typedef struct {
+    int fd;
+    uint32_t version;
+    uint32_t nblocks;
+    uint32_t filter_bytes;
+    seg_block_t *blocks;
+    uint8_t *filters;
+} segment_t;
+
+/**
+ * @brief One file of the runs database, in the same line format as the flat
+ * `runs` file, and the index of the video URI and the run ID of every line.
+ * Lines are never changed in place, a run is removed by appending its line
+ * prefixed by '-' as a tombstone. The index is
+ * kept in `PATH.idx` and only covers the first `indexed` bytes of the shard,
+ * lines appended by older versions or other processes are indexed when the
+ * shard is next used. The shard file is the hot segment, older lines are
+ * moved to the cold segments `PATH.seg.0`, `PATH.seg.1` and so on by
+ * `db_compact()`.
+ *
+ * The index file has the hash tables too, and is mapped rather than read, so
+ * every process using the shard shares one copy of the index in the page
+ * cache and uses it without building anything. Pages a process changes are
+ * its own. A process publishes its index by renaming a new file over the old
+ * one, with the next generation, unless one that covers as much was published
+ * meanwhile; a process that finds lines it has not indexed attaches to a
+ * newer generation that covers them first.
+ *
+ * @param path The path of the shard file
+ * @param fp The shard file, opened for reading and appending
+ * @param hashes The hash of the canonical video URI of every indexed line
+ * @param runs The hash of the run ID of every indexed line
+ * @param offs The offset of every indexed line
+ * @param flags The flags of every indexed line, e.g. `DB_DEAD`
+ * @param n The number of indexed lines
+ * @param cap The number of lines allocated for `hashes`, `runs`, `offs` and
+ * `flags`
+ * @param table Open addressing hash table of line numbers plus one, by video
+ * @param rtable Open addressing hash table of line numbers plus one, by run
+ * @param mask The size of `table` and `rtable` minus one
+ * @param indexed The number of bytes of the shard covered by the index
+ * @param loaded Whether the index file and the segments were read yet
+ * @param dirty Whether the index changed since it was read
+ * @param mapped Whether the index is mapped from the index file, every array
+ * in an area with room for `cap` lines, and the tables for `mask + 1` entries
+ * @param generation The generation of the index file the index was read from
+ * @param segs The cold segments, oldest first
+ * @param nsegs The number of cold segments
+ * @param block Buffer of a decompressed block
+ * @param zblock Buffer of a compressed block
+ * @param block_size The size of `block`
+ * @param zblock_size The size of `zblock`
+ * @param match The line found by the last lookup
+ * @param match_len The length of `match`
+ * @param match_size The number of bytes allocated for `match`
+ * @param tombs The lines removed by the tombstones seen by the last lookup
+ * @param tombs_len The length of `tombs`
+ * @param tombs_size The number of bytes allocated for `tombs`
+ * @param hits The offsets of the lines of a video in `block`
+ * @param hits_size The number of bytes allocated for `hits`
+ */
+typedef struct {
+    char path[1024];
+    FILE *fp;
+    uint64_t *hashes;
+    uint64_t *runs;
+    uint64_t *offs;
+    uint8_t *flags;
+    size_t n, cap;
+    uint32_t *table, *rtable;
+    size_t mask;
+    uint64_t indexed;
+    bool loaded, dirty, mapped;
+    uint64_t generation;
+    segment_t *segs;
+    size_t nsegs;
+    uint8_t *block, *zblock;
+    size_t block_size, zblock_size;
+    char *match;
+    size_t match_len, match_size;
+    char *tombs;
+    size_t tombs_len, tombs_size;
+    size_t *hits;
+    size_t hits_size;
+} shard_t;
+
+/**
+ * @brief The runs database
+ *
+ * @param dir The directory of the flat `runs` file and the `shards` directory
+ * @param by How runs are partitioned, e.g. `SHARD_GAME`
+ * @param shards Every shard that was used so far
+ * @param nshards The number of shards
+ * @param cap The number of shards allocated
+ * @param scanned Whether the shards directory was listed yet
+ */
+typedef struct {
+    char dir[1024];
+    int by;
+    shard_t *shards;
+    size_t nshards, cap;
+    bool scanned;
+} db_t;
+
+/**
+ * @brief Open the runs database, no file is touched until it is first used
+ *
+ * @param db The database to open
+ * @param dir The directory of the database
+ * @param by How to partition runs into shards, `SHARD_NONE` for the flat
+ * `runs` file
+ */
+void db_open(db_t *db, const char *dir, const int by);
+
+/**
+ * @brief Format a sealed line of a run
+ *
+ * @param line Where to store the line, at least the length of `video_uri`
+ * and `runid` plus 64 bytes
+ * @param size The size of `line`
+ * @param video_uri The canonical uri of the runs video
+ * @param runid The ID of the run on sr.c
+ * @return size_t The length of the line
+ */
+size_t db_format(char *line, const size_t size, const char *video_uri,
+                 const char *runid);
+
+/**
+ * @brief Get the length of a line without its CRC and newline
+ *
+ * @param line The line, with or without a CRC and a newline
+ * @param len The length of `line`
+ * @return size_t The length of `VIDEO RUN_URI`
+ */
+size_t db_unseal(const char *line, const size_t len);
+
+/**
+ * @brief Check the CRC of a line, or of a tombstone
+ *
+ * @param line The line, with or without a newline
+ * @param len The length of `line`
+ * @return int `DB_LINE_OK`, `DB_LINE_BAD` or `DB_LINE_UNSEALED`
+ */
+int db_check(const char *line, const size_t len);
+
+/**
+ * @brief Cut a line that was left incomplete by a crash off the end of a file
+ * of lines, and say so on STDERR. The file is locked as by `db_append()`,
+ * so no line that another drun is still appending is cut.
+ *
+ * @param fp The file, opened for reading and writing
+ * @param path The path of the file
+ */
+void db_recover(FILE *fp, const char *path);
+
+/**
+ * @brief Append a line to a file of lines that other drun processes may
+ * append to at once. The file is locked with `flock()` while the line is
+ * written.
+ *
+ * @param fp The file, opened for appending
+ * @param line The line, with its newline
+ * @param len The length of `line`
+ * @return off_t The offset the line was written at
+ */
+off_t db_append(FILE *fp, const char *line, const size_t len);
+
+/**
+ * @brief Look for a run with the same video in the shard of the run. The
+ * shard is the flat `runs` file if the run has no game or the database is not
+ * sharded.
+ *
+ * @param db The database
+ * @param game The game ID of the run, or NULL
+ * @param category The category ID of the run, or NULL
+ * @param video_uri The canonical uri to look for a duplicate of, see canon.h
+ * @param cross Whether to look in every shard and the flat `runs` file. The
+ * shards are loaded and searched in parallel.
+ * @param arena The arena to copy the duplicate into
+ * @return char* The line of the duplicate run without its CRC, if none found
+ * this is NULL
+ */
+char *db_find(db_t *db, const char *game, const char *category,
+              const char *video_uri, const bool cross, arena_t *arena);
+
+/**
+ * @brief Open and load the shards the first lookups will search: the flat
+ * `runs` file if the database is not sharded, every shard if `cross` is set.
+ * Otherwise the shard depends on the run, and nothing is loaded.
+ *
+ * @param db The database
+ * @param cross Whether the lookups will look in every shard
+ */
+void db_warm(db_t *db, const bool cross);
+
+/**
+ * @brief Add a run to its shard
+ *
+ * @param db The database
+ * @param game The game ID of the run, or NULL
+ * @param category The category ID of the run, or NULL
+ * @param video_uri The canonical uri of the runs video
+ * @param runid The ID of the run on sr.c
+ */
+void db_add(db_t *db, const char *game, const char *category,
+            const char *video_uri, const char *runid);
+
+/**
+ * @brief Remove runs from every shard by appending tombstones
+ *
+ * @param db The database
+ * @param key The canonical video URI or the run ID of the runs to remove
+ * @param by_run Whether `key` is a run ID
+ * @return size_t The number of runs removed
+ */
+size_t db_remove(db_t *db, const char *key, const bool by_run);
+
+/*
+ * Called with every run, `line` is `VIDEO RUN_URI` without its CRC and ends in
+ * a newline
+ */
+typedef void (*db_visit_t)(const char *line, const size_t len, void *arg);
+
+/**
+ * @brief Call `visit` with every run of every shard that was not removed, in
+ * no particular order. `visit` must not use the database.
+ *
+ * @param db The database
+ * @param visit The function to call with every run
+ * @param arg Passed on to `visit`
+ */
+void db_iterate(db_t *db, const db_visit_t visit, void *arg);
+
+/**
+ * @brief Move all but the newest lines of the flat `runs` file and of every
+ * shard into a new cold segment, and print how much each shrank. Removed runs
+ * are dropped. No other drun may write to the database meanwhile.
+ *
+ * @param db The database
+ * @param keep The number of lines to keep in the hot segment
+ */
+void db_compact(db_t *db, const size_t keep);
+
+/**
+ * @brief Index the flat `runs` file and every shard from scratch and compute
+ * the filters of their cold segments, split at line boundaries across all
+ * cores, and compare them with the index and filter files. Every mismatch is
+ * printed. No other drun may write to the database meanwhile.
+ *
+ * @param db The database
+ * @param fix Whether to replace the index and filter files that differ
+ * @return size_t The number of index and filter files that differ
+ */
+size_t db_reindex(db_t *db, const bool fix);
+
+/**
+ * @brief Save the indexes of all shards that changed and close them
+ *
+ * @param db The database to close
+ */
+void db_close(db_t *db);
+
+#endif /* !__DB_H_ */
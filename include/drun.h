@@ -5,28 +5,131 @@
 #define HELP_MSG                                                               \
     "Usage: drun [OPTIONS]... \n"                                              \
     "A speedrun moderation tool to find stolen videos from STDIN \n"           \
+    "Every line of STDIN is checked, one run per line. \n"                     \
     "Example: echo 'https://www.speedrun.com/mcbe/run/yj6wel3z' | drun \n"     \
     "\n"                                                                       \
+    "Queries: \n"                                                              \
+    "  -q QUERY                  query the stored run metadata instead of \n"  \
+    "                              reading from STDIN, QUERY is one of: \n"    \
+    "                              count    number of runs and duplicates \n"  \
+    "                              runs     list the runs \n"                  \
+    "                              dups     duplicates per game/category \n"   \
+    "                              players  players who submitted videos \n"   \
+    "                                       already in the database \n"        \
+    "                              clusters runs linked by shared videos \n"   \
+    "                                       or players, largest first \n"      \
+    "  -g GAME                   only query runs of the game with this ID \n"  \
+    "  -c CATEGORY               only query runs of this category ID \n"       \
+    "  -p PLAYER                 only query runs with this player ID \n"       \
+    "\n"                                                                       \
+    "Watching: \n"                                                             \
+    "  -w GAME                   check every new submission of the game \n"    \
+    "                              with this ID instead of reading STDIN \n"   \
+    "  -i SECONDS                seconds between polls of the submissions, \n" \
+    "                              0 polls once and exits (default: 60) \n"    \
+    "\n"                                                                       \
+    "Requests: \n"                                                             \
+    "  -C MS                     connect timeout of API requests in \n"        \
+    "                              milliseconds (default: 5000) \n"            \
+    "  -T MS                     timeout in milliseconds of every attempt \n"  \
+    "                              of an API request (default: 30000) \n"      \
+    "  -r RETRIES                retries of requests that failed \n"           \
+    "                              transiently, e.g. HTTP 503 (default: 3) \n" \
+    "  -H                        hedge requests slower than 95% of all \n"     \
+    "  -j JOBS                   download up to JOBS runs at once, still \n"   \
+    "                              checked in order (default: 1) \n"           \
+    "\n"                                                                       \
+    "Database: \n"                                                             \
+    "  -S KEY                    shard the database by KEY, one of: \n"        \
+    "                              game      one shard per game \n"            \
+    "                              category  one shard per category \n"        \
+    "                              runs without a game go to the runs file \n" \
+    "  -b                        check all of STDIN at once, with one \n"      \
+    "                              sorted pass over the database and -x \n"    \
+    "  -x                        search every shard and the runs file for \n"  \
+    "                              duplicates, in parallel \n"                 \
+    "  -Z LINES                  compress all but the newest LINES runs of \n" \
+    "                              every shard to cold segments and exit, \n"  \
+    "                              no other drun may run meanwhile \n"         \
+    "  -R                        rebuild the indexes and filters on all \n"    \
+    "                              cores and exit, -V only verifies them \n"   \
+    "  -D                        remove the runs read from STDIN, given by \n" \
+    "                              run ID, run URI or video URI \n"            \
+    "  -B BACKEND                store runs with BACKEND: text (the runs \n"   \
+    "                              file only, no index), hashed (default) \n"  \
+    "                              or sqlite (if built with SQLITE=1) \n"      \
+    "  -L                        list every run and exit \n"                   \
+    "  -I                        add the runs listed by -L from STDIN \n"      \
+    "  -K LIST                   build the blocklist of stolen videos from \n" \
+    "                              the video URIs or IDs in LIST and exit \n"  \
+    "\n"                                                                       \
+    "Metrics: \n"                                                              \
+    "  -M FILE                   write latency percentiles and counters to \n" \
+    "                              FILE in the Prometheus text format \n"      \
+    "  -s                        print a summary of the metrics to STDERR \n"  \
+    "\n"                                                                       \
     "Miscellaneous: \n"                                                        \
     "  -h                        display this help text and exit \n"           \
     "  -v                        display version information and exit \n"      \
     "\n"                                                                       \
-    "When a url is read from standard input, it will be compared against the " \
+    "Every run read is compared against ~/.local/share/drun/runs, or its \n"   \
+    "shard in ~/.local/share/drun/shards, and added if no match is found. \n"  \
+    "Its metadata is stored in ~/.local/share/drun/meta for queries. \n"       \
     "\n"                                                                       \
-    "database file located in ~/.local/share/drun/runs. \n"                    \
-    "If no match is found, the run will be added to the database."
+    "Environment: \n"                                                          \
+    "  DRUN_API                  base URI of the speedrun.com API \n"          \
+    "                              (default: " API_URI ")"
 
 /* -v message */
 #define VERSION_MSG                                                            \
-    "drun v1.0 \n"                                                             \
-    "License Unlicense: <https://unlicense.org> \n"                            \
-    "This is part of the modutils collection; see \n"                          \
-    "<https://www.github.com/MCBE-Speedrunning/modutils>"
+    "drun v1.0 \n" MODUTILS_NOTICE
+
+/* Default base URI of the speedrun.com API, overridden by $DRUN_API */
+#define API_URI "https://www.speedrun.com/api/v1"
 
 #ifndef size_t
 #    include <stdio.h>
 #endif
 
+#include <stdbool.h>
+
+#include "arena.h"
+#include "json.h"
+#include "modutils.h"
+
+/* Defaults of the request options */
+#define CONNECT_TIMEOUT 5000
+#define TOTAL_TIMEOUT   30000
+#define RETRIES         3
+
+/* First retry delay in milliseconds, doubled for every further retry */
+#define RETRY_BACKOFF 250
+
+/* Requests are only hedged once the latency percentiles are meaningful */
+#define HEDGE_MIN_SAMPLES 20
+
+/* Upper limit of the videos checked per run, links and comment together */
+#define RUN_MAX_VIDEOS 16
+
+/**
+ * @brief How requests to the API are made
+ * 
+ * @param connect_ms The connect timeout in milliseconds
+ * @param total_ms The timeout of every attempt in milliseconds
+ * @param retries How often requests that failed transiently are retried
+ * @param hedge Whether to send a second request when the first one is slower
+ * than 95% of the requests so far
+ */
+typedef struct {
+    long connect_ms;
+    long total_ms;
+    unsigned int retries;
+    bool hedge;
+} fetch_opts_t;
+
+/* The request options of the process */
+extern fetch_opts_t fetch_opts;
+
 /**
  * @brief A simple struct representing a string, to make working with them a
  * a bit easier
@@ -43,39 +146,59 @@ typedef struct {
  * @brief A struct containing all the information required for the given run
  * 
  * @param json A string_t containing the result of the API request
+ * @param tokens The tokens of `json`
+ * @param ntokens The number of tokens
  * @param id The ID of the run on sr.c
- * @param vid The uri of the runs video
+ * @param vids The canonical uris of the runs videos, its links first and then
+ * those found in its comment, without repeats
+ * @param nvids The number of videos
+ * @param arena The arena all of the above is allocated from, reset once the
+ * run is checked
  */
 typedef struct {
     string_t json;
+    jsmntok_t *tokens;
+    int ntokens;
     char *id;
-    char *vid;
+    char *vids[RUN_MAX_VIDEOS];
+    size_t nvids;
+    arena_t *arena;
 } run_t;
 
 /**
- * @brief Search the `runs` file for runs with the same video
+ * @brief Where curl writes a response to
  * 
- * @param fp Pointer to the `runs` file
- * @param video_uri The uri to look for a duplicate of
- * @return char* The uri of the duplicate run, if none found this is NULL
+ * @param json The string the response is appended to
+ * @param cap The number of bytes allocated for `json->ptr`, 0 until the size
+ * of the response is known
+ * @param arena The arena `json->ptr` is allocated from
+ * @param curl The curl handle of the transfer
  */
-char *find_duplicate(FILE *fp, const char *video_uri);
+typedef struct {
+    string_t *json;
+    size_t cap;
+    arena_t *arena;
+    void *curl;
+} sink_t;
 
 /**
- * @brief Parse the JSON string to get the video URI
+ * @brief Tokenize the JSON of the run into `run->tokens` and get the URIs of
+ * its videos into `run->vids`. Every link of the run is taken, and so are the
+ * links to videos of known platforms in the text of its videos and in its
+ * comment.
  * 
- * @param json The JSON to parse
- * @return char* The URI of the runs video, if no video is found the return
- * value is NULL
+ * @param run The run whose JSON to parse
+ * @return size_t The number of videos, 0 if no video is found
  */
-char *parse_json(string_t *json);
+size_t parse_json(run_t *run);
 
 /**
  * @brief Initialze the `string_t` struct
  * 
  * @param json Pointer to the struct to initialze
+ * @param arena The arena to allocate the string from
  */
-void init_string(string_t *json);
+void init_string(string_t *json, arena_t *arena);
 
 /**
  * @brief Read the incoming bytes from curl into `json`
@@ -83,26 +206,73 @@ void init_string(string_t *json);
  * @param ptr A pointer to the delivered data
  * @param size 1
  * @param nmemb Number of bytes recieved
- * @param json pointer to the string_t struct where the json will be stored
+ * @param sink Where the json will be stored. The buffer is sized once from
+ * the Content-Length of the response, and doubled if there is none.
  * @return size_t The number of bytes taken care of
  */
 size_t write_callback(const void *ptr, const size_t size, const size_t nmemb,
-                      string_t *json);
+                      sink_t *sink);
+
+/**
+ * @brief Download the contents of `uri` to `json`, this is safe to call from
+ * any thread
+ * 
+ * @param uri The URI to download
+ * @param json Where to store the contents
+ * @param arena The arena `json` is allocated from
+ * @return bool false if it could not be downloaded, which was reported
+ */
+bool dl_uri(const char *uri, string_t *json, arena_t *arena);
+
+/**
+ * @brief Get the base URI of the speedrun.com API
+ * 
+ * @return const char* $DRUN_API if it is set, `API_URI` otherwise
+ */
+const char *api_uri(void);
 
 /**
  * @brief Download the contents of the API request to `json`
  * 
  * @param runid The ID of the run to get the json of
  * @param json Where to store the json
- * @return char* The sr.c run URI
+ * @param arena The arena `json` is allocated from
+ * @return char* The sr.c run URI, NULL if it could not be downloaded
+ */
+char *dl_json(const char *runid, string_t *json, arena_t *arena);
+
+/**
+ * @brief Get the directory drun stores its data in, creating it if needed
+ * 
+ * @return const char* The path of ~/.local/share/drun
  */
-char *dl_json(const char *runid, string_t *json);
+const char *data_dir(void);
 
 /**
- * @brief Read the run id from stdin into `run->id`
+ * @brief Check the downloaded run for a duplicate video, add it to the
+ * database if there is none and store its metadata
  * 
- * @param run The run_t struct to store the id into 
+ * @param run The run, with `run->id` and `run->json` set
+ */
+void check_run(run_t *run);
+
+/**
+ * @brief Read the next run id from stdin into `run->id`
+ * 
+ * @param run The run_t struct to store the id into, allocated from `run->arena`
+ * @return bool false if the end of stdin was reached
+ */
+bool get_id(run_t *run);
+
+/**
+ * @brief Release the curl handles of the calling thread
+ */
+void dl_cleanup(void);
+
+/**
+ * @brief Release the curl handle, files and line buffer that are reused by
+ * every run. Registered with atexit().
  */
-void get_id(run_t *run);
+void cleanup(void);
 
 #endif /* !__DRUN_H_ */
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef __EXTSORT_H_
+#define __EXTSORT_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * An external merge sort of lines in bounded memory. Lines are collected in
+ * memory until they take up the budget, then sorted and spilled to a temporary
+ * file as a sorted run. The runs are merged back with a heap, at most
+ * EXTSORT_FANIN at a time, so any number of lines is sorted in a few
+ * sequential passes over the disk. Lines that fit into the budget are never
+ * written out.
+ */
+
+/* Runs merged at once, more are merged in passes first */
+#define EXTSORT_FANIN 64
+
+/**
+ * @brief A sorted run being merged
+ *
+ * @param fp The spilled run, rewound
+ * @param line The current line of the run, without its newline
+ * @param len The length of `line`
+ * @param size The number of bytes allocated for `line`
+ */
+typedef struct {
+    FILE *fp;
+    char *line;
+    size_t len, size;
+} xs_run_t;
+
+/**
+ * @brief A sort of lines, first collecting lines and then handing them out in
+ * order
+ *
+ * @param budget The number of bytes lines may take up in memory
+ * @param buf The lines collected in memory, NUL terminated
+ * @param used The number of bytes used in `buf`
+ * @param cap The number of bytes allocated for `buf`
+ * @param offs The offset of every line in `buf`
+ * @param n The number of lines in `buf`
+ * @param ncap The number of offsets allocated
+ * @param next The next line of `buf` to hand out
+ * @param spills The sorted runs spilled to disk
+ * @param nspills The number of spilled runs
+ * @param heap The runs being merged, by their current line
+ * @param nheap The number of runs in `heap`
+ * @param advance Whether the line last handed out is the current line of the
+ * first run in `heap`, which must be read past first
+ */
+typedef struct {
+    size_t budget;
+    char *buf;
+    size_t used, cap;
+    size_t *offs;
+    size_t n, ncap, next;
+    FILE **spills;
+    size_t nspills;
+    xs_run_t *heap;
+    size_t nheap;
+    bool advance;
+} extsort_t;
+
+/**
+ * @brief Start a sort
+ *
+ * @param xs The sort to start
+ * @param budget The number of bytes of lines to keep in memory
+ */
+void extsort_init(extsort_t *xs, const size_t budget);
+
+/**
+ * @brief Add a line to the sort
+ *
+ * @param xs The sort
+ * @param line The line, which contains no newline or NUL and does not need
+ * to be NUL terminated
+ * @param len The length of `line`
+ */
+void extsort_add(extsort_t *xs, const char *line, const size_t len);
+
+/**
+ * @brief Stop adding lines and get ready to hand them out in order. Lines are
+ * compared bytewise, like strcmp().
+ *
+ * @param xs The sort
+ */
+void extsort_finish(extsort_t *xs);
+
+/**
+ * @brief Get the next line in order
+ *
+ * @param xs The finished sort
+ * @param len Where to store the length of the line
+ * @return const char* The NUL terminated line, valid until the next call, or
+ * NULL once all lines were handed out
+ */
+const char *extsort_next(extsort_t *xs, size_t *len);
+
+/**
+ * @brief Free all memory and temporary files of the sort
+ *
+ * @param xs The sort to free
+ */
+void extsort_free(extsort_t *xs);
+
+#endif /* !__EXTSORT_H_ */
@@ -0,0 +1,112 @@
+#ifndef __HISTORY_H_
+#define __HISTORY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Every retime is appended to a log, so a run that is reviewed again or
+ * disputed does not have to be retimed from scratch. A line of the log is
+ *
+ *     VIDEO\tSTART\tEND\tFPS\tTIME\tNOTE
+ *
+ * where VIDEO is the YouTube video ID, or the absolute path of a local file
+ * so that it is found from any directory. The log
+ * is indexed by an append only file of the hash of the video and the offset
+ * of every line, so the last retime of a video is found without reading the
+ * log. Lines appended by a retime that crashed before indexing them are
+ * indexed when the log is next opened.
+ */
+
+/* Longest line of the log, longer lines are cut */
+#define HISTORY_LINE 1024
+
+/* Longest video of the log, the retimes of longer ones are not kept */
+#define HISTORY_VIDEO (HISTORY_LINE / 2)
+
+/**
+ * @brief An entry of the index
+ *
+ * @param hash The hash of the video
+ * @param off The offset of the line in the log
+ */
+typedef struct {
+    uint64_t hash;
+    uint64_t off;
+} hist_entry_t;
+
+/**
+ * @brief The history of retimes, empty if it can't be opened
+ *
+ * @param log The log, opened for reading and appending
+ * @param idx The index, opened for appending
+ * @param entries The index, oldest first
+ * @param n The number of entries
+ * @param cap The number of entries allocated
+ */
+typedef struct {
+    FILE *log;
+    FILE *idx;
+    hist_entry_t *entries;
+    size_t n, cap;
+} history_t;
+
+/**
+ * @brief A retime
+ *
+ * @param video The YouTube video ID or the path of the video file
+ * @param start The first frame of the run
+ * @param end The last frame of the run
+ * @param fps The framerate of the video
+ * @param time The duration of the run, formatted
+ * @param note The mod note of the retime
+ */
+typedef struct {
+    const char *video;
+    unsigned long start;
+    unsigned long end;
+    const char *fps;
+    const char *time;
+    const char *note;
+} retime_t;
+
+/**
+ * @brief Open the history in ~/.local/share/retime, or %APPDATA%\retime on
+ * Windows, creating it if needed
+ *
+ * @param history The history to open
+ * @return bool Whether there is a history, retimes are not kept without one
+ */
+bool history_open(history_t *history);
+
+/**
+ * @brief Find the last retime of a video
+ *
+ * @param history The history
+ * @param video The YouTube video ID or the path of the video file
+ * @param note Where to store the mod note of the retime
+ * @param size The size of `note`
+ * @return bool Whether the video was retimed before
+ */
+bool history_find(history_t *history, const char *video, char *note,
+                  const size_t size);
+
+/**
+ * @brief Append a retime to the history. A video of `HISTORY_VIDEO` bytes or
+ * more would not be found again, so its retime is not kept.
+ *
+ * @param history The history
+ * @param retime The retime
+ */
+void history_add(history_t *history, const retime_t *retime);
+
+/**
+ * @brief Close the history
+ *
+ * @param history The history to close
+ */
+void history_close(history_t *history);
+
+#endif /* !__HISTORY_H_ */
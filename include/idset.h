@@ -0,0 +1,79 @@
+#ifndef __IDSET_H_
+#define __IDSET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A set of packed YouTube IDs, see `canon_pack()`, that takes a few bytes per
+ * video rather than the string of its URI. The IDs are sorted and stored with
+ * the Elias-Fano encoding: the low bits of every ID as they are, and the high
+ * bits as the gaps between them in unary. That is about 2 + log2(2^64 / n)
+ * bits per ID, under 5 bytes for 100 million videos.
+ *
+ * An ID is looked up by finding the first ID with the same high bits, with
+ * the position of every `IDSET_SAMPLE`th zero of the unary part, and
+ * comparing the low bits of the IDs that share them.
+ */
+
+/* Zeros of the unary part between the positions kept to find them */
+#define IDSET_SAMPLE 256
+
+/**
+ * @brief An immutable set of packed IDs
+ *
+ * @param n The number of IDs
+ * @param low_bits The number of low bits of every ID
+ * @param max The largest ID
+ * @param lows The low bits of every ID, `low_bits` each
+ * @param highs The high bits of the IDs in unary, a one for every ID and a
+ * zero after the IDs of every value of the high bits
+ * @param nhighs The number of bits of `highs`
+ * @param zeros The position of every `IDSET_SAMPLE`th zero of `highs`
+ */
+typedef struct {
+    size_t n;
+    unsigned int low_bits;
+    uint64_t max;
+    uint64_t *lows;
+    uint64_t *highs;
+    uint64_t nhighs;
+    uint64_t *zeros;
+} idset_t;
+
+/**
+ * @brief Build a set
+ *
+ * @param set The set to build
+ * @param ids The IDs, in any order and with duplicates. They are sorted in
+ * place.
+ * @param n The number of IDs
+ */
+void idset_build(idset_t *set, uint64_t *ids, const size_t n);
+
+/**
+ * @brief Whether an ID is in the set
+ *
+ * @param set The set
+ * @param id The packed ID
+ * @return bool Whether `id` is in the set
+ */
+bool idset_has(const idset_t *set, const uint64_t id);
+
+/**
+ * @brief The memory taken by the set
+ *
+ * @param set The set
+ * @return size_t The number of bytes allocated for the set
+ */
+size_t idset_bytes(const idset_t *set);
+
+/**
+ * @brief Free a set
+ *
+ * @param set The set to free
+ */
+void idset_free(idset_t *set);
+
+#endif /* !__IDSET_H_ */
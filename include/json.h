@@ -0,0 +1,62 @@
+#ifndef __JSON_H_
+#define __JSON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSMN_HEADER
+#include "arena.h"
+#include "jsmn.h"
+
+/**
+ * @brief Tokenize a JSON string, allocating as many tokens as it needs
+ *
+ * @param js The JSON string
+ * @param len The length of `js`
+ * @param tokens Where to store the pointer to the allocated tokens
+ * @param arena The arena to allocate the tokens from
+ * @return int The number of tokens, or a negative jsmn error code
+ */
+int json_tokenize(const char *js, const size_t len, jsmntok_t **tokens,
+                  arena_t *arena);
+
+/**
+ * @brief Exit with a message if a JSON string could not be tokenized
+ *
+ * @param ret The return value of `json_tokenize()`
+ */
+void json_check(const int ret);
+
+/**
+ * @brief Compare a string token against a C string
+ *
+ * @param js The JSON string
+ * @param tok The token to compare
+ * @param str The string to compare against
+ * @return bool true if the token is a string equal to `str`
+ */
+bool json_eq(const char *js, const jsmntok_t *tok, const char *str);
+
+/**
+ * @brief Get the index of the token after the token `i` and all its children
+ *
+ * @param tokens The tokens
+ * @param i The index of the token to skip
+ * @return int The index of the next sibling of `i`
+ */
+int json_skip(const jsmntok_t *tokens, int i);
+
+/**
+ * @brief Find the value of `key` in an object
+ *
+ * @param js The JSON string
+ * @param tokens The tokens
+ * @param obj The index of the object token
+ * @param key The key to look for
+ * @return int The index of the value token, or -1 if `obj` is not an object or
+ * `key` is not in it
+ */
+int json_get(const char *js, const jsmntok_t *tokens, const int obj,
+             const char *key);
+
+#endif /* !__JSON_H_ */
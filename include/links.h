@@ -0,0 +1,43 @@
+#ifndef __LINKS_H_
+#define __LINKS_H_
+
+#include <stddef.h>
+
+/*
+ * Links to videos are found in free text, e.g. the comment of a run, by the
+ * hosts of the platforms canon.h knows, followed by a slash. All hosts are
+ * looked for at once by an Aho-Corasick automaton, so the text is read once
+ * however many hosts there are.
+ */
+
+/* Upper limit of the states of the automaton, the hosts have fewer bytes */
+#define LINKS_STATES 256
+
+/**
+ * @brief A link found in the text, not NUL terminated
+ *
+ * @param ptr The start of the link, with its scheme and subdomains if it has
+ * them
+ * @param len The length of the link
+ */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} link_t;
+
+/**
+ * @brief Find the links to known video platforms in a text, in the order they
+ * appear in. A link ends at white space, quotes, brackets or a backslash, and
+ * loses trailing punctuation, so links in JSON strings and in prose are found
+ * as they were meant.
+ *
+ * @param text The text, which does not need to be NUL terminated
+ * @param len The length of `text`
+ * @param links Where to store the links
+ * @param max The number of links `links` has room for
+ * @return size_t The number of links found
+ */
+size_t links_find(const char *text, const size_t len, link_t *links,
+                  const size_t max);
+
+#endif /* !__LINKS_H_ */
@@ -0,0 +1,48 @@
+#ifndef __LZ_H_
+#define __LZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A small compressor producing the LZ4 block format, so that blocks can be
+ * inspected with any LZ4 implementation. Matches are found greedily with a
+ * single hash table of 4 byte sequences.
+ */
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_DIST  65535
+
+/**
+ * @brief Get the largest size a block can compress to
+ *
+ * @param len The size of the uncompressed block
+ * @return size_t The number of bytes to allocate for the compressed block
+ */
+size_t lz_bound(const size_t len);
+
+/**
+ * @brief Compress a block
+ *
+ * @param src The uncompressed block
+ * @param len The size of `src`
+ * @param dst Where to store the compressed block, at least `lz_bound(len)`
+ * bytes
+ * @return size_t The size of the compressed block
+ */
+size_t lz_compress(const uint8_t *src, const size_t len, uint8_t *dst);
+
+/**
+ * @brief Decompress a block
+ *
+ * @param src The compressed block
+ * @param len The size of `src`
+ * @param dst Where to store the uncompressed block
+ * @param raw The size of the uncompressed block
+ * @return bool false if the block is corrupt
+ */
+bool lz_decompress(const uint8_t *src, const size_t len, uint8_t *dst,
+                   const size_t raw);
+
+#endif /* !__LZ_H_ */
@@ -0,0 +1,199 @@
+#ifndef __META_H_
+#define __META_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "drun.h"
+#include "json.h"
+
+/* Length of the IDs used by sr.c for runs, games, categories and users */
+#define META_ID_LEN      8
+#define META_MAX_PLAYERS 32
+#define META_MAX_VIDEOS  32
+
+/* Bits of the `flags` column */
+#define META_DUPLICATE 0x01
+
+/**
+ * @brief The metadata of a run that is persisted in the column store. All
+ * strings point into the JSON the metadata was parsed from and are not NUL
+ * terminated.
+ *
+ * @param id The ID of the run
+ * @param game The ID of the game
+ * @param category The ID of the category
+ * @param players The IDs of the players, or the names of guests
+ * @param videos All video links of the run
+ * @param nplayers The number of players
+ * @param nvideos The number of video links
+ * @param submitted The submission date as a UNIX timestamp, 0 if unknown
+ */
+typedef struct {
+    string_t id;
+    string_t game;
+    string_t category;
+    string_t players[META_MAX_PLAYERS];
+    string_t videos[META_MAX_VIDEOS];
+    unsigned int nplayers;
+    unsigned int nvideos;
+    uint32_t submitted;
+} meta_t;
+
+/**
+ * @brief A dictionary mapping strings to dense integer codes, stored as one
+ * entry per line
+ *
+ * @param fd The file descriptor of the dictionary file
+ * @param buf The contents of the dictionary file
+ * @param size The number of bytes used in `buf`
+ * @param cap The number of bytes allocated for `buf`
+ * @param offs The offset of every entry in `buf`
+ * @param n The number of entries
+ * @param table Open addressing hash table of entry codes plus one
+ * @param mask The size of `table` minus one
+ */
+typedef struct {
+    int fd;
+    char *buf;
+    size_t size, cap;
+    uint32_t *offs;
+    uint32_t n;
+    uint32_t *table;
+    size_t mask;
+} dict_t;
+
+/* The columns of the store, one file each */
+enum {
+    COL_ID,
+    COL_GAME,
+    COL_CATEGORY,
+    COL_SUBMITTED,
+    COL_FLAGS,
+    COL_PLAYERS_IDX,
+    COL_PLAYERS,
+    COL_VIDEOS_IDX,
+    COL_VIDEOS,
+    NCOLS
+};
+
+/* The dictionary encoded string columns */
+enum { DICT_GAME, DICT_CATEGORY, DICT_PLAYER, NDICTS };
+
+/**
+ * @brief An open column store
+ *
+ * @param dir The directory containing the column and dictionary files
+ * @param lock The lock file, locked exclusively while the store is recovered
+ * or appended to, as several processes may append to it at once
+ * @param fd The file descriptor of every column
+ * @param map The read-only mapping of every column at open time
+ * @param mapped The length of every mapping, the column may have grown since
+ * @param size The size of every column in bytes
+ * @param rows The number of complete rows
+ * @param dicts The dictionaries of the string columns
+ * @param ids Open addressing set of all run IDs, built on the first append
+ * @param idmask The size of `ids` minus one
+ */
+typedef struct {
+    char dir[1024];
+    int lock;
+    int fd[NCOLS];
+    void *map[NCOLS];
+    size_t mapped[NCOLS];
+    size_t size[NCOLS];
+    size_t rows;
+    dict_t dicts[NDICTS];
+    uint64_t *ids;
+    size_t idmask;
+} meta_db_t;
+
+/**
+ * @brief The filters of a query, NULL matches everything
+ *
+ * @param game Only match runs of this game
+ * @param category Only match runs of this category
+ * @param player Only match runs with this player
+ */
+typedef struct {
+    const char *game;
+    const char *category;
+    const char *player;
+} meta_filter_t;
+
+/**
+ * @brief Parse an ISO 8601 date like 2020-05-01T12:34:56Z
+ *
+ * @param str The date, which does not need to be NUL terminated
+ * @param len The length of `str`
+ * @return uint32_t The date as a UNIX timestamp, 0 if it is invalid
+ */
+uint32_t meta_date(const char *str, const size_t len);
+
+/**
+ * @brief Extract the metadata of a run from its API response
+ *
+ * @param run The run, which must already be tokenized by `parse_json()`. Its
+ * JSON is either a single run API response or a bare run object.
+ * @param meta Where to store the metadata
+ * @return bool false if the response contains no run
+ */
+bool meta_parse(const run_t *run, meta_t *meta);
+
+/**
+ * @brief Open the column store in `dir`, creating it if needed. Rows left
+ * incomplete by a crash are discarded.
+ *
+ * @param db The store to open
+ * @param dir The directory of the store
+ */
+void meta_open(meta_db_t *db, const char *dir);
+
+/**
+ * @brief Append a run to the store, unless a run with the same ID is already
+ * stored, also by another process since the store was opened
+ *
+ * @param db The store
+ * @param meta The metadata of the run
+ * @param flags The flags of the run, e.g. `META_DUPLICATE`
+ * @return bool true if the run was appended
+ */
+bool meta_append(meta_db_t *db, const meta_t *meta, const uint8_t flags);
+
+/**
+ * @brief Close the store and free all memory associated with it
+ *
+ * @param db The store to close
+ */
+void meta_close(meta_db_t *db);
+
+/**
+ * @brief Find an entry of a dictionary
+ *
+ * @param dict The dictionary
+ * @param str The entry, which does not need to be NUL terminated
+ * @param len The length of `str`
+ * @return uint32_t The code of the entry, UINT32_MAX if it is not stored
+ */
+uint32_t dict_find(const dict_t *dict, const char *str, const size_t len);
+
+/**
+ * @brief Print an entry of a dictionary to stdout, "-" if there is none
+ *
+ * @param dict The dictionary
+ * @param code The code of the entry
+ */
+void dict_print(const dict_t *dict, const uint32_t code);
+
+/**
+ * @brief Run a query over the store and print the result to stdout
+ *
+ * @param db The store to query
+ * @param query One of "count", "runs", "dups" or "players"
+ * @param filter The filters to apply
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE for an unknown query
+ */
+int meta_query(const meta_db_t *db, const char *query,
+               const meta_filter_t *filter);
+
+#endif /* !__META_H_ */
@@ -0,0 +1,127 @@
+#ifndef __METRICS_H_
+#define __METRICS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Histograms are log-linear like HdrHistogram: values below 2^HIST_SUB_BITS
+ * get a bucket each, every power of two above that is split into
+ * 2^(HIST_SUB_BITS - 1) buckets, which bounds the relative error by 1/16.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_HALF     (HIST_SUB / 2)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 2) * HIST_HALF)
+
+/**
+ * @brief A histogram of durations in microseconds
+ *
+ * @param counts The number of values in every bucket
+ * @param count The number of values
+ * @param sum The sum of all values
+ * @param max The largest value
+ */
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} hist_t;
+
+/* The histograms that are recorded */
+enum { HIST_FETCH, HIST_PARSE, HIST_LOOKUP, HIST_STORE, NHISTS };
+
+/* The counters that are recorded */
+enum {
+    CNT_RUNS,
+    CNT_DUPLICATES,
+    CNT_NEW,
+    CNT_NO_VIDEO,
+    CNT_BLOCKED,
+    CNT_REQUESTS,
+    CNT_RETRIES,
+    CNT_HEDGED,
+    CNT_BYTES,
+    NCOUNTERS
+};
+
+/**
+ * @brief All metrics of the process
+ *
+ * @param hists The histograms
+ * @param counters The counters
+ * @param textfile Where `metrics_flush()` exports the metrics to, if not NULL
+ * @param stats Whether `metrics_flush()` prints a summary to stderr
+ */
+typedef struct {
+    hist_t hists[NHISTS];
+    uint64_t counters[NCOUNTERS];
+    const char *textfile;
+    bool stats;
+} metrics_t;
+
+extern metrics_t metrics;
+
+/**
+ * @brief Get the current time of a monotonic clock
+ *
+ * @return uint64_t The time in microseconds
+ */
+uint64_t metrics_now(void);
+
+/**
+ * @brief Record the time elapsed since `start` in a histogram
+ *
+ * @param hist One of the HIST_* constants
+ * @param start The start time as returned by `metrics_now()`
+ */
+void metrics_time(const int hist, const uint64_t start);
+
+/**
+ * @brief Add to a counter, from any thread
+ *
+ * @param counter One of the CNT_* constants
+ * @param n The amount to add
+ */
+void metrics_count(const int counter, const uint64_t n);
+
+/**
+ * @brief Record a value in a histogram, from any thread
+ *
+ * @param hist The histogram
+ * @param value The value to record
+ */
+void hist_record(hist_t *hist, const uint64_t value);
+
+/**
+ * @brief Get a percentile of the values in a histogram
+ *
+ * @param hist The histogram
+ * @param p The percentile, from 0 to 100
+ * @return uint64_t The highest value equivalent to the percentile
+ */
+uint64_t hist_percentile(const hist_t *hist, const double p);
+
+/**
+ * @brief Print a one line summary of the metrics
+ *
+ * @param fp Where to print the summary
+ */
+void metrics_print(FILE *fp);
+
+/**
+ * @brief Write the metrics to a file in the Prometheus text format. The file
+ * is replaced atomically, so it can be read by the node exporter at any time.
+ *
+ * @param path The path of the file
+ */
+void metrics_export(const char *path);
+
+/**
+ * @brief Export the metrics and print the summary, as configured in `metrics`
+ */
+void metrics_flush(void);
+
+#endif /* !__METRICS_H_ */
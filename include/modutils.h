@@ -0,0 +1,48 @@
+#ifndef __MODUTILS_H_
+#define __MODUTILS_H_
+
+/* -h message of the multicall binary */
+#define MODUTILS_HELP_MSG                                                      \
+    "Usage: modutils TOOL [OPTIONS]... \n"                                     \
+    "   or: TOOL [OPTIONS]... \n"                                              \
+    "Run one of the modutils, given by name or by the name of a link to \n"    \
+    "this binary. Example: modutils drun -h \n"                                \
+    "\n"                                                                       \
+    "Tools: \n"                                                                \
+    "  drun                      find stolen videos of speedrun.com runs \n"   \
+    "  retime                    retime a segment of a video \n"               \
+    "\n"                                                                       \
+    "Miscellaneous: \n"                                                        \
+    "  -h                        display this help text and exit \n"           \
+    "  -v                        display version information and exit"
+
+/* The end of the -v message of every tool */
+#define MODUTILS_NOTICE                                                        \
+    "License Unlicense: <https://unlicense.org> \n"                            \
+    "This is part of the modutils collection; see \n"                          \
+    "<https://www.github.com/MCBE-Speedrunning/modutils>"
+
+/* -v message of the multicall binary */
+#define MODUTILS_VERSION_MSG                                                   \
+    "modutils v1.0 \n" MODUTILS_NOTICE
+
+/**
+ * @brief The main() of drun, which is a tool of its own or part of the
+ * multicall binary
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments, `argv[0]` is the name of the tool
+ * @return int The exit status
+ */
+int drun_main(int argc, char **argv);
+
+/**
+ * @brief The main() of retime, see `drun_main()`
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments, `argv[0]` is the name of the tool
+ * @return int The exit status
+ */
+int retime_main(int argc, char **argv);
+
+#endif /* !__MODUTILS_H_ */
@@ -0,0 +1,118 @@
+#ifndef __PIPELINE_H_
+#define __PIPELINE_H_
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "drun.h"
+#include "meta.h"
+
+/* Runs in flight between the stages, which bounds the memory of the pipeline */
+#define PIPELINE_DEPTH 64
+
+/* Upper limit of threads downloading runs */
+#define PIPELINE_MAX_JOBS 32
+
+/**
+ * @brief What was parsed from the JSON of a run besides its videos
+ *
+ * @param meta The metadata of the run
+ * @param has_meta Whether `meta` could be parsed
+ * @param game The game ID of the run, NULL without metadata
+ * @param category The category ID of the run, NULL without metadata
+ * @param blocked The videos of the run that are on the blocklist
+ * @param nblocked The number of videos in `blocked`
+ */
+typedef struct {
+    meta_t meta;
+    bool has_meta;
+    char *game;
+    char *category;
+    char *blocked[RUN_MAX_VIDEOS];
+    size_t nblocked;
+} parsed_t;
+
+/**
+ * @brief A run passed from stage to stage, along with the arena everything of
+ * the run is allocated from. Jobs are recycled once the run was stored.
+ *
+ * @param run The run
+ * @param parsed What was parsed from the JSON of the run
+ * @param arena The arena of the run
+ * @param seq The position of the run in the input
+ * @param failed Whether the run could not be downloaded, or was not as an
+ * earlier one could not be. It is then not parsed and ends the pipeline.
+ */
+typedef struct {
+    run_t run;
+    parsed_t parsed;
+    arena_t arena;
+    size_t seq;
+    bool failed;
+} job_t;
+
+/**
+ * @brief Parse the JSON of a run, the first half of `check_run()`. This only
+ * touches the run, so it can be done on any thread.
+ *
+ * @param run The run, with `run->json` set
+ * @param parsed Where to store what was parsed besides `run->vids`
+ */
+void parse_run(run_t *run, parsed_t *parsed);
+
+/**
+ * @brief Look for a duplicate of a parsed run, add it to the database if
+ * there is none and store its metadata, the second half of `check_run()`.
+ * This must only be done by one thread.
+ *
+ * @param run The run, as parsed by `parse_run()`
+ * @param parsed What was parsed besides `run->vids`
+ */
+void store_run(run_t *run, const parsed_t *parsed);
+
+/**
+ * @brief Open the databases `store_run()` uses and read what its first lookup
+ * would, so that this overlaps with downloading the first run rather than
+ * following it
+ */
+void warm_run(void);
+
+/**
+ * @brief Report a parsed run given the duplicates of its videos, add it to the
+ * database if it is new and store its metadata. This must only be done by one
+ * thread.
+ *
+ * @param run The run, as parsed by `parse_run()`
+ * @param parsed What was parsed besides `run->vids`
+ * @param found The line of a run with the same video for every video of the
+ * run, or NULL
+ */
+void settle_run(run_t *run, const parsed_t *parsed, char *const *found);
+
+/* Takes every parsed run from the pipeline, in order, e.g. `store_run()` */
+typedef void (*pipeline_sink_t)(run_t *run, const parsed_t *parsed);
+
+/* Gets the sink ready while the first runs are downloaded, e.g. `warm_run()` */
+typedef void (*pipeline_warm_t)(void);
+
+/**
+ * @brief Check every run read from STDIN, in order. Reading the IDs,
+ * downloading, parsing and the database are stages on their own threads,
+ * connected by bounded lock-free queues, so the slowest stage bounds the
+ * throughput. Runs are handed to the download threads in turns and taken back
+ * in the same turns, which keeps every queue single producer and single
+ * consumer and the output in the order of the input.
+ *
+ * A run that could not be downloaded stops the pipeline: the runs before it
+ * are still taken by the sink, the ones after it are dropped.
+ *
+ * @param jobs The number of threads downloading runs
+ * @param warm What to do on the calling thread once the downloads started,
+ * before the first run is parsed, or NULL
+ * @param sink What to do with every parsed run, on the calling thread
+ * @return bool false if a run could not be downloaded
+ */
+bool pipeline(const unsigned int jobs, const pipeline_warm_t warm,
+              const pipeline_sink_t sink);
+
+#endif /* !__PIPELINE_H_ */
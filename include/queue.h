@@ -0,0 +1,66 @@
+#ifndef __QUEUE_H_
+#define __QUEUE_H_
+
+#include <stddef.h>
+
+/* Size of a cache line, the producer and consumer indexes are kept apart */
+#define QUEUE_LINE 64
+
+/* Spins of a waiting thread before it starts to sleep, and its longest nap */
+#define QUEUE_SPINS     128
+#define QUEUE_MAX_SLEEP 1000000
+
+/**
+ * @brief A bounded lock-free queue of pointers with a single producer and a
+ * single consumer. Each index is only written by one side and read by the
+ * other with acquire/release ordering, so neither side ever takes a lock.
+ *
+ * @param head The index of the next item to pop, written by the consumer
+ * @param tail The index of the next item to push, written by the producer
+ * @param items The ring buffer of items
+ * @param mask The capacity of the queue minus one
+ */
+typedef struct {
+    size_t head;
+    char pad0[QUEUE_LINE - sizeof(size_t)];
+    size_t tail;
+    char pad1[QUEUE_LINE - sizeof(size_t)];
+    void **items;
+    size_t mask;
+} queue_t;
+
+/**
+ * @brief Initialize an empty queue, exits on allocation failure
+ *
+ * @param queue The queue to initialize
+ * @param cap The number of items the queue holds at least, rounded up to a
+ * power of two
+ */
+void queue_init(queue_t *queue, const size_t cap);
+
+/**
+ * @brief Append an item, waiting while the queue is full. Only one thread may
+ * push to a queue.
+ *
+ * @param queue The queue
+ * @param item The item to append, which may be NULL
+ */
+void queue_push(queue_t *queue, void *item);
+
+/**
+ * @brief Remove the oldest item, waiting while the queue is empty. Only one
+ * thread may pop from a queue.
+ *
+ * @param queue The queue
+ * @return void* The oldest item
+ */
+void *queue_pop(queue_t *queue);
+
+/**
+ * @brief Free the memory of the queue
+ *
+ * @param queue The queue
+ */
+void queue_free(queue_t *queue);
+
+#endif /* !__QUEUE_H_ */
@@ -1,10 +1,19 @@
 #ifndef __RETIME_H_
 #define __RETIME_H_
 
+#include <stdbool.h>
+
+#include "modutils.h"
+#include "video.h"
+
 /* Exit status */
 #define BAD_YT_DEBUG 2
 #define BAD_FPS      3
 #define BAD_FLAG     4
+#define BAD_VIDEO    5
+
+/* Size of a mod note */
+#define NOTE_BUF 256
 
 /* -h message */
 #define HELP_MSG                                                               \
@@ -16,8 +25,16 @@
     "  -b                        bulk retime videos; \n"                       \
     "                              the b and m flags are preserved \n"         \
     "  -f                        set the FPS of the video being retimed \n"    \
+    "  -i                        retime a local MP4/MOV file by its frame \n"  \
+    "                              numbers or timestamps instead \n"           \
     "  -m                        output a mod retime note as opposed to the "  \
     "end duration \n"                                                          \
+    "  -n                        do not keep the retimes in the history \n"    \
+    " \n"                                                                      \
+    "History: \n"                                                              \
+    "Every retime is kept in ~/.local/share/retime/history, and the last \n"   \
+    "retime of a video is shown when its debug info or file is retimed \n"     \
+    "again. \n"                                                                \
     " \n"                                                                      \
     "Miscellaneous: \n"                                                        \
     "  -h                        display this help text and exit \n"           \
@@ -28,22 +45,12 @@
     " 1  if any sort of non-user related error occured, \n"                    \
     " 2  if invalid youtube debug info, \n"                                    \
     " 3  if invalid fps, \n"                                                   \
-    " 4  if invalid flag or missing option. \n"
+    " 4  if invalid flag or missing option, \n"                                \
+    " 5  if invalid video file or position. \n"
 
 /* -v message */
 #define VERSION_MSG                                                            \
-    "retime v1.0 \n"                                                           \
-    "License Unlicense: <https://unlicense.org> \n"                            \
-    "This is part of the modutils collection; see \n"                          \
-    "<https://www.github.com/MCBE-Speedrunning/modutils>"
-
-/**
- * @brief malloc() but with error checking
- * 
- * @param size The number of bytes to allocate
- * @return void* A pointer to the allocated memory
- */
-void *smalloc(const size_t size);
+    "retime v1.0 \n" MODUTILS_NOTICE
 
 /**
  * @brief Convert a string to a double
@@ -63,11 +70,15 @@ double str_to_double(const char *str_time);
 unsigned int check_fps(char *string);
 
 /**
- * @brief Get the total duration of the run
+ * @brief Read the YouTube debug info of a point in the run from stdin
  * 
- * @return double The duration of the run
+ * @param video Where to store the ID of the video, empty if the debug info
+ * has none
+ * @param video_size The size of `video`
+ * @return double The time of the point in the video, -1 if the debug info has
+ * none
  */
-double get_time(void);
+double get_time(char *video, const size_t video_size);
 
 /**
  * @brief Format the runs duration in the form HH:MM:SS.ms
@@ -77,4 +88,23 @@ double get_time(void);
  */
 char *format_time(const double time);
 
+/**
+ * @brief Read the frame number or timestamp of a point in a video from stdin
+ * 
+ * @param video The video the point is in
+ * @param prompt The prompt to print before reading
+ * @return size_t The index of the frame at that point
+ */
+size_t get_position(const video_t *video, const char *prompt);
+
+/**
+ * @brief Retime a run in a local video file, using the frame times stored in
+ * the file
+ * 
+ * @param path The path of the video file
+ * @param bflag Whether to keep retiming runs in the same video
+ * @param mflag Whether to output a mod note
+ */
+void retime_file(const char *path, const bool bflag, const bool mflag);
+
 #endif /* !__RETIME_H_ */
\ No newline at end of file
@@ -0,0 +1,174 @@
+#ifndef __STORE_H_
+#define __STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "db.h"
+
+/*
+ * The runs database behind one interface, so that how runs are stored can be
+ * chosen when drun is started:
+ *
+ *  text    the flat `runs` file, read from the start by every lookup
+ *  hashed  the `runs` file and its shards, with their indexes and cold
+ *          segments, see db.h
+ *  sqlite  the SQLite database `runs.sqlite`, if drun was built with SQLITE=1
+ *
+ * Every backend hands out runs as lines of `VIDEO RUN_URI\n`, like the lines of
+ * the `runs` file.
+ */
+
+/* The backend used if none is chosen */
+#define STORE_DEFAULT "hashed"
+
+typedef struct store store_t;
+
+/**
+ * @brief The operations of a backend, see the store_ functions of the same
+ * names. Backends that can't be compacted have no `compact`, backends with
+ * nothing to warm have no `warm`, backends without indexes of their own have
+ * no `reindex`.
+ */
+typedef struct {
+    const char *name;
+    void (*open)(store_t *store, const char *dir, const int by);
+    char *(*find)(store_t *store, const char *game, const char *category,
+                  const char *video_uri, const bool cross, arena_t *arena);
+    void (*warm)(store_t *store, const bool cross);
+    void (*add)(store_t *store, const char *game, const char *category,
+                const char *video_uri, const char *runid);
+    size_t (*remove)(store_t *store, const char *key, const bool by_run);
+    void (*iterate)(store_t *store, const db_visit_t visit, void *arg);
+    void (*compact)(store_t *store, const size_t keep);
+    size_t (*reindex)(store_t *store, const bool fix);
+    void (*close)(store_t *store);
+} store_ops_t;
+
+/**
+ * @brief An open runs database
+ *
+ * @param ops The backend
+ * @param db The database of the hashed backend
+ * @param path The `runs` file of the text backend
+ * @param fp The `runs` file of the text backend, opened for reading and
+ * appending
+ * @param line Line buffer of the text backend
+ * @param line_size The number of bytes allocated for `line`
+ * @param sql The state of the sqlite backend
+ */
+struct store {
+    const store_ops_t *ops;
+    db_t db;
+    char path[1024];
+    FILE *fp;
+    char *line;
+    size_t line_size;
+    void *sql;
+};
+
+extern const store_ops_t text_store, hashed_store;
+#ifdef DRUN_SQLITE
+extern const store_ops_t sqlite_store;
+#endif
+
+/**
+ * @brief Open the runs database with a backend, no file is touched until it
+ * is first used
+ *
+ * @param store The database to open
+ * @param backend The name of the backend, e.g. `STORE_DEFAULT`
+ * @param dir The directory of the database
+ * @param by How to partition runs into shards, `SHARD_NONE` for a single
+ * shard. The text backend has a single shard only.
+ * @return bool Whether there is a backend of that name
+ */
+bool store_open(store_t *store, const char *backend, const char *dir,
+                const int by);
+
+/**
+ * @brief Look for a run with the same video, see `db_find()`
+ *
+ * @param store The database
+ * @param game The game ID of the run, or NULL
+ * @param category The category ID of the run, or NULL
+ * @param video_uri The canonical uri to look for a duplicate of, see canon.h
+ * @param cross Whether to look in every shard
+ * @param arena The arena to copy the duplicate into
+ * @return char* The line of the duplicate run without its CRC, if none found
+ * this is NULL
+ */
+char *store_find(store_t *store, const char *game, const char *category,
+                 const char *video_uri, const bool cross, arena_t *arena);
+
+/**
+ * @brief Open the files the first lookups will read and get them into memory,
+ * e.g. while the first run is downloaded
+ *
+ * @param store The database
+ * @param cross Whether the lookups will look in every shard
+ */
+void store_warm(store_t *store, const bool cross);
+
+/**
+ * @brief Add a run
+ *
+ * @param store The database
+ * @param game The game ID of the run, or NULL
+ * @param category The category ID of the run, or NULL
+ * @param video_uri The canonical uri of the runs video
+ * @param runid The ID of the run on sr.c
+ */
+void store_add(store_t *store, const char *game, const char *category,
+               const char *video_uri, const char *runid);
+
+/**
+ * @brief Remove runs from every shard
+ *
+ * @param store The database
+ * @param key The canonical video URI or the run ID of the runs to remove
+ * @param by_run Whether `key` is a run ID
+ * @return size_t The number of runs removed
+ */
+size_t store_remove(store_t *store, const char *key, const bool by_run);
+
+/**
+ * @brief Call `visit` with every run that was not removed, in no particular
+ * order. `visit` must not use the database.
+ *
+ * @param store The database
+ * @param visit The function to call with every run
+ * @param arg Passed on to `visit`
+ */
+void store_iterate(store_t *store, const db_visit_t visit, void *arg);
+
+/**
+ * @brief Compress all but the newest runs, see `db_compact()`
+ *
+ * @param store The database
+ * @param keep The number of lines to keep in the hot segment
+ * @return bool Whether the backend can be compacted
+ */
+bool store_compact(store_t *store, const size_t keep);
+
+/**
+ * @brief Verify the indexes and filters against the runs, and rebuild them
+ * if asked to, see `db_reindex()`
+ *
+ * @param store The database
+ * @param fix Whether to replace the indexes and filters that differ
+ * @param differ Where to store the number of indexes and filters that differ
+ * @return bool Whether the backend has indexes of its own
+ */
+bool store_reindex(store_t *store, const bool fix, size_t *differ);
+
+/**
+ * @brief Close the database, a database that was never opened is ignored
+ *
+ * @param store The database to close
+ */
+void store_close(store_t *store);
+
+#endif /* !__STORE_H_ */
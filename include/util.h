@@ -0,0 +1,28 @@
+#ifndef __UTIL_H_
+#define __UTIL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Helpers shared by all modutils, next to the allocation wrappers of
+ * alloc.h.
+ */
+
+/**
+ * @brief Print the error of the last failed call on STDERR and exit. drun
+ * cannot go on without its database, so any failure to use it ends here.
+ */
+void die(void);
+
+/**
+ * @brief Hash a string with 64 bit FNV-1a. The hashes are stored in index
+ * files, so they must not change.
+ *
+ * @param str The string
+ * @param len The length of `str`
+ * @return uint64_t The hash of `str`
+ */
+uint64_t hash(const char *str, const size_t len);
+
+#endif /* !__UTIL_H_ */
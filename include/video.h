@@ -0,0 +1,68 @@
+#ifndef __VIDEO_H_
+#define __VIDEO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The frame timestamps of the video track of a local video file
+ *
+ * @param pts The presentation time of every frame in display order, relative
+ * to the first frame, in units of `timescale`
+ * @param frames The number of frames
+ * @param timescale The number of time units per second
+ * @param duration The sum of the durations of all frames
+ * @param vfr Whether the frames do not all have the same duration
+ */
+typedef struct {
+    uint64_t *pts;
+    size_t frames;
+    uint32_t timescale;
+    uint64_t duration;
+    int vfr;
+} video_t;
+
+/**
+ * @brief Read the frame timestamps of the first video track of an MP4 or
+ * QuickTime file from its sample tables, without decoding any frames. Exits
+ * with BAD_VIDEO if the file can't be read.
+ *
+ * @param video Where to store the timestamps
+ * @param path The path of the video file
+ */
+void video_open(video_t *video, const char *path);
+
+/**
+ * @brief Get the average framerate of the video
+ *
+ * @param video The video
+ * @return double The number of frames per second
+ */
+double video_fps(const video_t *video);
+
+/**
+ * @brief Get the frame that is displayed at a point in time
+ *
+ * @param video The video
+ * @param seconds The time since the start of the video
+ * @return size_t The index of the frame
+ */
+size_t video_frame_at(const video_t *video, const double seconds);
+
+/**
+ * @brief Get the time at which a frame is first displayed
+ *
+ * @param video The video
+ * @param frame The index of the frame, at most the number of frames
+ * @return double The time since the start of the video in seconds
+ */
+double video_frame_time(const video_t *video, const size_t frame);
+
+/**
+ * @brief Free the timestamps of the video
+ *
+ * @param video The video
+ */
+void video_close(video_t *video);
+
+#endif /* !__VIDEO_H_ */
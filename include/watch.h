@@ -0,0 +1,52 @@
+#ifndef __WATCH_H_
+#define __WATCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "meta.h"
+
+/* Number of runs requested per page, the maximum the API allows */
+#define WATCH_PAGE 200
+
+/**
+ * @brief The newest submission that was processed for a game
+ *
+ * @param submitted The submission date of the newest processed run
+ * @param ids The IDs of all processed runs submitted at `submitted`, however
+ * many share it, so none of them is checked twice
+ * @param nids The number of IDs
+ * @param cap The number of IDs `ids` has room for
+ */
+typedef struct {
+    uint32_t submitted;
+    char (*ids)[META_ID_LEN + 1];
+    unsigned int nids;
+    unsigned int cap;
+} checkpoint_t;
+
+/**
+ * @brief Check every new submission of a game newer than its checkpoint,
+ * oldest first, and move the checkpoint forward after every run. The runs are
+ * only checked once every page of the listing was read, so that a page that
+ * could not be read is not skipped by the checkpoint.
+ *
+ * @param game The ID of the game
+ * @param cp The checkpoint of the game
+ * @param cpfile The file to save the checkpoint to
+ * @return bool Whether the listing was read, otherwise nothing was checked and
+ * the checkpoint is as it was
+ */
+bool watch_poll(const char *game, checkpoint_t *cp, const char *cpfile);
+
+/**
+ * @brief Poll the new submissions of a game forever. A poll that fails is
+ * reported and tried again after the interval.
+ *
+ * @param game The ID of the game
+ * @param interval The number of seconds between polls, 0 to poll only once
+ * @return bool Whether the last poll succeeded
+ */
+bool watch(const char *game, const unsigned int interval);
+
+#endif /* !__WATCH_H_ */
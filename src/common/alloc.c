@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+
+static void *check(void *ptr)
+{
+    if (ptr == NULL) {
+        fputs("Allocation error\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void *xmalloc(const size_t size)
+{
+    return check(malloc(size > 0 ? size : 1));
+}
+
+void *xcalloc(const size_t n, const size_t size)
+{
+    return check(calloc(n > 0 ? n : 1, size > 0 ? size : 1));
+}
+
+void *xrealloc(void *ptr, const size_t size)
+{
+    return check(realloc(ptr, size > 0 ? size : 1));
+}
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+static block_t *new_block(const size_t size)
+{
+    block_t *block = malloc(sizeof(block_t) + size);
+    if (block == NULL) {
+        fputs("Allocation error\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/* Padding needed to align the next allocation of the block */
+static size_t padding(const block_t *block)
+{
+    const uintptr_t next = (uintptr_t) (block->data + block->used);
+    return (ARENA_ALIGN - next % ARENA_ALIGN) % ARENA_ALIGN;
+}
+
+void *arena_alloc(arena_t *arena, const size_t size)
+{
+    const size_t needed = size + ARENA_ALIGN;
+
+    if (arena->cur == NULL)
+        arena->head = arena->cur = new_block(
+            needed > ARENA_BLOCK ? needed : ARENA_BLOCK);
+
+    /* Move on to the next block that is large enough, or add a new one */
+    while (arena->cur->size - arena->cur->used < size + padding(arena->cur)) {
+        if (arena->cur->next == NULL) {
+            const size_t grown = arena->cur->size * 2;
+            arena->cur->next = new_block(needed > grown ? needed : grown);
+        }
+        arena->cur = arena->cur->next;
+    }
+
+    arena->cur->used += padding(arena->cur);
+    arena->last = arena->cur->data + arena->cur->used;
+    arena->cur->used += size;
+    return arena->last;
+}
+
+void *arena_grow(arena_t *arena, void *ptr, const size_t old,
+                 const size_t size)
+{
+    /* The most recent allocation can grow into the free space after it */
+    if (ptr != NULL && ptr == arena->last) {
+        const size_t start = arena->last - arena->cur->data;
+        if (start + size <= arena->cur->size) {
+            arena->cur->used = start + size;
+            return ptr;
+        }
+    }
+
+    void *ret = arena_alloc(arena, size);
+    if (ptr != NULL)
+        memcpy(ret, ptr, old < size ? old : size);
+    return ret;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, const size_t len)
+{
+    char *ret = arena_alloc(arena, len + 1);
+    memcpy(ret, str, len);
+    ret[len] = '\0';
+    return ret;
+}
+
+void arena_reset(arena_t *arena)
+{
+    if (arena->head != NULL && arena->head->next != NULL) {
+        size_t total = 0;
+        for (block_t *b = arena->head, *next; b != NULL; b = next) {
+            next = b->next;
+            total += b->size;
+            free(b);
+        }
+        arena->head = new_block(total);
+    }
+
+    if (arena->head != NULL)
+        arena->head->used = 0;
+    arena->cur = arena->head;
+    arena->last = NULL;
+}
+
+void arena_free(arena_t *arena)
+{
+    for (block_t *b = arena->head, *next; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    arena->head = arena->cur = NULL;
+    arena->last = NULL;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The only translation unit containing the jsmn implementation */
+#include "jsmn.h"
+#include "json.h"
+
+int json_tokenize(const char *js, const size_t len, jsmntok_t **tokens,
+                  arena_t *arena)
+{
+    jsmn_parser parser;
+
+    /* Count the tokens first so that no JSON is ever too large */
+    jsmn_init(&parser);
+    int ret = jsmn_parse(&parser, js, len, NULL, 0);
+    if (ret < 0)
+        return ret;
+
+    *tokens = arena_alloc(arena, sizeof(jsmntok_t) * (ret + 1));
+
+    jsmn_init(&parser);
+    return jsmn_parse(&parser, js, len, *tokens, ret + 1);
+}
+
+void json_check(const int ret)
+{
+    switch (ret) {
+    case JSMN_ERROR_INVAL:
+        fputs("bad token, JSON string is corrupted\n", stderr);
+        break;
+    case JSMN_ERROR_NOMEM:
+        fputs("not enough tokens, JSON string is too large\n", stderr);
+        break;
+    case JSMN_ERROR_PART:
+        fputs("JSON string is too short, expecting more JSON data\n", stderr);
+        break;
+    default:
+        return;
+    }
+    exit(EXIT_FAILURE);
+}
+
+bool json_eq(const char *js, const jsmntok_t *tok, const char *str)
+{
+    const size_t len = tok->end - tok->start;
+    return tok->type == JSMN_STRING && strlen(str) == len
+           && strncmp(js + tok->start, str, len) == 0;
+}
+
+int json_skip(const jsmntok_t *tokens, int i)
+{
+    /*
+     * Number of tokens that still have to be skipped. The children of an
+     * object are its keys, and every key has its value as a child.
+     */
+    int pending = 1;
+
+    while (pending > 0)
+        pending += tokens[i++].size - 1;
+
+    return i;
+}
+
+int json_get(const char *js, const jsmntok_t *tokens, const int obj,
+             const char *key)
+{
+    if (obj < 0 || tokens[obj].type != JSMN_OBJECT)
+        return -1;
+
+    for (int i = obj + 1, n = 0; n < tokens[obj].size; n++) {
+        if (json_eq(js, &tokens[i], key))
+            return i + 1;
+
+        /* Skip the key and its value */
+        i = json_skip(tokens, i);
+    }
+
+    return -1;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+void die(void)
+{
+    perror("drun");
+    exit(EXIT_FAILURE);
+}
+
+uint64_t hash(const char *str, const size_t len)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) str[i]) * 0x100000001b3;
+    return h;
+}
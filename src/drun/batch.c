@@ -0,0 +1,307 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "batch.h"
+#include "canon.h"
+#include "extsort.h"
+#include "idset.h"
+#include "pipeline.h"
+#include "util.h"
+
+/*
+ * The sorts of a batch, all of lines of tab separated fields:
+ *
+ *  keys     VIDEO SEQ VIDX, for the VIDXth video of the SEQth run
+ *  runs     VIDEO ORDER LINE, for every line of the database but those of
+ *           YouTube videos not in the batch, ORDER is the position of the
+ *           line from the end
+ *  results  SEQ VIDX d LINE, if the video is in the database
+ *           SEQ VIDX r, if it is only in an earlier run of the batch
+ *
+ * SEQ and ORDER are 16 hexadecimal digits and VIDX 2, so they sort as numbers.
+ */
+static extsort_t keys, runs, results;
+
+/* The collected runs, in the order of the input */
+static FILE *records;
+static uint64_t nrecords;
+
+/*
+ * The packed IDs of the YouTube videos of the batch, so that the lines of
+ * the database with other YouTube videos are left out of the sort of `runs`
+ */
+static uint64_t *packed;
+static size_t npacked, packed_cap;
+static idset_t videos;
+
+/* Strings are written with their length first, NULL has length UINT32_MAX */
+static void put_str(const char *str, const size_t len)
+{
+    const uint32_t n = str != NULL ? len : UINT32_MAX;
+    fwrite(&n, sizeof(n), 1, records);
+    if (str != NULL)
+        fwrite(str, 1, len, records);
+}
+
+static void put_u32(const uint32_t n)
+{
+    fwrite(&n, sizeof(n), 1, records);
+}
+
+static uint32_t get_u32(void)
+{
+    uint32_t n;
+    if (fread(&n, sizeof(n), 1, records) != 1)
+        die();
+    return n;
+}
+
+static char *get_str(arena_t *arena, size_t *len)
+{
+    const uint32_t n = get_u32();
+    if (n == UINT32_MAX)
+        return NULL;
+
+    char *str = arena_alloc(arena, n + 1);
+    if (n > 0 && fread(str, 1, n, records) != n)
+        die();
+    str[n] = '\0';
+    if (len != NULL)
+        *len = n;
+    return str;
+}
+
+static void put_string(const string_t *str)
+{
+    put_str(str->ptr, str->len);
+}
+
+static void get_string(arena_t *arena, string_t *str)
+{
+    str->ptr = get_str(arena, &str->len);
+}
+
+/*
+ * Write down what is needed to report a run later, the tokens and the JSON
+ * of the run are not kept
+ */
+static void collect(run_t *run, const parsed_t *parsed)
+{
+    put_str(run->id, strlen(run->id));
+    put_u32(run->nvids);
+    uint32_t blocked = 0;
+    for (size_t i = 0; i < run->nvids; i++) {
+        put_str(run->vids[i], strlen(run->vids[i]));
+        for (size_t j = 0; j < parsed->nblocked; j++)
+            if (parsed->blocked[j] == run->vids[i])
+                blocked |= (uint32_t) 1 << i;
+    }
+    put_u32(blocked);
+
+    put_u32(parsed->has_meta);
+    if (parsed->has_meta) {
+        put_str(parsed->game, strlen(parsed->game));
+        put_str(parsed->category, strlen(parsed->category));
+        const meta_t *meta = &parsed->meta;
+        put_string(&meta->id);
+        put_string(&meta->game);
+        put_string(&meta->category);
+        put_u32(meta->nplayers);
+        for (unsigned int i = 0; i < meta->nplayers; i++)
+            put_string(&meta->players[i]);
+        put_u32(meta->nvideos);
+        for (unsigned int i = 0; i < meta->nvideos; i++)
+            put_string(&meta->videos[i]);
+        put_u32(meta->submitted);
+    }
+    if (ferror(records))
+        die();
+
+    for (size_t i = 0; i < run->nvids; i++) {
+        const size_t vlen = strlen(run->vids[i]);
+        char key[vlen + 32];
+        const int len = snprintf(key, sizeof(key), "%s\t%016" PRIx64 "\t%02zx",
+                                 run->vids[i], nrecords, i);
+        extsort_add(&keys, key, len);
+
+        if (npacked == packed_cap) {
+            packed_cap = packed_cap ? packed_cap * 2 : 1024;
+            packed = xrealloc(packed, sizeof(uint64_t) * packed_cap);
+        }
+        if (canon_pack(run->vids[i], vlen, &packed[npacked]))
+            npacked++;
+    }
+    nrecords++;
+}
+
+/* Read a run written down by `collect()` back */
+static void restore(run_t *run, parsed_t *parsed)
+{
+    run->id = get_str(run->arena, NULL);
+    run->nvids = get_u32();
+    for (size_t i = 0; i < run->nvids; i++)
+        run->vids[i] = get_str(run->arena, NULL);
+    const uint32_t blocked = get_u32();
+    parsed->nblocked = 0;
+    for (size_t i = 0; i < run->nvids; i++)
+        if (blocked >> i & 1)
+            parsed->blocked[parsed->nblocked++] = run->vids[i];
+
+    parsed->has_meta = get_u32();
+    parsed->game = parsed->category = NULL;
+    if (parsed->has_meta) {
+        meta_t *meta = &parsed->meta;
+        parsed->game = get_str(run->arena, NULL);
+        parsed->category = get_str(run->arena, NULL);
+        get_string(run->arena, &meta->id);
+        get_string(run->arena, &meta->game);
+        get_string(run->arena, &meta->category);
+        meta->nplayers = get_u32();
+        for (unsigned int i = 0; i < meta->nplayers; i++)
+            get_string(run->arena, &meta->players[i]);
+        meta->nvideos = get_u32();
+        for (unsigned int i = 0; i < meta->nvideos; i++)
+            get_string(run->arena, &meta->videos[i]);
+        meta->submitted = get_u32();
+    }
+}
+
+/* Add a line of the database, `VIDEO RUN_URI\n`, with its video canonical */
+static void add_line(const char *line, const size_t len, void *arg)
+{
+    uint64_t *order = arg;
+    const size_t video = strcspn(line, " ");
+    if (video == len)
+        return;
+
+    char buf[CANON_SIZE(video) + len + 32];
+    size_t n = canon_uri(line, video, buf);
+    uint64_t id;
+    if (canon_pack(buf, n, &id) && !idset_has(&videos, id)) {
+        (*order)++;
+        return;
+    }
+    n += sprintf(buf + n, "\t%016" PRIx64 "\t", UINT64_MAX - (*order)++);
+    memcpy(buf + n, line, len - (line[len - 1] == '\n'));
+    extsort_add(&runs, buf, n + len - (line[len - 1] == '\n'));
+}
+
+/* Compare the videos the lines of the sorts start with */
+static int cmp_video(const char *a, const char *b)
+{
+    const size_t la = strcspn(a, "\t"), lb = strcspn(b, "\t");
+    const int ret = memcmp(a, b, la < lb ? la : lb);
+    return ret != 0 ? ret : (la > lb) - (la < lb);
+}
+
+/*
+ * Merge the sorted videos of the batch with the sorted database. Of the lines
+ * of a video in the database, the one added last comes first.
+ */
+static void join(void)
+{
+    size_t klen, rlen = 0;
+    const char *key, *run = extsort_next(&runs, &rlen);
+    char *prev = NULL;
+    size_t prev_size = 0;
+    while ((key = extsort_next(&keys, &klen)) != NULL) {
+        while (run != NULL && cmp_video(run, key) < 0)
+            run = extsort_next(&runs, &rlen);
+
+        /* The sequence number and index of the video come after it */
+        const size_t video = strcspn(key, "\t");
+        const char *where = key + video + 1;
+        char result[klen + rlen + 8];
+        size_t len;
+        if (run != NULL && cmp_video(run, key) == 0) {
+            const char *line = run + strcspn(run, "\t") + 1;
+            line += strcspn(line, "\t") + 1;
+            len = snprintf(result, sizeof(result), "%s\td\t%s", where, line);
+        } else if (prev != NULL && cmp_video(prev, key) == 0) {
+            len = snprintf(result, sizeof(result), "%s\tr", where);
+        } else {
+            len = 0;
+        }
+        if (len > 0)
+            extsort_add(&results, result, len);
+
+        if (video + 1 > prev_size) {
+            prev_size = video + 1;
+            prev = xrealloc(prev, prev_size);
+        }
+        memcpy(prev, key, video);
+        prev[video] = '\0';
+    }
+    free(prev);
+}
+
+/* Report the collected runs in order with the results of the join */
+static void settle(store_t *store)
+{
+    rewind(records);
+    arena_t arena = {0};
+    size_t len;
+    const char *result = extsort_next(&results, &len);
+    for (uint64_t seq = 0; seq < nrecords; seq++) {
+        arena_reset(&arena);
+        run_t run = {.arena = &arena};
+        parsed_t parsed;
+        restore(&run, &parsed);
+
+        char *found[RUN_MAX_VIDEOS] = {NULL};
+        for (; result != NULL && strtoull(result, NULL, 16) == seq;
+             result = extsort_next(&results, &len)) {
+            const size_t i = strtoul(result + 17, NULL, 16);
+            if (i >= run.nvids)
+                continue;
+
+            /* Looked up only now, as an earlier run may have added it */
+            if (result[20] == 'r') {
+                found[i] = store_find(store, parsed.game, parsed.category,
+                                      run.vids[i], true, &arena);
+            } else {
+                found[i] = arena_alloc(&arena, len - 22 + 2);
+                sprintf(found[i], "%s\n", result + 22);
+            }
+        }
+        settle_run(&run, &parsed, found);
+    }
+    arena_free(&arena);
+}
+
+bool batch(store_t *store, const unsigned int jobs)
+{
+    extsort_init(&keys, BATCH_MEMORY);
+    extsort_init(&runs, BATCH_MEMORY);
+    extsort_init(&results, BATCH_MEMORY);
+    if ((records = tmpfile()) == NULL)
+        die();
+
+    const bool ok = pipeline(jobs, NULL, collect);
+    extsort_finish(&keys);
+    idset_build(&videos, packed, npacked);
+    free(packed);
+    packed = NULL;
+    npacked = packed_cap = 0;
+
+    uint64_t order = 0;
+    store_iterate(store, add_line, &order);
+    extsort_finish(&runs);
+    idset_free(&videos);
+
+    join();
+    extsort_free(&keys);
+    extsort_free(&runs);
+    extsort_finish(&results);
+
+    settle(store);
+    extsort_free(&results);
+    fclose(records);
+    records = NULL;
+    nrecords = 0;
+    return ok;
+}
@@ -0,0 +1,308 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "blocklist.h"
+#include "canon.h"
+#include "util.h"
+
+/* The splitmix64 finalizer, FNV-1a alone mixes its high bits poorly */
+static uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static uint64_t key_of(const char *uri, const size_t len)
+{
+    return mix(hash(uri, len));
+}
+
+static uint16_t fingerprint(const uint64_t key)
+{
+    return key >> 48;
+}
+
+/* The bit of the key in a level of `bits` bits */
+static uint64_t position(const uint64_t key, const uint32_t level,
+                         const uint64_t bits)
+{
+    return mix(key + (level + 1) * 0x9e3779b97f4a7c15) % bits;
+}
+
+static bool test_bit(const uint64_t *words, const uint64_t bit)
+{
+    return words[bit >> 6] >> (bit & 63) & 1;
+}
+
+static void set_bit(uint64_t *words, const uint64_t bit)
+{
+    words[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+}
+
+/* The number of set bits before `bit` over all levels */
+static uint64_t rank(const blocklist_t *bl, const uint64_t bit)
+{
+    const uint64_t words_per_rank = BLOCKLIST_RANK_BITS / 64,
+                   block = bit / BLOCKLIST_RANK_BITS;
+    uint64_t ret = bl->ranks[block];
+    for (uint64_t w = block * words_per_rank; w < bit >> 6; w++)
+        ret += __builtin_popcountll(bl->bits[w]);
+    const uint64_t below = ((uint64_t) 1 << (bit & 63)) - 1;
+    return ret + __builtin_popcountll(bl->bits[bit >> 6] & below);
+}
+
+static uint64_t nranks(const bl_header_t *hdr)
+{
+    return (hdr->nwords * 64 + BLOCKLIST_RANK_BITS - 1) / BLOCKLIST_RANK_BITS;
+}
+
+static size_t file_size(const bl_header_t *hdr)
+{
+    return sizeof(*hdr) + sizeof(bl_level_t) * hdr->nlevels
+           + sizeof(uint64_t) * (hdr->nwords + nranks(hdr))
+           + sizeof(uint16_t) * hdr->nkeys;
+}
+
+/* Point the blocklist at the parts of a file laid out at `map` */
+static void layout(blocklist_t *bl, void *map)
+{
+    bl->hdr = map;
+    bl->levels = (const bl_level_t *) (bl->hdr + 1);
+    bl->bits = (const uint64_t *) (bl->levels + bl->hdr->nlevels);
+    bl->ranks = bl->bits + bl->hdr->nwords;
+    bl->fps = (const uint16_t *) (bl->ranks + nranks(bl->hdr));
+}
+
+/*
+ * Whether a mapped file of `size` bytes is laid out as its header says, with
+ * every level inside the bits, so lookups never read past the mapping
+ */
+static bool valid(const void *map, const size_t size)
+{
+    const bl_header_t *hdr = map;
+    if (hdr->magic != BLOCKLIST_MAGIC || hdr->version != BLOCKLIST_VERSION
+        || hdr->nlevels > BLOCKLIST_LEVELS || hdr->nwords > size / 8
+        || hdr->nkeys > size / 2 || file_size(hdr) != size)
+        return false;
+
+    const bl_level_t *levels = (const bl_level_t *) (hdr + 1);
+    for (uint32_t l = 0; l < hdr->nlevels; l++)
+        if (levels[l].bits == 0 || levels[l].bits % 64 != 0
+            || levels[l].word > hdr->nwords
+            || levels[l].bits / 64 > hdr->nwords - levels[l].word)
+            return false;
+    return true;
+}
+
+bool blocklist_open(blocklist_t *bl, const char *path)
+{
+    memset(bl, 0, sizeof(*bl));
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT)
+            return false;
+        die();
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        die();
+    if (st.st_size < (off_t) sizeof(bl_header_t)) {
+        fprintf(stderr, "drun: corrupt blocklist %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        die();
+
+    bl->map = map;
+    bl->size = st.st_size;
+    if (!valid(map, st.st_size)) {
+        fprintf(stderr, "drun: corrupt blocklist %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    layout(bl, map);
+    return true;
+}
+
+bool blocklist_has(const blocklist_t *bl, const char *video_uri)
+{
+    if (bl->hdr == NULL)
+        return false;
+
+    const uint64_t key = key_of(video_uri, strlen(video_uri));
+    for (uint32_t l = 0; l < bl->hdr->nlevels; l++) {
+        const bl_level_t *level = &bl->levels[l];
+        const uint64_t bit = level->word * 64
+                             + position(key, l, level->bits);
+        if (!test_bit(bl->bits, bit))
+            continue;
+
+        /* Checking the rank table when opening would read all of it */
+        const uint64_t index = rank(bl, bit);
+        return index < bl->hdr->nkeys && bl->fps[index] == fingerprint(key);
+    }
+    return false;
+}
+
+static int cmp_keys(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Read the keys of the videos in the lists, sorted and without repeats */
+static uint64_t *read_keys(FILE *in, size_t *nkeys)
+{
+    size_t n = 0, cap = 1024;
+    uint64_t *keys = xrealloc(NULL, sizeof(uint64_t) * cap);
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t read;
+    while ((read = getline(&line, &size, in)) != -1) {
+        while (read > 0 && strchr(" \t\r\n", line[read - 1]) != NULL)
+            line[--read] = '\0';
+        if (read == 0 || line[0] == '#')
+            continue;
+
+        /* Lists mostly have bare YouTube IDs */
+        char uri[CANON_SIZE(read + 32)];
+        size_t len;
+        if (strpbrk(line, "/.") == NULL) {
+            char full[read + 32];
+            len = snprintf(full, sizeof(full), "https://youtu.be/%s", line);
+            len = canon_uri(full, len, uri);
+        } else {
+            len = canon_uri(line, read, uri);
+        }
+        if (len == 0) {
+            fprintf(stderr, "drun: '%s' is not a video, skipping it\n", line);
+            continue;
+        }
+
+        if (n == cap) {
+            cap *= 2;
+            keys = xrealloc(keys, sizeof(uint64_t) * cap);
+        }
+        keys[n++] = key_of(uri, len);
+    }
+    if (ferror(in))
+        die();
+    free(line);
+
+    qsort(keys, n, sizeof(uint64_t), cmp_keys);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++)
+        if (unique == 0 || keys[i] != keys[unique - 1])
+            keys[unique++] = keys[i];
+    *nkeys = unique;
+    return keys;
+}
+
+void blocklist_build(const char *path, FILE *in)
+{
+    size_t nkeys;
+    uint64_t *keys = read_keys(in, &nkeys);
+
+    /* Every level takes the keys that no other key collided with */
+    bl_header_t hdr = {BLOCKLIST_MAGIC, BLOCKLIST_VERSION, 0, 0, 0, 0};
+    bl_level_t levels[BLOCKLIST_LEVELS];
+    uint64_t *words = NULL;
+    uint64_t *left = xrealloc(NULL, sizeof(uint64_t) * (nkeys + 1));
+    memcpy(left, keys, sizeof(uint64_t) * nkeys);
+    size_t nleft = nkeys;
+    while (nleft > 0 && hdr.nlevels < BLOCKLIST_LEVELS) {
+        const uint32_t l = hdr.nlevels++;
+        const uint64_t nwords = (nleft * BLOCKLIST_GAMMA + 63) / 64;
+        levels[l] = (bl_level_t){hdr.nwords, nwords * 64};
+
+        uint64_t *seen = xcalloc(nwords, sizeof(uint64_t)),
+                 *twice = xcalloc(nwords, sizeof(uint64_t));
+        for (size_t i = 0; i < nleft; i++) {
+            const uint64_t bit = position(left[i], l, levels[l].bits);
+            if (test_bit(seen, bit))
+                set_bit(twice, bit);
+            set_bit(seen, bit);
+        }
+
+        words = xrealloc(words, sizeof(uint64_t) * (hdr.nwords + nwords));
+        for (uint64_t w = 0; w < nwords; w++)
+            words[hdr.nwords + w] = seen[w] & ~twice[w];
+        hdr.nwords += nwords;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < nleft; i++)
+            if (test_bit(twice, position(left[i], l, levels[l].bits)))
+                left[kept++] = left[i];
+        nleft = kept;
+        free(seen);
+        free(twice);
+    }
+    free(left);
+    if (nleft > 0)
+        fprintf(stderr, "drun: %zu videos did not fit into the blocklist\n",
+                nleft);
+    hdr.nkeys = nkeys - nleft;
+
+    /* Lay the file out in memory, so the lookups below work on it */
+    const size_t size = file_size(&hdr);
+    char *file = xcalloc(1, size);
+    blocklist_t bl = {file, size, NULL, NULL, NULL, NULL, NULL};
+    memcpy(file, &hdr, sizeof(hdr));
+    layout(&bl, file);
+    memcpy((bl_level_t *) bl.levels, levels, sizeof(bl_level_t) * hdr.nlevels);
+    if (hdr.nwords > 0)
+        memcpy((uint64_t *) bl.bits, words, sizeof(uint64_t) * hdr.nwords);
+    free(words);
+
+    uint64_t *ranks = (uint64_t *) bl.ranks, count = 0;
+    for (uint64_t w = 0; w < hdr.nwords; w++) {
+        if (w % (BLOCKLIST_RANK_BITS / 64) == 0)
+            ranks[w / (BLOCKLIST_RANK_BITS / 64)] = count;
+        count += __builtin_popcountll(bl.bits[w]);
+    }
+
+    /* The fingerprint of every key goes where its bit ranks */
+    uint16_t *fps = (uint16_t *) bl.fps;
+    for (size_t i = 0; i < nkeys; i++) {
+        for (uint32_t l = 0; l < hdr.nlevels; l++) {
+            const uint64_t bit = bl.levels[l].word * 64
+                                 + position(keys[i], l, bl.levels[l].bits);
+            if (test_bit(bl.bits, bit)) {
+                fps[rank(&bl, bit)] = fingerprint(keys[i]);
+                break;
+            }
+        }
+    }
+    free(keys);
+
+    /* Replace the blocklist at once, drun may have it mapped */
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL || fwrite(file, 1, size, fp) != size || fclose(fp) == EOF
+        || rename(tmp, path) == -1)
+        die();
+    free(file);
+
+    printf("%" PRIu64 " videos in the blocklist, %.1f bits per video\n",
+           hdr.nkeys, hdr.nkeys ? size * 8.0 / hdr.nkeys : 0.0);
+}
+
+void blocklist_close(blocklist_t *bl)
+{
+    if (bl->map != NULL)
+        munmap(bl->map, bl->size);
+    memset(bl, 0, sizeof(*bl));
+}
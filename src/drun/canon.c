@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+
+#include "canon.h"
+
+/* A part of the URI that is looked at, not NUL terminated */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} span_t;
+
+static char lower(const char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static bool id_char(const char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+           || (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+static bool span_is(const span_t s, const char *str)
+{
+    const size_t len = strlen(str);
+    return s.len == len && memcmp(s.ptr, str, len) == 0;
+}
+
+/* Cut `s` at the first character that can't be part of an ID */
+static span_t id(span_t s)
+{
+    size_t len = 0;
+    while (len < s.len && id_char(s.ptr[len]))
+        len++;
+    s.len = len;
+    return s;
+}
+
+/* Get the `n`th segment of the path, counting from 0 */
+static span_t segment(const span_t path, unsigned int n)
+{
+    const char *p = path.ptr, *end = p + path.len;
+    for (;;) {
+        while (p < end && *p == '/')
+            p++;
+        const char *start = p;
+        while (p < end && *p != '/')
+            p++;
+        if (n-- == 0)
+            return (span_t){start, p - start};
+        if (p == end)
+            return (span_t){end, 0};
+    }
+}
+
+/* Get the value of the query parameter `name` */
+static span_t param(const span_t query, const char *name)
+{
+    const size_t len = strlen(name);
+    const char *p = query.ptr, *end = p + query.len;
+    while (p < end) {
+        const char *amp = memchr(p, '&', end - p);
+        const char *stop = amp != NULL ? amp : end;
+        if ((size_t) (stop - p) > len && memcmp(p, name, len) == 0
+            && p[len] == '=')
+            return (span_t){p + len + 1, stop - p - len - 1};
+        p = stop + 1;
+    }
+    return (span_t){end, 0};
+}
+
+static const span_t none = {NULL, 0};
+
+/* Write `prefix` and `key`, and `suffix` and `extra` if there is an extra */
+static size_t emit(char *out, const char *prefix, const span_t key,
+                   const char *suffix, const span_t extra)
+{
+    const size_t plen = strlen(prefix);
+    char *o = out;
+    memcpy(o, prefix, plen), o += plen;
+    memcpy(o, key.ptr, key.len), o += key.len;
+    if (extra.len > 0) {
+        const size_t slen = strlen(suffix);
+        memcpy(o, suffix, slen), o += slen;
+        memcpy(o, extra.ptr, extra.len), o += extra.len;
+    }
+    *o = '\0';
+    return o - out;
+}
+
+static size_t youtube(const span_t host, const span_t path, const span_t query,
+                      char *out)
+{
+    span_t key = {path.ptr, 0};
+    const span_t first = segment(path, 0);
+    if (span_is(host, "youtu.be"))
+        key = id(first);
+    else if (span_is(first, "watch"))
+        key = id(param(query, "v"));
+    else if (span_is(first, "embed") || span_is(first, "v")
+             || span_is(first, "shorts") || span_is(first, "live")
+             || span_is(first, "e"))
+        key = id(segment(path, 1));
+
+    if (key.len == 0)
+        return 0;
+    return emit(out, "https://youtu.be/", key, NULL, none);
+}
+
+static size_t twitch(const span_t host, const span_t path, const span_t query,
+                     char *out)
+{
+    span_t video = {path.ptr, 0}, clip = {path.ptr, 0};
+    const span_t first = segment(path, 0), second = segment(path, 1);
+
+    if (span_is(host, "clips.twitch.tv")) {
+        clip = span_is(first, "embed") ? param(query, "clip") : first;
+    } else if (span_is(host, "player.twitch.tv")) {
+        video = param(query, "video");
+        clip = param(query, "clip");
+    } else if (span_is(first, "videos")) {
+        video = second;
+    } else if (span_is(second, "v") || span_is(second, "video")) {
+        video = segment(path, 2);
+    } else if (span_is(second, "clip")) {
+        clip = segment(path, 2);
+    }
+
+    /* The player takes VOD IDs with a leading v */
+    if (video.len > 0 && video.ptr[0] == 'v')
+        video.ptr++, video.len--;
+    if ((video = id(video)).len > 0)
+        return emit(out, "https://www.twitch.tv/videos/", video, NULL, none);
+    if ((clip = id(clip)).len > 0)
+        return emit(out, "https://clips.twitch.tv/", clip, NULL, none);
+    return 0;
+}
+
+static size_t bilibili(const span_t path, const span_t query, char *out)
+{
+    if (!span_is(segment(path, 0), "video"))
+        return 0;
+    const span_t key = id(segment(path, 1));
+    if (key.len == 0)
+        return 0;
+
+    /* Every part of a video has its own page */
+    span_t part = id(param(query, "p"));
+    if (span_is(part, "1"))
+        part.len = 0;
+    return emit(out, "https://www.bilibili.com/video/", key, "?p=", part);
+}
+
+static size_t vimeo(const span_t host, const span_t path, char *out)
+{
+    span_t key = segment(path, 0);
+    if (span_is(host, "player.vimeo.com")) {
+        if (!span_is(key, "video"))
+            return 0;
+        key = segment(path, 1);
+    }
+
+    /* Other pages of vimeo.com are channels, groups and the like */
+    size_t len = 0;
+    while (len < key.len && key.ptr[len] >= '0' && key.ptr[len] <= '9')
+        len++;
+    if (len == 0 || len != key.len)
+        return 0;
+    return emit(out, "https://vimeo.com/", key, NULL, none);
+}
+
+/* Canonicalize the URI, a URI of no known video only if `generic` is set */
+static size_t canon(const char *uri, const size_t len, char *out,
+                    const bool generic)
+{
+    const char *p = uri, *end = uri + len;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n'
+                       || end[-1] == '\r'))
+        end--;
+
+    if (p == end) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    /* Skip the scheme, if there is one */
+    static const char *const schemes[] = {"https://", "http://", "//"};
+    for (size_t i = 0; i < sizeof(schemes) / sizeof(*schemes); i++) {
+        const size_t n = strlen(schemes[i]);
+        size_t j = 0;
+        while (j < n && p + j < end && lower(p[j]) == schemes[i][j])
+            j++;
+        if (j == n) {
+            p += n;
+            break;
+        }
+    }
+
+    /* The host is lowercased and loses its port, www. and m. */
+    char host_buf[CANON_HOST_MAX];
+    size_t host_len = 0;
+    bool port = false;
+    for (; p < end && *p != '/' && *p != '?' && *p != '#'; p++) {
+        if (*p == ':')
+            port = true;
+        else if (!port && host_len < CANON_HOST_MAX)
+            host_buf[host_len++] = lower(*p);
+    }
+    span_t host = {host_buf, host_len};
+    if (host.len > 4 && memcmp(host.ptr, "www.", 4) == 0)
+        host.ptr += 4, host.len -= 4;
+    else if (host.len > 2 && memcmp(host.ptr, "m.", 2) == 0)
+        host.ptr += 2, host.len -= 2;
+
+    span_t path = {p, 0}, query = {end, 0};
+    while (p < end && *p != '?' && *p != '#')
+        p++, path.len++;
+    if (p < end && *p == '?') {
+        query.ptr = ++p;
+        while (p < end && *p != '#')
+            p++, query.len++;
+    }
+
+    size_t ret = 0;
+    if (host_len < CANON_HOST_MAX) {
+        if (span_is(host, "youtu.be") || span_is(host, "youtube.com")
+            || span_is(host, "music.youtube.com")
+            || span_is(host, "gaming.youtube.com")
+            || span_is(host, "youtube-nocookie.com"))
+            ret = youtube(host, path, query, out);
+        else if (span_is(host, "twitch.tv") || span_is(host, "clips.twitch.tv")
+                 || span_is(host, "player.twitch.tv"))
+            ret = twitch(host, path, query, out);
+        else if (span_is(host, "bilibili.com"))
+            ret = bilibili(path, query, out);
+        else if (span_is(host, "vimeo.com")
+                 || span_is(host, "player.vimeo.com"))
+            ret = vimeo(host, path, out);
+    }
+    if (ret > 0)
+        return ret;
+    if (!generic) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    /* Anything else keeps its path and query */
+    while (path.len > 0 && path.ptr[path.len - 1] == '/')
+        path.len--;
+    if (host_len == CANON_HOST_MAX) {
+        /* Too long to be a host name, don't touch it */
+        const size_t n = end - uri;
+        memcpy(out, uri, n);
+        out[n] = '\0';
+        return n;
+    }
+    char *o = out;
+    memcpy(o, "https://", 8), o += 8;
+    memcpy(o, host.ptr, host.len), o += host.len;
+    memcpy(o, path.ptr, path.len), o += path.len;
+    if (query.len > 0) {
+        *o++ = '?';
+        memcpy(o, query.ptr, query.len), o += query.len;
+    }
+    *o = '\0';
+    return o - out;
+}
+
+size_t canon_uri(const char *uri, const size_t len, char *out)
+{
+    return canon(uri, len, out, true);
+}
+
+size_t canon_video(const char *uri, const size_t len, char *out)
+{
+    return canon(uri, len, out, false);
+}
+
+bool canon_eq(const char *video, const size_t len, const char *key,
+              const size_t key_len)
+{
+    if (len == key_len && memcmp(video, key, len) == 0)
+        return true;
+
+    /* The last segment of the path of a canonical form is in every form */
+    const char *path = key_len > 8 ? memchr(key + 8, '/', key_len - 8) : NULL;
+    if (path != NULL) {
+        const char *tail = key + key_len;
+        while (tail[-1] != '/')
+            tail--;
+        const char *query = memchr(tail, '?', key + key_len - tail);
+        const size_t tail_len = (query != NULL ? query : key + key_len) - tail;
+        if (memmem(video, len, tail, tail_len) == NULL)
+            return false;
+    }
+
+    char canon[CANON_SIZE(len)];
+    return canon_uri(video, len, canon) == key_len
+           && memcmp(canon, key, key_len) == 0;
+}
+
+/* The characters of YouTube IDs in ASCII order, and the last characters */
+static const char id_digits[] =
+    "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+static const char id_last[] = "048AEIMQUYcgkosw";
+
+bool canon_pack(const char *key, const size_t len, uint64_t *id)
+{
+    static const char prefix[] = "https://youtu.be/";
+    const size_t plen = sizeof(prefix) - 1;
+    if (len != plen + 11 || memcmp(key, prefix, plen) != 0)
+        return false;
+
+    uint64_t packed = 0;
+    for (size_t i = plen; i < plen + 10; i++) {
+        const char *digit = memchr(id_digits, key[i], 64);
+        if (digit == NULL)
+            return false;
+        packed = packed << 6 | (uint64_t) (digit - id_digits);
+    }
+    const char *last = memchr(id_last, key[plen + 10], 16);
+    if (last == NULL)
+        return false;
+    *id = packed << 4 | (uint64_t) (last - id_last);
+    return true;
+}
@@ -0,0 +1,514 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "canon.h"
+#include "cluster.h"
+#include "extsort.h"
+#include "util.h"
+
+/* Upper limit of the threads that merge the edges */
+#define CLUSTER_MAX_THREADS 16
+
+/* Edges a thread merges at least, fewer are not worth starting one for */
+#define CLUSTER_CHUNK (1024 * 1024)
+
+/*
+ * The nodes of the graph are the players, numbered by their code in the
+ * dictionary of the metadata, followed by the runs, numbered in the order
+ * they are found in the database and then in the metadata
+ */
+static uint32_t nplayers;
+static uint64_t *runs;
+static uint32_t nruns, runs_cap;
+
+/* Open addressing hash table of the runs by packed ID, indexes plus one */
+static uint32_t *table;
+static size_t mask;
+
+/* The pairs of nodes linked */
+static uint32_t *edges;
+static size_t nedges, edges_cap;
+
+/**
+ * @brief A YouTube video of a run
+ *
+ * @param id The packed ID of the video, see `canon_pack()`
+ * @param node The node of the run
+ */
+typedef struct {
+    uint64_t id;
+    uint32_t node;
+} packed_t;
+
+/*
+ * The pairs of a video and the node of a run. YouTube videos, most of them,
+ * are packed and sorted in memory with the rest of the graph, other videos
+ * are sorted externally as lines VIDEO NODE, NODE is 8 hexadecimal digits.
+ */
+static packed_t *packed;
+static size_t npacked, packed_cap;
+static extsort_t pairs;
+
+/**
+ * @brief The part of the nodes or edges a thread merges
+ *
+ * @param parent The parent of every node, a root is its own parent
+ * @param from The first node or edge of the part
+ * @param to The end of the part
+ */
+typedef struct {
+    uint32_t *parent;
+    size_t from, to;
+} part_t;
+
+/**
+ * @brief A cluster that is printed
+ *
+ * @param root The smallest node of the cluster
+ * @param runs The number of runs
+ * @param players The number of players
+ * @param start Where the nodes of the cluster start in the list of members
+ */
+typedef struct {
+    uint32_t root, runs, players, start;
+} cluster_t;
+
+/* Run IDs are 8 characters, so they fit into a word, like in the metadata */
+static uint64_t pack_run(const char *id, const size_t len)
+{
+    uint64_t ret = 0;
+    memcpy(&ret, id, len < META_ID_LEN ? len : META_ID_LEN);
+    return ret;
+}
+
+static size_t slot(const uint64_t id)
+{
+    const uint64_t h = id * 0x9e3779b97f4a7c15;
+    return (h ^ h >> 32) & mask;
+}
+
+static void insert_run(const uint32_t i)
+{
+    size_t j = slot(runs[i]);
+    while (table[j])
+        j = (j + 1) & mask;
+    table[j] = i + 1;
+}
+
+/* Get the node of a run, UINT32_MAX if it is not in the graph */
+static uint32_t find_run(const uint64_t id)
+{
+    if (table == NULL)
+        return UINT32_MAX;
+    for (size_t j = slot(id); table[j]; j = (j + 1) & mask)
+        if (runs[table[j] - 1] == id)
+            return nplayers + table[j] - 1;
+    return UINT32_MAX;
+}
+
+/* Get the node of a run, adding it if it is new */
+static uint32_t add_run(const uint64_t id)
+{
+    const uint32_t node = find_run(id);
+    if (node != UINT32_MAX)
+        return node;
+
+    if (nruns == runs_cap) {
+        runs_cap = runs_cap ? runs_cap * 2 : 1024;
+        runs = xrealloc(runs, sizeof(uint64_t) * runs_cap);
+    }
+    runs[nruns++] = id;
+
+    /* Resize the hash table to fit at least twice the number of runs */
+    if (table == NULL || mask < (size_t) nruns * 2) {
+        free(table);
+        mask = 1023;
+        while (mask < (size_t) nruns * 2)
+            mask = mask * 2 + 1;
+        table = xcalloc(mask + 1, sizeof(uint32_t));
+        for (uint32_t i = 0; i < nruns; i++)
+            insert_run(i);
+    } else {
+        insert_run(nruns - 1);
+    }
+    return nplayers + nruns - 1;
+}
+
+static void add_edge(const uint32_t a, const uint32_t b)
+{
+    if (nedges == edges_cap) {
+        edges_cap = edges_cap ? edges_cap * 2 : 1024;
+        edges = xrealloc(edges, 2 * sizeof(uint32_t) * edges_cap);
+    }
+    edges[nedges * 2] = a;
+    edges[nedges * 2 + 1] = b;
+    nedges++;
+}
+
+static void add_pair(const char *video, const size_t len, const uint32_t node)
+{
+    uint64_t id;
+    if (canon_pack(video, len, &id)) {
+        if (npacked == packed_cap) {
+            packed_cap = packed_cap ? packed_cap * 2 : 1024;
+            packed = xrealloc(packed, sizeof(packed_t) * packed_cap);
+        }
+        const packed_t pair = {id, node};
+        packed[npacked++] = pair;
+        return;
+    }
+
+    char buf[len + 16];
+    memcpy(buf, video, len);
+    const int n = sprintf(buf + len, "\t%08" PRIx32, node);
+    extsort_add(&pairs, buf, len + n);
+}
+
+/* Sort a line of the database, `VIDEO RUN_URI\n`, by its video */
+static void add_line(const char *line, const size_t len, void *arg)
+{
+    (void) arg;
+    const char *space = memchr(line, ' ', len);
+    if (space == NULL)
+        return;
+
+    /* The run ID is the last component of the run URI */
+    const char *end = line + len - (line[len - 1] == '\n'), *id = end;
+    while (id > space + 1 && id[-1] != '/')
+        id--;
+
+    /* Lines stored before canon_uri() existed have other forms of a video */
+    char video[CANON_SIZE(space - line)];
+    const size_t n = canon_uri(line, space - line, video);
+    const uint32_t node = add_run(pack_run(id, end - id));
+    if (n > 0)
+        add_pair(video, n, node);
+}
+
+/*
+ * Sort the videos of every run of the metadata too, as duplicates are not
+ * added to the database, and link the runs to their players
+ */
+static void add_meta(const meta_db_t *meta)
+{
+    const uint32_t *players_idx = meta->map[COL_PLAYERS_IDX],
+                   *players = meta->map[COL_PLAYERS];
+    const uint64_t *videos_idx = meta->map[COL_VIDEOS_IDX];
+    const char *ids = meta->map[COL_ID], *videos = meta->map[COL_VIDEOS];
+
+    for (size_t r = 0; r < meta->rows; r++) {
+        const uint32_t node = add_run(pack_run(ids + r * META_ID_LEN,
+                                               META_ID_LEN));
+
+        const uint64_t vstart = r ? videos_idx[r - 1] : 0,
+                       vend = videos_idx[r];
+        for (uint64_t v = vstart; v < vend;) {
+            const char *nl = memchr(videos + v, '\n', vend - v);
+            if (nl == NULL)
+                break;
+            const size_t len = nl - videos - v;
+            char uri[CANON_SIZE(len)];
+            const size_t n = canon_uri(videos + v, len, uri);
+            if (n > 0)
+                add_pair(uri, n, node);
+            v = nl - videos + 1;
+        }
+
+        const uint32_t pstart = r ? players_idx[r - 1] : 0,
+                       pend = players_idx[r];
+        for (uint32_t p = pstart; p < pend; p++)
+            add_edge(node, players[p]);
+    }
+}
+
+static int cmp_packed(const void *a, const void *b)
+{
+    const uint64_t x = ((const packed_t *) a)->id,
+                   y = ((const packed_t *) b)->id;
+    return (x > y) - (x < y);
+}
+
+/* Link every run of a video to the one before it */
+static void link_videos(void)
+{
+    qsort(packed, npacked, sizeof(packed_t), cmp_packed);
+    for (size_t i = 1; i < npacked; i++)
+        if (packed[i].id == packed[i - 1].id)
+            add_edge(packed[i - 1].node, packed[i].node);
+
+    char *prev = NULL;
+    size_t prev_len = 0, prev_size = 0, len;
+    uint32_t prev_node = 0;
+    const char *pair;
+    while ((pair = extsort_next(&pairs, &len)) != NULL) {
+        const size_t video = strcspn(pair, "\t");
+        const uint32_t node = strtoul(pair + video + 1, NULL, 16);
+        if (prev != NULL && video == prev_len
+            && memcmp(pair, prev, video) == 0) {
+            add_edge(prev_node, node);
+        } else {
+            if (video + 1 > prev_size) {
+                prev_size = video + 1;
+                prev = xrealloc(prev, prev_size);
+            }
+            memcpy(prev, pair, video);
+            prev_len = video;
+        }
+        prev_node = node;
+    }
+    free(prev);
+}
+
+/* Find the root of a node, halving the path to it on the way */
+static uint32_t find_root(uint32_t *parent, uint32_t node)
+{
+    for (;;) {
+        uint32_t up = __atomic_load_n(&parent[node], __ATOMIC_RELAXED);
+        if (up == node)
+            return node;
+
+        /* Another thread may have moved the node up meanwhile, that's fine */
+        const uint32_t next = __atomic_load_n(&parent[up], __ATOMIC_RELAXED);
+        if (next != up)
+            __atomic_compare_exchange_n(&parent[node], &up, next, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        node = next;
+    }
+}
+
+static void unite(uint32_t *parent, uint32_t a, uint32_t b)
+{
+    for (;;) {
+        a = find_root(parent, a);
+        b = find_root(parent, b);
+        if (a == b)
+            return;
+
+        /* The larger root goes below the smaller, if it is still a root */
+        if (a < b) {
+            const uint32_t tmp = a;
+            a = b;
+            b = tmp;
+        }
+        uint32_t root = a;
+        if (__atomic_compare_exchange_n(&parent[a], &root, b, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+    }
+}
+
+static void *unite_part(void *arg)
+{
+    const part_t *part = arg;
+    for (size_t i = part->from; i < part->to; i++)
+        unite(part->parent, edges[i * 2], edges[i * 2 + 1]);
+    return NULL;
+}
+
+/* Point every node of the part at its root */
+static void *flatten_part(void *arg)
+{
+    const part_t *part = arg;
+    for (size_t node = part->from; node < part->to; node++)
+        __atomic_store_n(&part->parent[node],
+                         find_root(part->parent, node), __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* Run `work` on `n` nodes or edges split evenly between the threads */
+static void run_parts(void *(*work)(void *), uint32_t *parent, const size_t n,
+                      const long nthreads)
+{
+    pthread_t threads[CLUSTER_MAX_THREADS];
+    part_t parts[CLUSTER_MAX_THREADS];
+    for (long t = 0; t < nthreads; t++) {
+        parts[t].parent = parent;
+        parts[t].from = n * t / nthreads;
+        parts[t].to = n * (t + 1) / nthreads;
+    }
+    for (long t = 1; t < nthreads; t++)
+        if (pthread_create(&threads[t], NULL, work, &parts[t]) != 0)
+            die();
+    work(&parts[0]);
+    for (long t = 1; t < nthreads; t++)
+        pthread_join(threads[t], NULL);
+}
+
+/* Merge the edges, after which the parent of every node is its root */
+static uint32_t *merge(const size_t nnodes)
+{
+    uint32_t *parent = xmalloc(sizeof(uint32_t) * (nnodes + 1));
+    for (size_t node = 0; node < nnodes; node++)
+        parent[node] = node;
+
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > CLUSTER_MAX_THREADS)
+        nthreads = CLUSTER_MAX_THREADS;
+    if ((size_t) nthreads > nedges / CLUSTER_CHUNK + 1)
+        nthreads = nedges / CLUSTER_CHUNK + 1;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    run_parts(unite_part, parent, nedges, nthreads);
+    run_parts(flatten_part, parent, nnodes, nthreads);
+    return parent;
+}
+
+/* Sort clusters by their size, largest first */
+static int cmp_clusters(const void *a, const void *b)
+{
+    const cluster_t *x = a, *y = b;
+    if (x->runs != y->runs)
+        return (x->runs < y->runs) - (x->runs > y->runs);
+    if (x->players != y->players)
+        return (x->players < y->players) - (x->players > y->players);
+    return (x->root > y->root) - (x->root < y->root);
+}
+
+static void print_clusters(const meta_db_t *meta, const uint32_t *parent,
+                           const size_t nnodes, const uint8_t *wanted)
+{
+    /* Count the runs and players of every cluster at its root */
+    uint32_t *nruns_of = xcalloc(nnodes + 1, sizeof(uint32_t)),
+             *nplayers_of = xcalloc(nnodes + 1, sizeof(uint32_t));
+    for (size_t node = 0; node < nnodes; node++)
+        (node < nplayers ? nplayers_of : nruns_of)[parent[node]]++;
+
+    cluster_t *clusters = NULL;
+    size_t nclusters = 0, cap = 0;
+    for (uint32_t root = 0; root < nnodes; root++) {
+        if (parent[root] != root || nruns_of[root] < 2
+            || (wanted != NULL && !wanted[root]))
+            continue;
+        if (nclusters == cap) {
+            cap = cap ? cap * 2 : 256;
+            clusters = xrealloc(clusters, sizeof(cluster_t) * cap);
+        }
+        const cluster_t cluster = {root, nruns_of[root], nplayers_of[root], 0};
+        clusters[nclusters++] = cluster;
+    }
+    qsort(clusters, nclusters, sizeof(cluster_t), cmp_clusters);
+
+    /* The position of the cluster of every root plus one, 0 if not printed */
+    uint32_t *rank = nruns_of, nmembers = 0;
+    memset(rank, 0, sizeof(uint32_t) * nnodes);
+    for (size_t i = 0; i < nclusters; i++) {
+        rank[clusters[i].root] = i + 1;
+        clusters[i].start = nmembers;
+        nmembers += clusters[i].runs + clusters[i].players;
+    }
+
+    /* The runs of every cluster come before its players */
+    uint32_t *members = xmalloc(sizeof(uint32_t) * (nmembers + 1)),
+             *next = xmalloc(sizeof(uint32_t) * (nclusters + 1));
+    for (size_t i = 0; i < nclusters; i++)
+        next[i] = clusters[i].start;
+    for (size_t i = 0; i < nnodes; i++) {
+        const uint32_t node = (nplayers + i) % nnodes;
+        if (rank[parent[node]])
+            members[next[rank[parent[node]] - 1]++] = node;
+    }
+
+    for (size_t i = 0; i < nclusters; i++) {
+        const cluster_t *cluster = &clusters[i];
+        printf("%" PRIu32 " runs, %" PRIu32 " players:", cluster->runs,
+               cluster->players);
+        for (uint32_t m = 0; m < cluster->runs + cluster->players; m++) {
+            const uint32_t node = members[cluster->start + m];
+            putchar(' ');
+            if (node >= nplayers) {
+                char id[META_ID_LEN];
+                memcpy(id, &runs[node - nplayers], META_ID_LEN);
+                fwrite(id, 1, strnlen(id, META_ID_LEN), stdout);
+            } else {
+                dict_print(&meta->dicts[DICT_PLAYER], node);
+            }
+        }
+        putchar('\n');
+    }
+
+    free(members);
+    free(next);
+    free(clusters);
+    free(nruns_of);
+    free(nplayers_of);
+}
+
+int cluster_query(store_t *store, const meta_db_t *meta,
+                  const meta_filter_t *filter)
+{
+    const uint32_t *games = meta->map[COL_GAME],
+                   *categories = meta->map[COL_CATEGORY],
+                   *players_idx = meta->map[COL_PLAYERS_IDX],
+                   *players = meta->map[COL_PLAYERS];
+    const char *ids = meta->map[COL_ID];
+
+    /* A value that was never stored matches nothing */
+    const char *names[NDICTS] = {filter->game, filter->category,
+                                 filter->player};
+    uint32_t codes[NDICTS];
+    bool filtered = false;
+    for (int i = 0; i < NDICTS; i++) {
+        codes[i] = UINT32_MAX;
+        if (names[i] == NULL)
+            continue;
+        codes[i] = dict_find(&meta->dicts[i], names[i], strlen(names[i]));
+        if (codes[i] == UINT32_MAX)
+            return EXIT_SUCCESS;
+        filtered = true;
+    }
+
+    nplayers = meta->dicts[DICT_PLAYER].n;
+    extsort_init(&pairs, CLUSTER_MEMORY);
+    store_iterate(store, add_line, NULL);
+    add_meta(meta);
+    extsort_finish(&pairs);
+    link_videos();
+    extsort_free(&pairs);
+
+    const size_t nnodes = (size_t) nplayers + nruns;
+    uint32_t *parent = merge(nnodes);
+
+    /* A cluster is printed if the filters match any of its runs */
+    uint8_t *wanted = NULL;
+    if (filtered) {
+        wanted = xcalloc(nnodes + 1, 1);
+        for (size_t r = 0; r < meta->rows; r++) {
+            if ((codes[DICT_GAME] != UINT32_MAX
+                 && games[r] != codes[DICT_GAME])
+                || (codes[DICT_CATEGORY] != UINT32_MAX
+                    && categories[r] != codes[DICT_CATEGORY]))
+                continue;
+
+            uint32_t p = r ? players_idx[r - 1] : 0;
+            const uint32_t pend = players_idx[r];
+            while (codes[DICT_PLAYER] != UINT32_MAX && p < pend
+                   && players[p] != codes[DICT_PLAYER])
+                p++;
+            if (p == pend && codes[DICT_PLAYER] != UINT32_MAX)
+                continue;
+
+            const uint32_t node = find_run(pack_run(ids + r * META_ID_LEN,
+                                                    META_ID_LEN));
+            wanted[parent[node]] = 1;
+        }
+    }
+    print_clusters(meta, parent, nnodes, wanted);
+
+    free(parent);
+    free(wanted);
+    free(runs);
+    free(table);
+    free(edges);
+    free(packed);
+    runs = NULL, table = NULL, edges = NULL, packed = NULL;
+    nplayers = nruns = runs_cap = 0, mask = 0, nedges = edges_cap = 0;
+    npacked = packed_cap = 0;
+    return EXIT_SUCCESS;
+}
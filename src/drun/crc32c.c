@@ -0,0 +1,78 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+/* The CRC of every byte followed by 0 to 7 zero bytes */
+static uint32_t table[8][256];
+static pthread_once_t built = PTHREAD_ONCE_INIT;
+static bool hardware;
+
+static void build(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? crc >> 1 ^ CRC32C_POLY : crc >> 1;
+        table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int k = 1; k < 8; k++)
+            table[k][i] = table[k - 1][i] >> 8
+                          ^ table[0][table[k - 1][i] & 0xff];
+
+#if defined(__x86_64__)
+    hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo), hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = table[7][lo & 0xff] ^ table[6][lo >> 8 & 0xff]
+              ^ table[5][lo >> 16 & 0xff] ^ table[4][lo >> 24]
+              ^ table[3][hi & 0xff] ^ table[2][hi >> 8 & 0xff]
+              ^ table[1][hi >> 16 & 0xff] ^ table[0][hi >> 24];
+        p += 8, len -= 8;
+    }
+    while (len-- > 0)
+        crc = crc >> 8 ^ table[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8, len -= 8;
+    }
+    crc = crc64;
+    while (len-- > 0)
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#else
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    return crc32c_sw(crc, p, len);
+}
+#endif
+
+uint32_t crc32c(const uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&built, build);
+    return ~(hardware ? crc32c_hw(~crc, buf, len) : crc32c_sw(~crc, buf, len));
+}
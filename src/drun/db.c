@@ -0,0 +1,1813 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "canon.h"
+#include "crc32c.h"
+#include "db.h"
+#include "lz.h"
+#include "util.h"
+
+/* Upper limit of threads searching shards in parallel */
+#define DB_MAX_THREADS 16
+
+/* Bytes read to compare the first field of a line, longer URIs never match */
+#define DB_PEEK 1024
+
+/*
+ * Header of an index file of the hot segment with the inode `ino`, followed by
+ * the video hashes, the run hashes, the offsets and the flags of the lines and
+ * the two hash tables, each at a multiple of `align` bytes so it can be mapped
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+    uint64_t ino;
+    uint64_t indexed;
+    uint64_t n;
+    uint64_t mask;
+    uint32_t align;
+    uint32_t reserved;
+} idx_header_t;
+
+/* The arrays of an index file, in order */
+enum { IDX_HASHES, IDX_RUNS, IDX_OFFS, IDX_FLAGS, IDX_TABLE, IDX_RTABLE,
+       IDX_ARRAYS };
+
+/* Header of a cold segment, followed by the block table and the filters */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nblocks;
+    uint32_t filter_bytes;
+    uint64_t nlines;
+} seg_header_t;
+
+/* The shards searched by one thread */
+typedef struct {
+    shard_t *shards;
+    size_t nshards, first, step;
+    const char *uri;
+    size_t len;
+    uint64_t hash;
+    bool *found;
+} search_t;
+
+/* The fields of a line, `run` is the last component of the run URI */
+typedef struct {
+    const char *video;
+    size_t video_len;
+    const char *run;
+    size_t run_len;
+    bool tombstone;
+} record_t;
+
+static void corrupt(const char *path)
+{
+    fprintf(stderr, "drun: corrupt cold segment %s\n", path);
+    exit(EXIT_FAILURE);
+}
+
+/* Make sure `buf` has room for `need` bytes */
+static void *reserve(void *buf, size_t *size, const size_t need)
+{
+    if (need <= *size)
+        return buf;
+    *size = need;
+    return xrealloc(buf, need);
+}
+
+/* Bloom filter probes, derived from the two halves of the hash */
+static bool filter_test(const uint8_t *filter, const uint32_t bytes,
+                        const uint64_t h)
+{
+    const uint32_t mask = bytes * 8 - 1, h1 = h, h2 = h >> 32 | 1;
+    for (uint32_t i = 0; i < DB_FILTER_HASHES; i++) {
+        const uint32_t bit = (h1 + i * h2) & mask;
+        if (!(filter[bit >> 3] & 1 << (bit & 7)))
+            return false;
+    }
+    return true;
+}
+
+static void filter_add(uint8_t *filter, const uint32_t bytes, const uint64_t h)
+{
+    const uint32_t mask = bytes * 8 - 1, h1 = h, h2 = h >> 32 | 1;
+    for (uint32_t i = 0; i < DB_FILTER_HASHES; i++) {
+        const uint32_t bit = (h1 + i * h2) & mask;
+        filter[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+/* Whether the first field of the line is a form of the video URI `key` */
+static bool line_eq(const char *line, const size_t n, const char *key,
+                    const size_t len)
+{
+    size_t field = 0;
+    while (field < n && line[field] != ' ' && line[field] != '\n')
+        field++;
+    return field < n && canon_eq(line, field, key, len);
+}
+
+/* Hash of the canonical form of a video URI as it was stored */
+static uint64_t video_hash(const char *video, const size_t len)
+{
+    char canon[CANON_SIZE(len)];
+    return hash(canon, canon_uri(video, len, canon));
+}
+
+/* Lines are `VIDEO RUN_URI`, a tombstone is a removed line prefixed by '-' */
+static record_t parse_line(const char *line, size_t len)
+{
+    record_t rec = {line, 0, NULL, 0, false};
+    len = db_unseal(line, len);
+    if (len > 0 && line[0] == '-') {
+        rec.video = ++line, len--;
+        rec.tombstone = true;
+    }
+
+    while (rec.video_len < len && line[rec.video_len] != ' ')
+        rec.video_len++;
+
+    /* The run ID is the last component of the run URI */
+    const char *end = line + len, *run = end;
+    while (run > line + rec.video_len && run[-1] != '/' && run[-1] != ' ')
+        run--;
+    rec.run = run;
+    rec.run_len = end - run;
+    return rec;
+}
+
+size_t db_format(char *line, const size_t size, const char *video_uri,
+                 const char *runid)
+{
+    const int len = snprintf(line, size, "%s https://www.speedrun.com/run/%s",
+                             video_uri, runid);
+    return len + snprintf(line + len, size - len, "\t%0*" PRIx32 "\n",
+                          DB_CRC_DIGITS, crc32c(0, line, len));
+}
+
+size_t db_unseal(const char *line, const size_t len)
+{
+    const size_t end = len - (len > 0 && line[len - 1] == '\n');
+    if (end < DB_CRC_DIGITS + 1 || line[end - DB_CRC_DIGITS - 1] != '\t')
+        return end;
+    for (size_t i = end - DB_CRC_DIGITS; i < end; i++)
+        if (!isxdigit((unsigned char) line[i]))
+            return end;
+    return end - DB_CRC_DIGITS - 1;
+}
+
+int db_check(const char *line, const size_t len)
+{
+    const size_t body = db_unseal(line, len);
+    const size_t end = len - (len > 0 && line[len - 1] == '\n');
+    if (body == end)
+        return DB_LINE_UNSEALED;
+
+    char digits[DB_CRC_DIGITS + 1];
+    memcpy(digits, line + body + 1, DB_CRC_DIGITS);
+    digits[DB_CRC_DIGITS] = '\0';
+    const bool tomb = body > 0 && line[0] == '-';
+    return crc32c(0, line + tomb, body - tomb) == strtoul(digits, NULL, 16)
+               ? DB_LINE_OK
+               : DB_LINE_BAD;
+}
+
+static void lock_file(FILE *fp, const int op)
+{
+    while (flock(fileno(fp), op) == -1)
+        if (errno != EINTR)
+            die();
+}
+
+void db_recover(FILE *fp, const char *path)
+{
+    /* Appends hold the lock, so only a line left by a crash is incomplete */
+    lock_file(fp, LOCK_EX);
+    struct stat st;
+    if (fstat(fileno(fp), &st) == -1)
+        die();
+
+    /* Look back for the end of the last complete line */
+    char buf[4096];
+    off_t end = st.st_size;
+    while (end > 0) {
+        const size_t n = end < (off_t) sizeof(buf) ? (size_t) end : sizeof(buf);
+        if (pread(fileno(fp), buf, n, end - n) != (ssize_t) n)
+            die();
+        size_t i = n;
+        while (i > 0 && buf[i - 1] != '\n')
+            i--;
+        end -= n - i;
+        if (i > 0)
+            break;
+    }
+    if (end < st.st_size) {
+        if (ftruncate(fileno(fp), end) == -1)
+            die();
+        fprintf(stderr, "drun: %s: cut %jd bytes of an incomplete line\n",
+                path, (intmax_t) (st.st_size - end));
+    }
+    lock_file(fp, LOCK_UN);
+}
+
+off_t db_append(FILE *fp, const char *line, const size_t len)
+{
+    /*
+     * The stream appends, the seek only switches it from reading to writing.
+     * The lock keeps the line whole for other processes that recover the
+     * file, and makes the end after the write the end of this line.
+     */
+    lock_file(fp, LOCK_EX);
+    off_t end;
+    if (fseeko(fp, 0, SEEK_END) == -1 || fwrite(line, 1, len, fp) != len
+        || fflush(fp) == EOF || (end = ftello(fp)) == -1)
+        die();
+    lock_file(fp, LOCK_UN);
+    return end - len;
+}
+
+static void insert(uint32_t *table, const size_t mask, const uint64_t h,
+                   const uint32_t line)
+{
+    size_t i = h & mask;
+    while (table[i])
+        i = (i + 1) & mask;
+    table[i] = line + 1;
+}
+
+/* The size of an array of an index file */
+static uint64_t idx_size(const idx_header_t *hdr, const int array)
+{
+    switch (array) {
+    case IDX_FLAGS:
+        return hdr->n;
+    case IDX_TABLE:
+    case IDX_RTABLE:
+        return sizeof(uint32_t) * (hdr->mask + 1);
+    default:
+        return sizeof(uint64_t) * hdr->n;
+    }
+}
+
+/* Where the arrays of an index file start, and where the file ends */
+static void idx_layout(const idx_header_t *hdr, uint64_t off[IDX_ARRAYS + 1])
+{
+    uint64_t end = sizeof(*hdr);
+    for (int i = 0; i < IDX_ARRAYS; i++) {
+        off[i] = (end + hdr->align - 1) / hdr->align * hdr->align;
+        end = off[i] + idx_size(hdr, i);
+    }
+    off[IDX_ARRAYS] = end;
+}
+
+/* Unmap an index mapped from the index file */
+static void unmap_index(shard_t *s)
+{
+    const size_t lines = sizeof(uint64_t) * s->cap,
+                 table = sizeof(uint32_t) * (s->mask + 1);
+    if (munmap(s->hashes, lines) == -1 || munmap(s->runs, lines) == -1
+        || munmap(s->offs, lines) == -1 || munmap(s->flags, s->cap) == -1
+        || munmap(s->table, table) == -1 || munmap(s->rtable, table) == -1)
+        die();
+    s->mapped = false;
+}
+
+/* Copy the first `size` bytes of an array to memory for `cap` bytes */
+static void *copy_array(const void *array, const size_t size, const size_t cap)
+{
+    return memcpy(xmalloc(cap), array, size);
+}
+
+/* Copy a mapped index to memory of its own, before it is resized */
+static void own_index(shard_t *s)
+{
+    if (!s->mapped)
+        return;
+
+    const size_t lines = sizeof(uint64_t) * s->cap,
+                 table = sizeof(uint32_t) * (s->mask + 1);
+    shard_t own = *s;
+    own.hashes = copy_array(s->hashes, sizeof(uint64_t) * s->n, lines);
+    own.runs = copy_array(s->runs, sizeof(uint64_t) * s->n, lines);
+    own.offs = copy_array(s->offs, sizeof(uint64_t) * s->n, lines);
+    own.flags = copy_array(s->flags, s->n, s->cap);
+    own.table = copy_array(s->table, table, table);
+    own.rtable = copy_array(s->rtable, table, table);
+    unmap_index(s);
+    *s = own;
+    s->mapped = false;
+}
+
+/* Free the index of the hot segment of the shard */
+static void free_index(shard_t *s)
+{
+    if (s->mapped) {
+        unmap_index(s);
+    } else {
+        free(s->hashes);
+        free(s->runs);
+        free(s->offs);
+        free(s->flags);
+        free(s->table);
+        free(s->rtable);
+    }
+    s->hashes = s->runs = s->offs = NULL;
+    s->flags = NULL;
+    s->table = s->rtable = NULL;
+    s->n = s->cap = s->mask = 0;
+}
+
+/* Resize the hash tables to stay at most half full */
+static void grow_table(shard_t *s)
+{
+    own_index(s);
+    size_t size = s->table != NULL ? (s->mask + 1) * 2 : 1024;
+    while (size < (s->n + 1) * 2)
+        size *= 2;
+
+    free(s->table);
+    free(s->rtable);
+    s->table = xcalloc(size, sizeof(uint32_t));
+    s->rtable = xcalloc(size, sizeof(uint32_t));
+    s->mask = size - 1;
+
+    for (size_t line = 0; line < s->n; line++) {
+        insert(s->table, s->mask, s->hashes[line], line);
+        insert(s->rtable, s->mask, s->runs[line], line);
+    }
+}
+
+/* Read the line of the index at `line` into `s->match` */
+static void read_line(shard_t *s, const size_t line)
+{
+    ssize_t read;
+    if (fseeko(s->fp, s->offs[line], SEEK_SET) == -1
+        || (read = getline(&s->match, &s->match_size, s->fp)) == -1)
+        die();
+    s->match_len = read;
+}
+
+/* Whether the line of the index at `line` is about the video */
+static bool video_at(const shard_t *s, const size_t line, const char *uri,
+                     const size_t len)
+{
+    /* Compare the whole first field, hashes can collide */
+    const uint64_t off = s->offs[line] + (s->flags[line] & DB_TOMBSTONE);
+    char buf[DB_PEEK];
+    const ssize_t n = pread(fileno(s->fp), buf, sizeof(buf), off);
+    return n > 0 && line_eq(buf, n, uri, len);
+}
+
+/* Mark the lines before the tombstone at `tomb` that it removes as dead */
+static void kill_runs(shard_t *s, const char *line, const size_t len,
+                      const size_t tomb)
+{
+    const uint64_t h = s->hashes[tomb];
+    char buf[len];
+    for (size_t i = h & s->mask; s->table[i]; i = (i + 1) & s->mask) {
+        const size_t dead = s->table[i] - 1;
+        if (dead < tomb && s->hashes[dead] == h
+            && s->runs[dead] == s->runs[tomb] && s->flags[dead] == 0
+            && pread(fileno(s->fp), buf, len, s->offs[dead]) == (ssize_t) len
+            && memcmp(buf, line, len) == 0)
+            s->flags[dead] |= DB_DEAD;
+    }
+}
+
+/* Index a complete line of the hot segment, starting at `off` */
+static void push_line(shard_t *s, const char *text, const size_t len,
+                      const uint64_t off)
+{
+    const record_t rec = parse_line(text, len);
+    if (s->n == s->cap) {
+        own_index(s);
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->hashes = xrealloc(s->hashes, sizeof(uint64_t) * s->cap);
+        s->runs = xrealloc(s->runs, sizeof(uint64_t) * s->cap);
+        s->offs = xrealloc(s->offs, sizeof(uint64_t) * s->cap);
+        s->flags = xrealloc(s->flags, s->cap);
+    }
+    const size_t line = s->n++;
+    s->hashes[line] = video_hash(rec.video, rec.video_len);
+    s->runs[line] = hash(rec.run, rec.run_len);
+    s->offs[line] = off;
+    s->flags[line] = rec.tombstone ? DB_TOMBSTONE : 0;
+    s->dirty = true;
+
+    if (s->table == NULL || s->n * 2 > s->mask + 1) {
+        grow_table(s);
+    } else {
+        insert(s->table, s->mask, s->hashes[line], line);
+        insert(s->rtable, s->mask, s->runs[line], line);
+    }
+
+    if (rec.tombstone)
+        kill_runs(s, text + 1, len - 1, line);
+}
+
+/*
+ * Whether the index file of the shard ends with the line the hot segment
+ * ends with at `hdr->indexed`: the last indexed line starts after a newline,
+ * runs up to `indexed` with no other one, and its CRC holds. This is cheap
+ * and catches an index of lines that were since cut or that it misplaced.
+ */
+static bool index_fits(const shard_t *s, const int fd, const idx_header_t *hdr,
+                       const uint64_t offs)
+{
+    if (hdr->n == 0)
+        return hdr->indexed == 0;
+
+    uint64_t last;
+    char buf[4096];
+    if (pread(fd, &last, sizeof(last), offs + sizeof(last) * (hdr->n - 1))
+            != sizeof(last)
+        || last >= hdr->indexed || hdr->indexed - last >= sizeof(buf))
+        return false;
+
+    /* The newline before the line, if there is one, is read with it */
+    const size_t before = last > 0, len = hdr->indexed - last + before;
+    if (pread(fileno(s->fp), buf, len, last - before) != (ssize_t) len
+        || (before && buf[0] != '\n') || buf[len - 1] != '\n'
+        || memchr(buf + before, '\n', len - before - 1) != NULL)
+        return false;
+    return db_check(buf + before, len - before) != DB_LINE_BAD;
+}
+
+/*
+ * Open the index file of the shard and read its header, if it is an index of
+ * the hot segment as it is now. The open file is returned, or -1.
+ */
+static int open_index(const shard_t *s, idx_header_t *hdr)
+{
+    char path[1100];
+    snprintf(path, sizeof(path), "%s.idx", s->path);
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat hot, st;
+    uint64_t off[IDX_ARRAYS + 1];
+    if (fstat(fileno(s->fp), &hot) == 0 && fstat(fd, &st) == 0
+        && pread(fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr)
+        && hdr->magic == DB_IDX_MAGIC && hdr->version == DB_IDX_VERSION
+        && hdr->ino == (uint64_t) hot.st_ino
+        && hdr->indexed <= (uint64_t) hot.st_size && hdr->n < UINT32_MAX
+        && hdr->mask > 0 && hdr->mask < UINT32_MAX
+        && (hdr->mask & (hdr->mask + 1)) == 0 && hdr->n * 2 <= hdr->mask + 1
+        && hdr->align >= sizeof(uint64_t)
+        && (hdr->align & (hdr->align - 1)) == 0) {
+        idx_layout(hdr, off);
+        if ((uint64_t) st.st_size >= off[IDX_ARRAYS]
+            && index_fits(s, fd, hdr, off[IDX_OFFS]))
+            return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+/*
+ * Map `size` bytes of the index file at `off` into an area of `cap` bytes, so
+ * the array grows in place, or read them if the index is not mapped. Mapped
+ * pages are shared with every process that maps them until written to.
+ */
+static void *load_array(const shard_t *s, const int fd, const uint64_t off,
+                        const size_t size, const size_t cap)
+{
+    if (!s->mapped) {
+        uint8_t *array = xmalloc(cap);
+        for (size_t done = 0; done < size;) {
+            const ssize_t n = pread(fd, array + done, size - done, off + done);
+            if (n <= 0)
+                die();
+            done += n;
+        }
+        return array;
+    }
+
+    void *area = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED
+        || (size > 0
+            && mmap(area, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                    fd, off) == MAP_FAILED))
+        die();
+    return area;
+}
+
+/*
+ * Replace the index of the shard with the one of the index file opened by
+ * `open_index()`. The arrays get room for the lines the tables take before
+ * they grow, so appending lines costs a few pages rather than a copy.
+ */
+static void attach_index(shard_t *s, const int fd, const idx_header_t *hdr)
+{
+    uint64_t off[IDX_ARRAYS + 1];
+    idx_layout(hdr, off);
+    free_index(s);
+    s->mapped = hdr->align % sysconf(_SC_PAGESIZE) == 0;
+    s->n = hdr->n, s->cap = (hdr->mask + 1) / 2, s->mask = hdr->mask;
+
+    const size_t lines = sizeof(uint64_t) * s->cap,
+                 table = sizeof(uint32_t) * (s->mask + 1);
+    s->hashes = load_array(s, fd, off[IDX_HASHES], idx_size(hdr, IDX_HASHES),
+                           lines);
+    s->runs = load_array(s, fd, off[IDX_RUNS], idx_size(hdr, IDX_RUNS), lines);
+    s->offs = load_array(s, fd, off[IDX_OFFS], idx_size(hdr, IDX_OFFS), lines);
+    s->flags = load_array(s, fd, off[IDX_FLAGS], s->n, s->cap);
+    s->table = load_array(s, fd, off[IDX_TABLE], table, table);
+    s->rtable = load_array(s, fd, off[IDX_RTABLE], table, table);
+    s->indexed = hdr->indexed;
+    s->generation = hdr->generation;
+    s->dirty = false;
+}
+
+/*
+ * Map the index file of the shard, a missing or outdated one is rebuilt.
+ * Whether there was an index to map is returned.
+ */
+static bool load_index(shard_t *s)
+{
+    idx_header_t hdr;
+    const int fd = open_index(s, &hdr);
+    if (fd == -1)
+        return false;
+
+    attach_index(s, fd, &hdr);
+    close(fd);
+    return true;
+}
+
+/* Whether another process published an index that covers this one */
+static bool published(const shard_t *s)
+{
+    idx_header_t hdr;
+    const int fd = open_index(s, &hdr);
+    if (fd == -1)
+        return false;
+
+    close(fd);
+    return hdr.indexed >= s->indexed;
+}
+
+/* The bytes of a cold segment that are mapped, up to the end of the filters */
+static size_t seg_span(const segment_t *seg)
+{
+    return sizeof(seg_header_t) + sizeof(seg_block_t) * seg->nblocks
+           + (size_t) seg->nblocks * seg->filter_bytes;
+}
+
+/* Map the block table and the filters of every cold segment */
+static void load_segments(shard_t *s)
+{
+    for (;;) {
+        char path[1100];
+        snprintf(path, sizeof(path), "%s.seg.%zu", s->path, s->nsegs);
+        const int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            if (errno == ENOENT)
+                return;
+            die();
+        }
+
+        seg_header_t hdr;
+        if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+            || hdr.magic != DB_SEG_MAGIC || hdr.version == 0
+            || hdr.version > DB_SEG_VERSION
+            || hdr.filter_bytes == 0
+            || (hdr.filter_bytes & (hdr.filter_bytes - 1)) != 0)
+            corrupt(path);
+
+        segment_t seg = {fd, hdr.version, hdr.nblocks, hdr.filter_bytes, NULL,
+                         NULL};
+        struct stat st;
+        const size_t span = seg_span(&seg);
+        if (fstat(fd, &st) == -1)
+            die();
+        if ((uint64_t) st.st_size < span)
+            corrupt(path);
+
+        /* Private, as `check_segment()` may fix the filters in place */
+        uint8_t *map = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                            fd, 0);
+        if (map == MAP_FAILED)
+            die();
+        seg.blocks = (seg_block_t *) (map + sizeof(hdr));
+        seg.filters = map + sizeof(hdr) + sizeof(seg_block_t) * seg.nblocks;
+
+        s->segs = xrealloc(s->segs, sizeof(segment_t) * (s->nsegs + 1));
+        s->segs[s->nsegs++] = seg;
+    }
+}
+
+static void load_shard(shard_t *s)
+{
+    s->loaded = true;
+    db_recover(s->fp, s->path);
+    load_index(s);
+    load_segments(s);
+}
+
+/*
+ * Publish the index as the next generation of the index file. It is written
+ * to a file of this process first and renamed over the index file, processes
+ * that mapped the old one keep it.
+ */
+static void save_index(shard_t *s)
+{
+    char path[1100], tmp[1100];
+    snprintf(path, sizeof(path), "%s.idx", s->path);
+    snprintf(tmp, sizeof(tmp), "%s.idx.%ld.tmp", s->path, (long) getpid());
+
+    struct stat hot;
+    if (s->table == NULL)
+        grow_table(s);
+    if (fstat(fileno(s->fp), &hot) == -1)
+        die();
+    idx_header_t hdr = {DB_IDX_MAGIC, DB_IDX_VERSION, s->generation + 1,
+                        hot.st_ino, s->indexed, s->n, s->mask,
+                        sysconf(_SC_PAGESIZE), 0};
+
+    /* Generations only grow, whichever process published the last one */
+    idx_header_t last;
+    const int fd = open_index(s, &last);
+    if (fd != -1) {
+        close(fd);
+        if (last.generation >= hdr.generation)
+            hdr.generation = last.generation + 1;
+    }
+
+    uint64_t off[IDX_ARRAYS + 1];
+    idx_layout(&hdr, off);
+    const void *arrays[IDX_ARRAYS] = {s->hashes, s->runs, s->offs, s->flags,
+                                      s->table, s->rtable};
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL)
+        die();
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    for (int i = 0; i < IDX_ARRAYS; i++)
+        if (fseeko(fp, off[i], SEEK_SET) == -1
+            || fwrite(arrays[i], 1, idx_size(&hdr, i), fp) != idx_size(&hdr, i))
+            die();
+    if (ferror(fp) || fclose(fp) == EOF || rename(tmp, path) == -1)
+        die();
+    s->generation = hdr.generation;
+}
+
+/* Forget the index, e.g. when the hot segment was replaced */
+static void reset_index(shard_t *s)
+{
+    s->n = 0, s->indexed = 0, s->dirty = true;
+    if (s->table != NULL) {
+        memset(s->table, 0, sizeof(uint32_t) * (s->mask + 1));
+        memset(s->rtable, 0, sizeof(uint32_t) * (s->mask + 1));
+    }
+}
+
+/* Index the lines appended to the shard since it was last indexed */
+static void refresh_index(shard_t *s)
+{
+    struct stat st;
+    if (fstat(fileno(s->fp), &st) == -1)
+        die();
+
+    /* The shard was truncated or replaced, index it from scratch */
+    if ((uint64_t) st.st_size < s->indexed)
+        reset_index(s);
+    if ((uint64_t) st.st_size == s->indexed)
+        return;
+
+    /* Another process may have published an index of the new lines */
+    idx_header_t hdr;
+    const int fd = open_index(s, &hdr);
+    if (fd != -1) {
+        if (hdr.generation != s->generation && hdr.indexed > s->indexed)
+            attach_index(s, fd, &hdr);
+        close(fd);
+        if ((uint64_t) st.st_size == s->indexed)
+            return;
+    }
+
+    if (fseeko(s->fp, s->indexed, SEEK_SET) == -1)
+        die();
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t read;
+    while ((read = getline(&line, &size, s->fp)) != -1) {
+        /* A line that is still being written is indexed next time */
+        if (line[read - 1] != '\n')
+            break;
+
+        push_line(s, line, read, s->indexed);
+        s->indexed += read;
+    }
+    if (ferror(s->fp))
+        die();
+    free(line);
+}
+
+/* Remember the line removed by a tombstone for the current lookup */
+static void add_tomb(shard_t *s, const char *line, const size_t len)
+{
+    s->tombs = reserve(s->tombs, &s->tombs_size, s->tombs_len + len);
+    memcpy(s->tombs + s->tombs_len, line, len);
+    s->tombs_len += len;
+}
+
+static bool is_tomb(const shard_t *s, const char *line, const size_t len)
+{
+    for (size_t i = 0; i < s->tombs_len;) {
+        const char *nl = memchr(s->tombs + i, '\n', s->tombs_len - i);
+        const size_t n = (size_t) (nl - s->tombs) + 1 - i;
+        if (n == len && memcmp(s->tombs + i, line, len) == 0)
+            return true;
+        i += n;
+    }
+    return false;
+}
+
+/* Whether the line is a run of the video `key`, or of its run if it has one */
+static bool key_eq(const record_t *key, const char *line, const size_t n)
+{
+    if (!line_eq(line, n, key->video, key->video_len))
+        return false;
+    if (key->run == NULL)
+        return true;
+    const record_t rec = parse_line(line, n);
+    return rec.run_len == key->run_len
+           && memcmp(rec.run, key->run, key->run_len) == 0;
+}
+
+/*
+ * Look for a run of the video in the hot segment and copy its line to
+ * `s->match`. The tombstones found are remembered as they can remove runs of
+ * the cold segments.
+ */
+static bool lookup_hot(shard_t *s, const record_t *key, const uint64_t h)
+{
+    if (s->table == NULL)
+        return false;
+
+    for (size_t i = h & s->mask; s->table[i]; i = (i + 1) & s->mask) {
+        const size_t line = s->table[i] - 1;
+        if (s->hashes[line] != h || (s->flags[line] & DB_DEAD)
+            || !video_at(s, line, key->video, key->video_len))
+            continue;
+
+        read_line(s, line);
+        if (s->flags[line] & DB_TOMBSTONE)
+            add_tomb(s, s->match + 1, s->match_len - 1);
+        else if (key_eq(key, s->match, s->match_len))
+            return true;
+    }
+
+    return false;
+}
+
+/* Read and decompress a block of a cold segment into `s->block` */
+static void read_block(shard_t *s, const segment_t *seg, const uint32_t b)
+{
+    const seg_block_t *blk = &seg->blocks[b];
+    s->zblock = reserve(s->zblock, &s->zblock_size, blk->size);
+    s->block = reserve(s->block, &s->block_size, blk->raw);
+    if (pread(seg->fd, s->zblock, blk->size, blk->off) != (ssize_t) blk->size
+        || !lz_decompress(s->zblock, blk->size, s->block, blk->raw))
+        corrupt(s->path);
+}
+
+static bool block_filter(const segment_t *seg, const uint32_t b,
+                         const uint64_t h)
+{
+    return filter_test(seg->filters + (size_t) b * seg->filter_bytes,
+                       seg->filter_bytes, h);
+}
+
+/*
+ * Look for a run of the video in the cold segments and copy its line to
+ * `s->match`. Lines are visited newest first so that tombstones are seen
+ * before the runs they remove, and only the blocks whose filter matches are
+ * decompressed.
+ */
+static bool lookup_cold(shard_t *s, const record_t *key, const uint64_t h)
+{
+    for (size_t i = s->nsegs; i-- > 0;) {
+        const segment_t *seg = &s->segs[i];
+        for (uint32_t b = seg->nblocks; b-- > 0;) {
+            if (!block_filter(seg, b, h))
+                continue;
+
+            /* Lines are only delimited forward, so collect the matches */
+            read_block(s, seg, b);
+            const char *line = (const char *) s->block,
+                       *end = line + seg->blocks[b].raw;
+            size_t nhits = 0;
+            while (line < end) {
+                const char *nl = memchr(line, '\n', end - line);
+                const size_t n = nl != NULL ? (size_t) (nl - line) + 1
+                                            : (size_t) (end - line);
+                const bool tomb = line[0] == '-';
+                if (line_eq(line + tomb, n - tomb, key->video,
+                            key->video_len)) {
+                    s->hits = reserve(s->hits, &s->hits_size,
+                                      sizeof(*s->hits) * (nhits + 1));
+                    s->hits[nhits++] = line - (const char *) s->block;
+                }
+                line += n;
+            }
+
+            while (nhits-- > 0) {
+                line = (const char *) s->block + s->hits[nhits];
+                const char *nl = memchr(line, '\n', end - line);
+                const size_t n = nl != NULL ? (size_t) (nl - line) + 1
+                                            : (size_t) (end - line);
+                if (line[0] == '-') {
+                    add_tomb(s, line + 1, n - 1);
+                } else if (key_eq(key, line, n) && !is_tomb(s, line, n)) {
+                    s->match = reserve(s->match, &s->match_size, n + 1);
+                    memcpy(s->match, line, n);
+                    s->match[n] = '\0';
+                    s->match_len = n;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Look for a run of the video that was not removed */
+static bool find_video(shard_t *s, const record_t *key, const uint64_t h)
+{
+    s->tombs_len = 0;
+    return lookup_hot(s, key, h) || lookup_cold(s, key, h);
+}
+
+/* Look for a run that was not removed by its ID and copy its line */
+static bool find_run(shard_t *s, const char *id, const size_t len)
+{
+    const uint64_t h = hash(id, len);
+
+    /* The reverse index of the hot segment */
+    if (s->table != NULL) {
+        for (size_t i = h & s->mask; s->rtable[i]; i = (i + 1) & s->mask) {
+            const size_t line = s->rtable[i] - 1;
+            if (s->runs[line] != h || s->flags[line] != 0)
+                continue;
+
+            read_line(s, line);
+            const record_t rec = parse_line(s->match, s->match_len);
+            if (rec.run_len == len && memcmp(rec.run, id, len) == 0)
+                return true;
+        }
+    }
+
+    /*
+     * The filters of cold segments have the run IDs too, but whether a run
+     * found there was removed depends on the newer lines of its video
+     */
+    for (size_t i = s->nsegs; i-- > 0;) {
+        const segment_t *seg = &s->segs[i];
+        for (uint32_t b = seg->nblocks; b-- > 0;) {
+            if (seg->version > 1 && !block_filter(seg, b, h))
+                continue;
+
+            read_block(s, seg, b);
+            for (size_t off = 0; off < seg->blocks[b].raw;) {
+                const char *line = (const char *) s->block + off,
+                           *nl = memchr(line, '\n', seg->blocks[b].raw - off);
+                const size_t n = nl != NULL ? (size_t) (nl - line) + 1
+                                            : seg->blocks[b].raw - off;
+                off += n;
+
+                record_t rec = parse_line(line, n);
+                if (rec.tombstone || rec.run_len != len
+                    || memcmp(rec.run, id, len) != 0)
+                    continue;
+
+                char copy[CANON_SIZE(n)];
+                rec.video_len = canon_uri(rec.video, rec.video_len, copy);
+                rec.video = copy;
+                rec.run = memcpy(copy + rec.video_len + 1, rec.run,
+                                 rec.run_len);
+                if (find_video(s, &rec, hash(rec.video, rec.video_len)))
+                    return true;
+
+                /* The lookup replaced the block */
+                read_block(s, seg, b);
+            }
+        }
+    }
+
+    return false;
+}
+
+static void *search_shards(void *arg)
+{
+    const search_t *search = arg;
+    for (size_t i = search->first; i < search->nshards; i += search->step) {
+        shard_t *s = &search->shards[i];
+        if (!s->loaded)
+            load_shard(s);
+        refresh_index(s);
+        const record_t key = {search->uri, search->len, NULL, 0, false};
+        search->found[i] = find_video(s, &key, search->hash);
+    }
+    return NULL;
+}
+
+/* Append a line to the hot segment of the shard */
+static void append_line(shard_t *s, const char *line, const size_t len)
+{
+    const uint64_t off = db_append(s->fp, line, len);
+
+    /* Lines appended by someone else first are indexed on the next lookup */
+    if (off == s->indexed) {
+        push_line(s, line, len, off);
+        s->indexed += len;
+    }
+}
+
+/* Get the shard stored at `path`, opening it if it is not yet */
+static size_t get_shard(db_t *db, const char *path)
+{
+    for (size_t i = 0; i < db->nshards; i++)
+        if (strcmp(db->shards[i].path, path) == 0)
+            return i;
+
+    if (db->nshards == db->cap) {
+        db->cap = db->cap ? db->cap * 2 : 16;
+        db->shards = xrealloc(db->shards, sizeof(shard_t) * db->cap);
+    }
+
+    shard_t *s = &db->shards[db->nshards];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    if ((s->fp = fopen(path, "a+")) == NULL)
+        die();
+
+    return db->nshards++;
+}
+
+/* IDs end up in file names, so only accept what sr.c uses for them */
+static bool valid_id(const char *id)
+{
+    if (id == NULL || *id == '\0')
+        return false;
+    for (; *id != '\0'; id++)
+        if (!isalnum((unsigned char) *id))
+            return false;
+    return true;
+}
+
+static size_t run_shard(db_t *db, const char *game, const char *category)
+{
+    char path[2048];
+    if (db->by == SHARD_NONE || !valid_id(game)) {
+        snprintf(path, sizeof(path), "%s/runs", db->dir);
+        return get_shard(db, path);
+    }
+
+    snprintf(path, sizeof(path), "%s/shards", db->dir);
+    if (mkdir(path, 0777) == -1 && errno != EEXIST)
+        die();
+
+    if (db->by == SHARD_CATEGORY && valid_id(category))
+        snprintf(path, sizeof(path), "%s/shards/%s.%s", db->dir, game,
+                 category);
+    else
+        snprintf(path, sizeof(path), "%s/shards/%s", db->dir, game);
+    return get_shard(db, path);
+}
+
+/* Open the flat `runs` file and every shard */
+static void scan_shards(db_t *db)
+{
+    db->scanned = true;
+
+    char path[2048];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/runs", db->dir);
+    if (stat(path, &st) == 0)
+        get_shard(db, path);
+
+    snprintf(path, sizeof(path), "%s/shards", db->dir);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        if (errno == ENOENT)
+            return;
+        die();
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const size_t len = strlen(ent->d_name);
+        if (ent->d_name[0] == '.'
+            || (len > 4 && strcmp(ent->d_name + len - 4, ".idx") == 0)
+            || (len > 4 && strcmp(ent->d_name + len - 4, ".tmp") == 0)
+            || strstr(ent->d_name, ".seg.") != NULL)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/shards/%s", db->dir, ent->d_name);
+        get_shard(db, path);
+    }
+    closedir(dir);
+}
+
+void db_open(db_t *db, const char *dir, const int by)
+{
+    memset(db, 0, sizeof(*db));
+    snprintf(db->dir, sizeof(db->dir), "%s", dir);
+    db->by = by;
+}
+
+char *db_find(db_t *db, const char *game, const char *category,
+              const char *video_uri, const bool cross, arena_t *arena)
+{
+    const size_t own = run_shard(db, game, category);
+    if (cross && !db->scanned)
+        scan_shards(db);
+
+    bool *found = arena_alloc(arena, sizeof(bool) * db->nshards);
+    search_t search = {db->shards, db->nshards, own, db->nshards,
+                       video_uri,  strlen(video_uri), 0, found};
+    search.hash = hash(video_uri, search.len);
+
+    if (!cross) {
+        search_shards(&search);
+    } else {
+        long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads > DB_MAX_THREADS)
+            nthreads = DB_MAX_THREADS;
+        if (nthreads > (long) db->nshards)
+            nthreads = db->nshards;
+        if (nthreads < 1)
+            nthreads = 1;
+
+        pthread_t threads[DB_MAX_THREADS];
+        search_t searches[DB_MAX_THREADS];
+        for (long t = 0; t < nthreads; t++) {
+            searches[t] = search;
+            searches[t].first = t, searches[t].step = nthreads;
+            if (t > 0
+                && pthread_create(&threads[t], NULL, search_shards,
+                                  &searches[t])
+                       != 0)
+                die();
+        }
+
+        /* The calling thread takes its share too */
+        search_shards(&searches[0]);
+        for (long t = 1; t < nthreads; t++)
+            pthread_join(threads[t], NULL);
+    }
+
+    /* Prefer a duplicate in the shard of the run itself */
+    size_t match = own;
+    if (!found[own]) {
+        if (!cross)
+            return NULL;
+        for (match = 0; match < db->nshards && !found[match]; match++)
+            ;
+        if (match == db->nshards)
+            return NULL;
+    }
+
+    const shard_t *s = &db->shards[match];
+    const size_t len = db_unseal(s->match, s->match_len);
+    char *line = arena_alloc(arena, len + 2);
+    memcpy(line, s->match, len);
+    line[len] = '\n', line[len + 1] = '\0';
+    return line;
+}
+
+void db_warm(db_t *db, const bool cross)
+{
+    if (cross) {
+        if (!db->scanned)
+            scan_shards(db);
+    } else if (db->by == SHARD_NONE) {
+        run_shard(db, NULL, NULL);
+    } else {
+        return;
+    }
+
+    for (size_t i = 0; i < db->nshards; i++) {
+        shard_t *s = &db->shards[i];
+        if (!s->loaded)
+            load_shard(s);
+        refresh_index(s);
+    }
+}
+
+void db_add(db_t *db, const char *game, const char *category,
+            const char *video_uri, const char *runid)
+{
+    /* Getting the shard may move the shards */
+    const size_t shard = run_shard(db, game, category);
+    shard_t *s = &db->shards[shard];
+    if (!s->loaded)
+        load_shard(s);
+
+    char line[strlen(video_uri) + strlen(runid) + 64];
+    append_line(s, line, db_format(line, sizeof(line), video_uri, runid));
+}
+
+size_t db_remove(db_t *db, const char *key, const bool by_run)
+{
+    if (!db->scanned)
+        scan_shards(db);
+
+    const record_t video = {key, strlen(key), NULL, 0, false};
+    const uint64_t h = hash(key, video.video_len);
+    size_t removed = 0;
+    for (size_t i = 0; i < db->nshards; i++) {
+        shard_t *s = &db->shards[i];
+        if (!s->loaded)
+            load_shard(s);
+
+        /* Every tombstone removes one line, until no run is left */
+        for (;;) {
+            refresh_index(s);
+            if (!(by_run ? find_run(s, key, video.video_len)
+                         : find_video(s, &video, h)))
+                break;
+
+            char line[s->match_len + 1];
+            line[0] = '-';
+            memcpy(line + 1, s->match, s->match_len);
+            append_line(s, line, s->match_len + 1);
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+/* Hand a line to `visit` without its CRC */
+static void visit_line(const char *line, const size_t n, const db_visit_t visit,
+                       void *arg)
+{
+    const size_t len = db_unseal(line, n);
+    char copy[len + 1];
+    memcpy(copy, line, len);
+    copy[len] = '\n';
+    visit(copy, len + 1, arg);
+}
+
+void db_iterate(db_t *db, const db_visit_t visit, void *arg)
+{
+    if (!db->scanned)
+        scan_shards(db);
+
+    for (size_t i = 0; i < db->nshards; i++) {
+        shard_t *s = &db->shards[i];
+        if (!s->loaded)
+            load_shard(s);
+        refresh_index(s);
+        s->tombs_len = 0;
+
+        /* The removed lines of the hot segment are marked already */
+        if (fseeko(s->fp, 0, SEEK_SET) == -1)
+            die();
+        for (size_t line = 0; line < s->n; line++) {
+            const ssize_t read = getline(&s->match, &s->match_size, s->fp);
+            if (read == -1)
+                die();
+            if (s->flags[line] & DB_TOMBSTONE)
+                add_tomb(s, s->match + 1, read - 1);
+            else if (!(s->flags[line] & DB_DEAD))
+                visit_line(s->match, read, visit, arg);
+        }
+
+        /* Newest first, so that tombstones come before the lines they remove */
+        for (size_t j = s->nsegs; j-- > 0;) {
+            const segment_t *seg = &s->segs[j];
+            for (uint32_t b = seg->nblocks; b-- > 0;) {
+                read_block(s, seg, b);
+                const char *line = (const char *) s->block,
+                           *end = line + seg->blocks[b].raw;
+                size_t nlines = 0;
+                while (line < end) {
+                    s->hits = reserve(s->hits, &s->hits_size,
+                                      sizeof(*s->hits) * (nlines + 1));
+                    s->hits[nlines++] = line - (const char *) s->block;
+                    const char *nl = memchr(line, '\n', end - line);
+                    line = nl != NULL ? nl + 1 : end;
+                }
+
+                while (nlines-- > 0) {
+                    line = (const char *) s->block + s->hits[nlines];
+                    const char *nl = memchr(line, '\n', end - line);
+                    const size_t n = nl != NULL ? (size_t) (nl - line) + 1
+                                                : (size_t) (end - line);
+                    if (line[0] == '-')
+                        add_tomb(s, line + 1, n - 1);
+                    else if (!is_tomb(s, line, n))
+                        visit_line(line, n, visit, arg);
+                }
+            }
+        }
+    }
+}
+
+/* Write complete lines as a new cold segment of the shard */
+static void write_segment(shard_t *s, const char *data, const size_t len)
+{
+    /* Split the lines into blocks of about DB_BLOCK bytes */
+    size_t *ends = NULL, nblocks = 0, maxlines = 0, nlines = 0;
+    for (size_t start = 0; start < len; nblocks++) {
+        size_t end = start, lines = 0;
+        while (end < len) {
+            const char *nl = memchr(data + end, '\n', len - end);
+            const size_t next = nl != NULL ? (size_t) (nl - data) + 1 : len;
+            if (next - start > DB_BLOCK && lines > 0)
+                break;
+            end = next, lines++;
+        }
+
+        ends = xrealloc(ends, sizeof(size_t) * (nblocks + 1));
+        ends[nblocks] = start = end;
+        nlines += lines;
+        if (lines > maxlines)
+            maxlines = lines;
+    }
+
+    /* Both the video and the run of every line are in the filters */
+    uint32_t bits = 64;
+    while (bits < maxlines * 2 * DB_FILTER_BITS)
+        bits *= 2;
+    const seg_header_t hdr = {DB_SEG_MAGIC, DB_SEG_VERSION, nblocks, bits / 8,
+                              nlines};
+
+    seg_block_t *blocks = xrealloc(NULL, sizeof(seg_block_t) * nblocks + 1);
+    uint8_t *filters = xcalloc((size_t) nblocks * hdr.filter_bytes + 1, 1);
+
+    char path[1100], tmp[1200];
+    snprintf(path, sizeof(path), "%s.seg.%zu", s->path, s->nsegs);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL)
+        die();
+
+    /* The block table is written once the offsets of the blocks are known */
+    off_t off = sizeof(hdr) + sizeof(seg_block_t) * nblocks
+                + (size_t) nblocks * hdr.filter_bytes;
+    if (fseeko(fp, off, SEEK_SET) == -1)
+        die();
+
+    for (size_t b = 0, start = 0; b < nblocks; start = ends[b++]) {
+        const size_t raw = ends[b] - start;
+        uint8_t *filter = filters + b * hdr.filter_bytes;
+        for (size_t i = start; i < ends[b];) {
+            const char *nl = memchr(data + i, '\n', ends[b] - i);
+            const size_t n = nl != NULL ? (size_t) (nl - data) + 1 - i
+                                        : ends[b] - i;
+            const record_t rec = parse_line(data + i, n);
+            filter_add(filter, hdr.filter_bytes,
+                       video_hash(rec.video, rec.video_len));
+            filter_add(filter, hdr.filter_bytes, hash(rec.run, rec.run_len));
+            i += n;
+        }
+
+        s->zblock = reserve(s->zblock, &s->zblock_size, lz_bound(raw));
+        const size_t size =
+            lz_compress((const uint8_t *) data + start, raw, s->zblock);
+        blocks[b] = (seg_block_t){off, size, raw};
+        fwrite(s->zblock, 1, size, fp);
+        off += size;
+    }
+
+    if (fseeko(fp, 0, SEEK_SET) == -1)
+        die();
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(blocks, sizeof(seg_block_t), nblocks, fp);
+    fwrite(filters, hdr.filter_bytes, nblocks, fp);
+    if (ferror(fp) || fflush(fp) == EOF || fsync(fileno(fp)) == -1
+        || fclose(fp) == EOF || rename(tmp, path) == -1)
+        die();
+
+    free(ends);
+    free(blocks);
+    free(filters);
+}
+
+/*
+ * Move all but the newest `keep` lines of the shard to a cold segment. Removed
+ * runs are dropped, and so are their tombstones unless they still have to
+ * remove a run of an older cold segment.
+ */
+static void compact_shard(shard_t *s, const size_t keep)
+{
+    if (!s->loaded)
+        load_shard(s);
+    refresh_index(s);
+
+    struct stat st;
+    if (fstat(fileno(s->fp), &st) == -1)
+        die();
+    const size_t size = st.st_size;
+    char *data = xrealloc(NULL, size + 1);
+    if (fseeko(s->fp, 0, SEEK_SET) == -1
+        || fread(data, 1, size, s->fp) != size)
+        die();
+
+    /* Only complete lines are compacted, counting back from the last one */
+    size_t split = size;
+    while (split > 0 && data[split - 1] != '\n')
+        split--;
+    for (size_t k = 0; k < keep && split > 0; k++) {
+        split--;
+        while (split > 0 && data[split - 1] != '\n')
+            split--;
+    }
+    if (split == 0) {
+        free(data);
+        return;
+    }
+
+    char *cold = xrealloc(NULL, split + 1);
+    size_t cold_len = 0;
+    for (size_t line = 0; line < s->n && s->offs[line] < split; line++) {
+        const char *text = data + s->offs[line],
+                   *nl = memchr(text, '\n', split - s->offs[line]);
+        const size_t n = nl - text + 1;
+        if (s->flags[line] & DB_DEAD)
+            continue;
+
+        if (s->flags[line] & DB_TOMBSTONE) {
+            record_t rec = parse_line(text, n);
+            char canon[CANON_SIZE(rec.video_len)];
+            rec.video_len = canon_uri(rec.video, rec.video_len, canon);
+            rec.video = canon;
+            s->tombs_len = 0;
+            if (!lookup_cold(s, &rec, s->hashes[line])
+                || s->match_len != n - 1
+                || memcmp(s->match, text + 1, n - 1) != 0)
+                continue;
+        }
+
+        memcpy(cold + cold_len, text, n);
+        cold_len += n;
+    }
+
+    /*
+     * The segment is in place before the hot segment loses its lines, so a
+     * crash in between leaves lines in both, which is harmless for lookups
+     */
+    const size_t seg = s->nsegs;
+    if (cold_len > 0)
+        write_segment(s, cold, cold_len);
+    free(cold);
+
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", s->path);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL)
+        die();
+    fwrite(data + split, 1, size - split, fp);
+    if (ferror(fp) || fflush(fp) == EOF || fsync(fileno(fp)) == -1
+        || fclose(fp) == EOF || rename(tmp, s->path) == -1)
+        die();
+    free(data);
+
+    /* Reopen the new hot segment and index it from scratch */
+    fclose(s->fp);
+    if ((s->fp = fopen(s->path, "a+")) == NULL)
+        die();
+    reset_index(s);
+    refresh_index(s);
+    save_index(s);
+    s->dirty = false;
+    load_segments(s);
+
+    struct stat st_cold = {0};
+    char path[1100];
+    snprintf(path, sizeof(path), "%s.seg.%zu", s->path, seg);
+    if (cold_len > 0 && stat(path, &st_cold) == -1)
+        die();
+    printf("%s: %zu bytes of runs compressed to %jd bytes, %zu bytes of "
+           "removed runs dropped, %zu bytes hot\n",
+           s->path, cold_len, (intmax_t) st_cold.st_size, split - cold_len,
+           size - split);
+}
+
+void db_compact(db_t *db, const size_t keep)
+{
+    if (!db->scanned)
+        scan_shards(db);
+
+    for (size_t i = 0; i < db->nshards; i++)
+        compact_shard(&db->shards[i], keep);
+}
+
+/* How many threads to split `size` bytes of work of `chunk` bytes between */
+static long reindex_threads(const uint64_t size, const uint64_t chunk)
+{
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > DB_MAX_THREADS)
+        nthreads = DB_MAX_THREADS;
+    if ((uint64_t) nthreads > size / chunk + 1)
+        nthreads = size / chunk + 1;
+    return nthreads < 1 ? 1 : nthreads;
+}
+
+/* Run `work` with every argument, the calling thread takes the first one */
+static void run_threads(void *(*work)(void *), void *args, const size_t size,
+                        const long nthreads)
+{
+    pthread_t threads[DB_MAX_THREADS];
+    for (long t = 1; t < nthreads; t++)
+        if (pthread_create(&threads[t], NULL, work, (char *) args + t * size)
+            != 0)
+            die();
+    work(args);
+    for (long t = 1; t < nthreads; t++)
+        pthread_join(threads[t], NULL);
+}
+
+/* What the CRCs of the lines checked say, `first_bad` is where one failed */
+typedef struct {
+    size_t lines, bad, unsealed;
+    uint64_t first_bad;
+} seals_t;
+
+static void check_seal(seals_t *seals, const char *line, const size_t len,
+                       const uint64_t where)
+{
+    seals->lines++;
+    const int check = db_check(line, len);
+    if (check == DB_LINE_UNSEALED) {
+        seals->unsealed++;
+    } else if (check == DB_LINE_BAD) {
+        if (seals->bad == 0 || where < seals->first_bad)
+            seals->first_bad = where;
+        seals->bad++;
+    }
+}
+
+static void add_seals(seals_t *to, const seals_t *from)
+{
+    if (from->bad > 0 && (to->bad == 0 || from->first_bad < to->first_bad))
+        to->first_bad = from->first_bad;
+    to->lines += from->lines;
+    to->bad += from->bad;
+    to->unsealed += from->unsealed;
+}
+
+/* Print what the CRCs say, `unit` is what `first_bad` counts */
+static bool report_seals(const char *name, const seals_t *seals,
+                         const char *unit)
+{
+    if (seals->bad > 0)
+        printf("%s: %zu of %zu lines fail their CRC, the first at %s %" PRIu64
+               "\n",
+               name, seals->bad, seals->lines, unit, seals->first_bad);
+    if (seals->unsealed > 0)
+        printf("%s: %zu of %zu lines have no CRC\n", name, seals->unsealed,
+               seals->lines);
+    return seals->bad == 0;
+}
+
+/*
+ * A part of a shard indexed by one thread: its lines are counted first, and
+ * then indexed into their place in the index of the whole shard
+ */
+typedef struct {
+    shard_t *s;
+    const char *data;
+    uint64_t start, end;
+    size_t first, n;
+    seals_t seals;
+} part_t;
+
+static void *count_part(void *arg)
+{
+    part_t *part = arg;
+    part->n = 0;
+    for (uint64_t off = part->start; off < part->end; part->n++) {
+        const char *nl = memchr(part->data + off, '\n', part->end - off);
+        off = nl - part->data + 1;
+    }
+    return NULL;
+}
+
+static void *index_part(void *arg)
+{
+    part_t *part = arg;
+    shard_t *s = part->s;
+    uint64_t off = part->start;
+    for (size_t line = part->first; line < part->first + part->n; line++) {
+        const char *text = part->data + off,
+                   *nl = memchr(text, '\n', part->end - off);
+        const size_t len = nl - text + 1;
+        const record_t rec = parse_line(text, len);
+        s->hashes[line] = video_hash(rec.video, rec.video_len);
+        s->runs[line] = hash(rec.run, rec.run_len);
+        s->offs[line] = off;
+        s->flags[line] = rec.tombstone ? DB_TOMBSTONE : 0;
+        check_seal(&part->seals, text, len, off);
+        off += len;
+    }
+    return NULL;
+}
+
+/*
+ * Index every complete line of the hot segment into `out`, in parallel, and
+ * check their CRCs. Whether the last line is complete is returned.
+ */
+static bool build_index(shard_t *s, shard_t *out, seals_t *seals)
+{
+    memset(out, 0, sizeof(*out));
+    memcpy(out->path, s->path, sizeof(out->path));
+    out->fp = s->fp;
+
+    struct stat st;
+    if (fstat(fileno(s->fp), &st) == -1)
+        die();
+    char *data = NULL;
+    uint64_t size = st.st_size;
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(s->fp), 0);
+        if (data == MAP_FAILED)
+            die();
+    }
+    const uint64_t mapped = size;
+
+    /* A line that is still being written is indexed next time */
+    while (size > 0 && data[size - 1] != '\n')
+        size--;
+    out->indexed = size;
+
+    const long nthreads = reindex_threads(size, DB_REINDEX_CHUNK);
+    part_t parts[DB_MAX_THREADS];
+    for (long t = 0; t < nthreads; t++) {
+        /* Every part but the first starts after the end of a line */
+        uint64_t start = size * t / nthreads;
+        if (start > 0) {
+            const char *nl = memchr(data + start - 1, '\n', size - start + 1);
+            start = nl - data + 1;
+        }
+        parts[t] = (part_t){out, data, start, size, 0, 0, {0, 0, 0, 0}};
+        if (t > 0)
+            parts[t - 1].end = start;
+    }
+    run_threads(count_part, parts, sizeof(part_t), nthreads);
+
+    for (long t = 0; t < nthreads; t++) {
+        parts[t].first = out->n;
+        out->n += parts[t].n;
+    }
+    out->cap = out->n;
+    out->hashes = xmalloc(sizeof(uint64_t) * (out->cap + 1));
+    out->runs = xmalloc(sizeof(uint64_t) * (out->cap + 1));
+    out->offs = xmalloc(sizeof(uint64_t) * (out->cap + 1));
+    out->flags = xmalloc(out->cap + 1);
+    run_threads(index_part, parts, sizeof(part_t), nthreads);
+    memset(seals, 0, sizeof(*seals));
+    for (long t = 0; t < nthreads; t++)
+        add_seals(seals, &parts[t].seals);
+
+    /* Tombstones only remove older lines, so they are applied in order */
+    grow_table(out);
+    for (size_t line = 0; line < out->n; line++) {
+        if (!(out->flags[line] & DB_TOMBSTONE))
+            continue;
+        const char *text = data + out->offs[line],
+                   *nl = memchr(text, '\n', size - out->offs[line]);
+        kill_runs(out, text + 1, nl - text, line);
+    }
+
+    if (mapped > 0 && munmap(data, mapped) == -1)
+        die();
+    if (mapped > size)
+        printf("%s: %" PRIu64 " bytes of an incomplete line at the end\n",
+               s->path, mapped - size);
+    return mapped == size;
+}
+
+/* Compare the index of the shard with one built from scratch */
+static bool same_index(shard_t *s, const shard_t *built)
+{
+    char path[1100];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s.idx", s->path);
+    if (!load_index(s)) {
+        if (stat(path, &st) == 0) {
+            printf("%s: unreadable index\n", s->path);
+            return false;
+        }
+        printf("%s: no index\n", s->path);
+        return true;
+    }
+
+    /* Lines appended since the index was saved are indexed as usual */
+    if (s->indexed > built->indexed) {
+        printf("%s: index covers %" PRIu64 " bytes of %" PRIu64 "\n",
+               s->path, s->indexed, built->indexed);
+        return false;
+    }
+    refresh_index(s);
+
+    size_t line = 0;
+    while (line < s->n && line < built->n
+           && s->hashes[line] == built->hashes[line]
+           && s->runs[line] == built->runs[line]
+           && s->offs[line] == built->offs[line]
+           && s->flags[line] == built->flags[line])
+        line++;
+    if (line < s->n || line < built->n) {
+        printf("%s: index differs from line %zu of %zu\n", s->path, line + 1,
+               built->n);
+        return false;
+    }
+    printf("%s: index of %zu lines matches\n", s->path, built->n);
+    return true;
+}
+
+/* Replace the index of the shard with one built from scratch, and save it */
+static void take_index(shard_t *s, shard_t *built)
+{
+    free_index(s);
+    s->hashes = built->hashes, s->runs = built->runs;
+    s->offs = built->offs, s->flags = built->flags;
+    s->table = built->table, s->rtable = built->rtable;
+    s->n = built->n, s->cap = built->cap, s->mask = built->mask;
+    s->indexed = built->indexed;
+    save_index(s);
+    s->dirty = false;
+
+    built->hashes = built->runs = built->offs = NULL;
+    built->flags = NULL;
+    built->table = built->rtable = NULL;
+}
+
+/* The blocks of a cold segment checked by one thread */
+typedef struct {
+    const shard_t *s;
+    const segment_t *seg;
+    uint8_t *filters;
+    uint32_t first, step;
+    seals_t seals;
+} check_t;
+
+/* Compute the filter of every block anew from its lines and check them */
+static void *filter_blocks(void *arg)
+{
+    check_t *check = arg;
+    const segment_t *seg = check->seg;
+    uint8_t *block = NULL, *zblock = NULL;
+    size_t block_size = 0, zblock_size = 0;
+    for (uint32_t b = check->first; b < seg->nblocks; b += check->step) {
+        const seg_block_t *blk = &seg->blocks[b];
+        zblock = reserve(zblock, &zblock_size, blk->size);
+        block = reserve(block, &block_size, blk->raw);
+        if (pread(seg->fd, zblock, blk->size, blk->off) != (ssize_t) blk->size
+            || !lz_decompress(zblock, blk->size, block, blk->raw))
+            corrupt(check->s->path);
+
+        uint8_t *filter = check->filters + (size_t) b * seg->filter_bytes;
+        for (size_t i = 0; i < blk->raw;) {
+            const char *text = (const char *) block + i,
+                       *nl = memchr(text, '\n', blk->raw - i);
+            const size_t n = nl != NULL ? (size_t) (nl - text) + 1
+                                        : blk->raw - i;
+            const record_t rec = parse_line(text, n);
+            filter_add(filter, seg->filter_bytes,
+                       video_hash(rec.video, rec.video_len));
+            if (seg->version > 1)
+                filter_add(filter, seg->filter_bytes,
+                           hash(rec.run, rec.run_len));
+            check_seal(&check->seals, text, n, b);
+            i += n;
+        }
+    }
+    free(block);
+    free(zblock);
+    return NULL;
+}
+
+/*
+ * Check the filters and the CRCs of the lines of a cold segment, and replace
+ * the filters if they differ. Whether all was well is returned.
+ */
+static bool check_segment(shard_t *s, const size_t i, const bool fix)
+{
+    segment_t *seg = &s->segs[i];
+    const size_t bytes = (size_t) seg->nblocks * seg->filter_bytes;
+    uint8_t *filters = xcalloc(bytes + 1, 1);
+    const long nthreads = reindex_threads(seg->nblocks, 1);
+    check_t checks[DB_MAX_THREADS];
+    for (long t = 0; t < nthreads; t++)
+        checks[t] = (check_t){s, seg, filters, t, nthreads, {0, 0, 0, 0}};
+    run_threads(filter_blocks, checks, sizeof(check_t), nthreads);
+    seals_t seals = {0, 0, 0, 0};
+    for (long t = 0; t < nthreads; t++)
+        add_seals(&seals, &checks[t].seals);
+
+    uint32_t differ = 0;
+    for (uint32_t b = 0; b < seg->nblocks; b++)
+        differ += memcmp(filters + (size_t) b * seg->filter_bytes,
+                         seg->filters + (size_t) b * seg->filter_bytes,
+                         seg->filter_bytes)
+                  != 0;
+    char name[1100];
+    snprintf(name, sizeof(name), "%s.seg.%zu", s->path, i);
+    printf("%s: %" PRIu32 " of %" PRIu32 " filters differ\n", name, differ,
+           seg->nblocks);
+    const bool sealed = report_seals(name, &seals, "block");
+
+    if (differ > 0 && fix) {
+        const off_t off = sizeof(seg_header_t)
+                          + sizeof(seg_block_t) * seg->nblocks;
+        const int fd = open(name, O_WRONLY);
+        if (fd == -1 || pwrite(fd, filters, bytes, off) != (ssize_t) bytes
+            || fsync(fd) == -1 || close(fd) == -1)
+            die();
+        memcpy(seg->filters, filters, bytes);
+    }
+    free(filters);
+    return differ == 0 && sealed;
+}
+
+size_t db_reindex(db_t *db, const bool fix)
+{
+    if (!db->scanned)
+        scan_shards(db);
+
+    size_t differ = 0;
+    for (size_t i = 0; i < db->nshards; i++) {
+        /* Rebuilding cuts a line left incomplete by a crash */
+        shard_t *s = &db->shards[i], built;
+        if (fix)
+            db_recover(s->fp, s->path);
+
+        seals_t seals;
+        differ += !build_index(s, &built, &seals);
+        differ += !report_seals(s->path, &seals, "byte");
+        if (!s->loaded) {
+            s->loaded = true;
+            load_segments(s);
+        }
+
+        /* A shard without an index takes over the one built too */
+        const bool same = same_index(s, &built);
+        differ += !same;
+        if (fix && (!same || s->n != built.n))
+            take_index(s, &built);
+        free_index(&built);
+
+        /* Only verifying leaves the index file as it was */
+        if (!fix)
+            s->dirty = false;
+
+        for (size_t j = 0; j < s->nsegs; j++)
+            differ += !check_segment(s, j, fix);
+    }
+    return differ;
+}
+
+void db_close(db_t *db)
+{
+    for (size_t i = 0; i < db->nshards; i++) {
+        shard_t *s = &db->shards[i];
+        if (s->dirty && !published(s))
+            save_index(s);
+
+        for (size_t j = 0; j < s->nsegs; j++) {
+            const segment_t *seg = &s->segs[j];
+            close(seg->fd);
+            if (munmap((uint8_t *) seg->blocks - sizeof(seg_header_t),
+                       seg_span(seg)) == -1)
+                die();
+        }
+
+        fclose(s->fp);
+        free_index(s);
+        free(s->segs);
+        free(s->block);
+        free(s->zblock);
+        free(s->match);
+        free(s->tombs);
+        free(s->hits);
+    }
+
+    free(db->shards);
+    memset(db, 0, sizeof(*db));
+}
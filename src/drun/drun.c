@@ -4,135 +4,164 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <curl/curl.h>
 
+#include "arena.h"
+#include "batch.h"
+#include "blocklist.h"
+#include "canon.h"
+#include "cluster.h"
+#include "db.h"
 #include "drun.h"
-#include "jsmn.h"
+#include "links.h"
+#include "meta.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "store.h"
+#include "watch.h"
 
-char *find_duplicate(FILE *fp, const char *video_uri)
-{
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-
-    while ((read = getline(&line, &len, fp))) {
-        if (read == -1) {
-            if (feof(fp))
-                break;
-
-            perror("drun");
-            free(line);
-            exit(EXIT_FAILURE);
-        }
+fetch_opts_t fetch_opts = {CONNECT_TIMEOUT, TOTAL_TIMEOUT, RETRIES, false};
 
-        /* Match found */
-        if (strncmp(line, video_uri, strlen(video_uri)) == 0)
-            return line;
-    }
+/*
+ * Resources that are reused by every run and released at exit. There are two
+ * curl handles so a request can be hedged with a second one, and every thread
+ * that downloads has its own.
+ */
+static __thread CURLM *multi;
+static __thread CURL *curl[2];
+static store_t runs_db;
+static blocklist_t blocklist;
+static meta_db_t meta_db;
+static bool meta_db_open;
+
+/* Look for duplicates in every shard instead of only the one of the run */
+static bool cross_shard;
+
+/* Line buffer of getline(), it only grows so it is reused by every run */
+static char *line;
+static size_t line_size;
+
+/* Add the canonical form of a video URI to the run, if it is a new one */
+static void add_video(run_t *run, const char *uri, size_t len,
+                      const bool known)
+{
+#define URIBUF 128
+    if (run->nvids == RUN_MAX_VIDEOS)
+        return;
+    if (len > URIBUF)
+        len = URIBUF;
+
+    /* Links in free text are only videos if their platform is known */
+    char *vid = arena_alloc(run->arena, CANON_SIZE(len));
+    if ((known ? canon_video(uri, len, vid) : canon_uri(uri, len, vid)) == 0)
+        return;
+    for (size_t i = 0; i < run->nvids; i++)
+        if (strcmp(run->vids[i], vid) == 0)
+            return;
+    run->vids[run->nvids++] = vid;
+}
 
-    /* No match found */
-    free(line);
-    return NULL;
+/* Add the videos linked to in the string token `tok` */
+static void add_links(run_t *run, const int tok)
+{
+    if (tok == -1 || run->tokens[tok].type != JSMN_STRING)
+        return;
+
+    link_t links[RUN_MAX_VIDEOS];
+    const size_t n = links_find(run->json.ptr + run->tokens[tok].start,
+                                run->tokens[tok].end - run->tokens[tok].start,
+                                links, RUN_MAX_VIDEOS);
+    for (size_t i = 0; i < n; i++)
+        add_video(run, links[i].ptr, links[i].len, true);
 }
 
-char *parse_json(string_t *json)
+size_t parse_json(run_t *run)
 {
-    jsmn_parser parser;
-    jsmn_init(&parser);
-
-    /* Parse the JSON */
-#define TOKBUF 1024
-    jsmntok_t tokens[TOKBUF];
-    if (tokens == NULL) {
-        fputs("Allocation error\n", stderr);
-        exit(EXIT_FAILURE);
-    }
-    int ret = jsmn_parse(&parser, json->ptr, json->len, tokens, TOKBUF);
-
-    /* TODO: Make this macro free run->id */
-#define JSON_ERR(STR)                                                          \
-    fputs(STR, stderr);                                                        \
-    free(json->ptr);                                                           \
-    exit(EXIT_FAILURE);
-
-    switch (ret) {
-    case JSMN_ERROR_INVAL:
-        JSON_ERR("bad token, JSON string is corrupted\n");
-    case JSMN_ERROR_NOMEM:
-        JSON_ERR("not enough tokens, JSON string is too large\n");
-    case JSMN_ERROR_PART:
-        JSON_ERR("JSON string is too short, expecting more JSON data\n");
-    }
+    string_t *json = &run->json;
 
-    /* Find the "videos" object */
-    for (int i = 0; i < ret; i++) {
-        if (tokens[i].type == JSMN_STRING) {
-            int start = tokens[i].start, end = tokens[i].end;
-            if (strncmp(&json->ptr[start], "videos", end - start) == 0
-                || strncmp(&json->ptr[start], "text", end - start) == 0) {
-                /*
-                 * Read in the video URL which is at an offset of 6 from the
-                 * "videos" token into `video_uri`
-                 */
-#define URIBUF 128
-                char *video_uri = malloc(sizeof(char) * URIBUF + 1);
-                if (video_uri == NULL) {
-                    fputs("Allocation error\n", stderr);
-                    free(json->ptr);
-                    exit(EXIT_FAILURE);
-                }
+    /* Parse the JSON, everything of the run is freed with its arena */
+    const int ret =
+        json_tokenize(json->ptr, json->len, &run->tokens, run->arena);
+    json_check(ret);
 
-/*
- * Set the token offset to 6, since the video URI comes 6 tokens after the
- * "videos" key. The json looks like this:
- *
- * "videos": {
- *     "links": [
- *         {
- *             "uri": "https://youtu.be/2vjYnibdCBg"
- *         }
- *     ]
- * },
- *
- * TODO: Make this dynamic maybe
- */
-#define TOK_OFFSET 6
-                start = tokens[i + TOK_OFFSET].start,
-                end = tokens[i + TOK_OFFSET].end;
-                strncpy(video_uri, &json->ptr[start], end - start);
-                video_uri[end - start] = '\0';
-                return video_uri;
-            }
+    run->ntokens = ret;
+    run->nvids = 0;
+    const jsmntok_t *tokens = run->tokens;
+
+    /*
+     * The videos of a run look like this, runners often paste more links, or
+     * the right one, into the text or the comment of the run:
+     *
+     * "videos": {
+     *     "text": "...",
+     *     "links": [
+     *         {
+     *             "uri": "https://youtu.be/2vjYnibdCBg"
+     *         }
+     *     ]
+     * },
+     * "comment": "..."
+     *
+     * Single runs are wrapped in "data", runs from a listing are not.
+     */
+    int data = json_get(json->ptr, tokens, 0, "data");
+    if (data == -1)
+        data = 0;
+    const int videos = json_get(json->ptr, tokens, data, "videos"),
+              links = json_get(json->ptr, tokens, videos, "links");
+
+    if (links != -1 && tokens[links].type == JSMN_ARRAY) {
+        for (int i = links + 1, n = 0; n < tokens[links].size;
+             n++, i = json_skip(tokens, i)) {
+            const int uri = json_get(json->ptr, tokens, i, "uri");
+            if (uri != -1 && tokens[uri].type == JSMN_STRING)
+                add_video(run, json->ptr + tokens[uri].start,
+                          tokens[uri].end - tokens[uri].start, false);
         }
     }
+    add_links(run, json_get(json->ptr, tokens, videos, "text"));
+    add_links(run, json_get(json->ptr, tokens, data, "comment"));
 
-    /* No video found */
-    return NULL;
+    return run->nvids;
 }
 
-void init_string(string_t *json)
+void init_string(string_t *json, arena_t *arena)
 {
     json->len = 0;
-    json->ptr = malloc(json->len + 1);
-    if (json->ptr == NULL) {
-        fputs("Allocation error\n", stderr);
-        exit(EXIT_FAILURE);
-    }
+    json->ptr = arena_alloc(arena, json->len + 1);
     json->ptr[0] = '\0';
     return;
 }
 
 size_t write_callback(const void *ptr, const size_t size, const size_t nmemb,
-                      string_t *json)
+                      sink_t *sink)
 {
+    string_t *json = sink->json;
+
+    /* Size the buffer for the whole response once the length is known */
+    if (sink->cap == 0) {
+        curl_off_t length = -1;
+        curl_easy_getinfo(sink->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                          &length);
+        sink->cap = json->len + 1;
+        if (length > 0) {
+            json->ptr = arena_grow(sink->arena, json->ptr, sink->cap,
+                                   json->len + length + 1);
+            sink->cap = json->len + length + 1;
+        }
+    }
+
     /* Update the length of the JSON, and allocate more memory if needed */
     const size_t new_len = json->len + size * nmemb;
-    json->ptr = realloc(json->ptr, new_len + 1);
-    if (json->ptr == NULL) {
-        fputs("Reallocation error\n", stderr);
-        exit(EXIT_FAILURE);
+    if (new_len + 1 > sink->cap) {
+        size_t cap = sink->cap * 2;
+        if (cap < new_len + 1)
+            cap = new_len + 1;
+        json->ptr = arena_grow(sink->arena, json->ptr, sink->cap, cap);
+        sink->cap = cap;
     }
 
     /* Copy the incoming bytes to `json` */
@@ -143,81 +172,569 @@ size_t write_callback(const void *ptr, const size_t size, const size_t nmemb,
     return size * nmemb;
 }
 
-char *dl_json(const char *runid, string_t *json)
+/* Whether a request failed in a way that can succeed when it is retried */
+static bool transient(const CURLcode res, const long status)
 {
-#define BUFSIZE 64
-    static char uri[BUFSIZE];
-    snprintf(uri, BUFSIZE, "https://www.speedrun.com/api/v1/runs/%s", runid);
+    switch (res) {
+    case CURLE_OK:
+        return status == 429 || status == 500 || status == 502 || status == 503
+               || status == 504;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_SSL_CONNECT_ERROR:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    CURL *curl = curl_easy_init();
-    if (curl == NULL)
-        exit(EXIT_FAILURE);
+static bool start_transfer(CURL *easy, const char *uri, sink_t *sink)
+{
+    curl_easy_setopt(easy, CURLOPT_URL, uri);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION,
+                     (curl_write_callback) write_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, sink);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, fetch_opts.connect_ms);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, fetch_opts.total_ms);
+    return curl_multi_add_handle(multi, easy) == CURLM_OK;
+}
+
+/*
+ * Make one attempt at downloading `uri` to `json`. When hedging, a second
+ * request is sent once the first one takes longer than 95% of the requests so
+ * far, and whichever response arrives first wins.
+ */
+static CURLcode attempt(const char *uri, string_t *json, arena_t *arena,
+                        long *status)
+{
+    const uint64_t start = metrics_now();
+    const size_t len = json->len;
+    json->ptr[len] = '\0';
+
+    uint64_t hedge_after = UINT64_MAX;
+    const hist_t *fetch = &metrics.hists[HIST_FETCH];
+    if (fetch_opts.hedge
+        && __atomic_load_n(&fetch->count, __ATOMIC_RELAXED)
+               >= HEDGE_MIN_SAMPLES)
+        hedge_after = hist_percentile(fetch, 95);
+
+    string_t hedge = {NULL, len};
+    sink_t sinks[2] = {{json, 0, arena, curl[0]}, {&hedge, 0, arena, curl[1]}};
+    bool started[2] = {true, false};
+    if (!start_transfer(curl[0], uri, &sinks[0]))
+        return CURLE_FAILED_INIT;
+
+    CURLcode res = CURLE_OK;
+    int active = 1, winner = -1;
+    while (winner == -1) {
+        int running;
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            res = CURLE_FAILED_INIT, winner = 0;
+            break;
+        }
+
+        /* A failed transfer only loses if there is no other one left */
+        CURLMsg *msg;
+        int left;
+        while (winner == -1 && (msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            res = msg->data.result;
+            if (res == CURLE_OK || --active == 0)
+                winner = msg->easy_handle == curl[1];
+        }
+        if (winner != -1)
+            break;
+
+        const uint64_t elapsed = metrics_now() - start;
+        if (!started[1] && elapsed >= hedge_after) {
+            hedge.ptr = arena_strndup(arena, json->ptr, len);
+            started[1] = true;
+            if (start_transfer(curl[1], uri, &sinks[1])) {
+                active++;
+                metrics_count(CNT_HEDGED, 1);
+            }
+        }
+
+        int timeout = 1000;
+        if (!started[1] && hedge_after - elapsed < 1000000)
+            timeout = (hedge_after - elapsed) / 1000 + 1;
+        curl_multi_poll(multi, NULL, 0, timeout, NULL);
+    }
 
-    /* Load the contents of the API request to `json` */
-    curl_easy_setopt(curl, CURLOPT_URL, uri);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, json);
+    for (int i = 0; i < 2; i++)
+        if (started[i])
+            curl_multi_remove_handle(multi, curl[i]);
 
+    if (winner == 1)
+        *json = hedge;
+    curl_easy_getinfo(curl[winner], CURLINFO_RESPONSE_CODE, status);
+    return res;
+}
+
+bool dl_uri(const char *uri, string_t *json, arena_t *arena)
+{
+    const uint64_t start = metrics_now();
+    const size_t len = json->len;
+
+    /* The handles are reused so connections to the API are kept alive */
+    if (multi == NULL
+        && ((multi = curl_multi_init()) == NULL
+            || (curl[0] = curl_easy_init()) == NULL
+            || (curl[1] = curl_easy_init()) == NULL)) {
+        fputs("drun: curl could not be set up\n", stderr);
+        return false;
+    }
+
+    /* Load the contents of the API request to `json`, retrying if needed */
     CURLcode res;
-    if ((res = curl_easy_perform(curl)) != 0) {
+    long status = 0;
+    for (unsigned int i = 0;; i++) {
+        json->len = len;
+        res = attempt(uri, json, arena, &status);
+        metrics_count(CNT_REQUESTS, 1);
+        if (!transient(res, status) || i == fetch_opts.retries)
+            break;
+
+        /* Back off exponentially, with jitter so retries don't synchronize */
+        metrics_count(CNT_RETRIES, 1);
+        const long backoff = RETRY_BACKOFF << (i < 6 ? i : 6),
+                   delay = backoff / 2 + rand() % (backoff / 2 + 1);
+        const struct timespec ts = {delay / 1000, delay % 1000 * 1000000};
+        nanosleep(&ts, NULL);
+    }
+
+    if (res != CURLE_OK) {
         fprintf(stderr,
                 "Curl error: %d\nReport this error to whoever you got this "
                 "program from\n",
                 res);
-        curl_easy_cleanup(curl);
-        exit(EXIT_FAILURE);
+        return false;
     }
-    curl_easy_cleanup(curl);
 
-    return uri;
+    metrics_count(CNT_BYTES, json->len - len);
+    metrics_time(HIST_FETCH, start);
+    return true;
+}
+
+const char *api_uri(void)
+{
+    /* The API can be overridden, e.g. to replay recorded responses */
+    const char *api = getenv("DRUN_API");
+    return api != NULL ? api : API_URI;
+}
+
+char *dl_json(const char *runid, string_t *json, arena_t *arena)
+{
+#define BUFSIZE 1024
+    char *uri = arena_alloc(arena, BUFSIZE);
+    snprintf(uri, BUFSIZE, "%s/runs/%s", api_uri(), runid);
+
+    return dl_uri(uri, json, arena) ? uri : NULL;
 }
 
-void get_id(run_t *run)
+bool get_id(run_t *run)
 {
-    run->id = NULL;
-    size_t size = 0;
     ssize_t read;
-    if ((read = getline(&run->id, &size, stdin)) == -1) {
+    if ((read = getline(&line, &line_size, stdin)) == -1) {
         if (feof(stdin))
-            exit(EXIT_SUCCESS);
+            return false;
 
+        perror("drun");
         exit(EXIT_FAILURE);
     }
-    run->id[read - 1] = '\0';
+    if (read > 0 && line[read - 1] == '\n')
+        line[--read] = '\0';
 
     /*
      * Support for URIs with the following formats:
      *  - https://www.speedrun.com/game/run/ID
      *  - www.speedrun.com/game/run/ID
      *
-     * the game/ part of the URI is optional
+     * the game/ part of the URI is optional, and so are a trailing slash, a
+     * query and a fragment
      */
-    if (strncmp(run->id, "http", 4) == 0 || strncmp(run->id, "www", 3) == 0) {
-        char copy[strlen(run->id) + 1], *token, *prevtoken = run->id;
-        strcpy(copy, run->id);
+    const char *start = line, *end = line + read;
+    if (strncmp(line, "http", 4) == 0 || strncmp(line, "www", 3) == 0) {
+        end = line + strcspn(line, "?#");
+        while (end > line && end[-1] == '/')
+            end--;
+        start = end;
+        while (start > line && start[-1] != '/')
+            start--;
+    }
+    run->id = arena_strndup(run->arena, start, end - start);
+
+    return true;
+}
+
+const char *data_dir(void)
+{
+    /* Differs per system, and there is no easy way to get get the limit */
+#ifdef PATH_MAX
+#    undef PATH_MAX
+#endif
+#define PATH_MAX 1028
+    static char xdg_data_home[PATH_MAX - 5];
+    if (xdg_data_home[0] != '\0')
+        return xdg_data_home;
 
-        /* Get the last token */
-        token = strtok(copy, "/");
-        while ((token = strtok(NULL, "/")))
-            prevtoken = token;
+    const char *HOME = getenv("HOME");
+    snprintf(xdg_data_home, PATH_MAX - 5, "%s/.local/share/drun", HOME);
 
-        run->id = strcpy(run->id, prevtoken);
+    /* Create ~/.local/share/drun if it doesn't exist */
+    struct stat st = {0};
+    if (stat(xdg_data_home, &st) == -1) {
+        if (mkdir(xdg_data_home, 0777) == -1) {
+            perror("drun");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    return;
+    return xdg_data_home;
+}
+
+/* Open the metadata in ~/.local/share/drun/meta if it is not yet */
+static void open_meta(void)
+{
+    if (!meta_db_open) {
+        char meta_dir[PATH_MAX];
+        snprintf(meta_dir, PATH_MAX, "%s/meta", data_dir());
+        meta_open(&meta_db, meta_dir);
+        meta_db_open = true;
+    }
+}
+
+/* Store the metadata of the run in ~/.local/share/drun/meta */
+static void store_meta(const meta_t *meta, const bool duplicate)
+{
+    const uint64_t start = metrics_now();
+
+    open_meta();
+    meta_append(&meta_db, meta, duplicate ? META_DUPLICATE : 0);
+
+    metrics_time(HIST_STORE, start);
+}
+
+void dl_cleanup(void)
+{
+    for (int i = 0; i < 2; i++)
+        if (curl[i] != NULL)
+            curl_easy_cleanup(curl[i]);
+    if (multi != NULL)
+        curl_multi_cleanup(multi);
+    curl[0] = curl[1] = NULL, multi = NULL;
 }
 
-int main(int argc, char **argv)
+void cleanup(void)
 {
+    dl_cleanup();
+    store_close(&runs_db);
+    blocklist_close(&blocklist);
+    if (meta_db_open)
+        meta_close(&meta_db);
+    free(line);
+
+    meta_db_open = false;
+    line = NULL;
+    line_size = 0;
+}
+
+void parse_run(run_t *run, parsed_t *parsed)
+{
+    metrics_count(CNT_RUNS, 1);
+
+    const uint64_t start = metrics_now();
+    parse_json(run);
+
+    /* The blocklist is only read, so it is checked here rather than later */
+    parsed->nblocked = 0;
+    for (size_t i = 0; i < run->nvids; i++)
+        if (blocklist_has(&blocklist, run->vids[i]))
+            parsed->blocked[parsed->nblocked++] = run->vids[i];
+
+    /* The game and category select the shard of the run */
+    parsed->has_meta = meta_parse(run, &parsed->meta);
+    parsed->game = parsed->category = NULL;
+    if (parsed->has_meta) {
+        const meta_t *meta = &parsed->meta;
+        parsed->game = arena_strndup(run->arena, meta->game.ptr,
+                                     meta->game.len);
+        parsed->category = arena_strndup(run->arena, meta->category.ptr,
+                                         meta->category.len);
+    }
+    metrics_time(HIST_PARSE, start);
+}
+
+void settle_run(run_t *run, const parsed_t *parsed, char *const *found)
+{
+    if (run->nvids == 0) {
+        fputs("No video found\n", stderr);
+        metrics_count(CNT_NO_VIDEO, 1);
+        if (parsed->has_meta)
+            store_meta(&parsed->meta, false);
+        return;
+    }
+
+    /* Videos known to be stolen are reported whether they are stored or not */
+    if (parsed->nblocked > 0)
+        metrics_count(CNT_BLOCKED, 1);
+    for (size_t i = 0; i < parsed->nblocked; i++)
+        printf("Known stolen video found!\n%s\n", parsed->blocked[i]);
+
+    /* The run is a duplicate if any of its videos is in the database */
+    char *dups[RUN_MAX_VIDEOS];
+    size_t ndups = 0;
+    for (size_t i = 0; i < run->nvids; i++) {
+        /* Two videos can be of the same run */
+        char *dup = found[i];
+        for (size_t j = 0; dup != NULL && j < ndups; j++)
+            if (strcmp(dups[j], dup) == 0)
+                dup = NULL;
+        if (dup != NULL)
+            dups[ndups++] = dup;
+    }
+
+    if (ndups == 0 && parsed->nblocked == 0) {
+        metrics_count(CNT_NEW, 1);
+        puts("No duplicate found");
+        for (size_t i = 0; i < run->nvids; i++)
+            store_add(&runs_db, parsed->game, parsed->category, run->vids[i],
+                      run->id);
+    } else if (ndups > 0) {
+        /* Skip the video URI, which may not be canonical, to get the run */
+        metrics_count(CNT_DUPLICATES, 1);
+        for (size_t i = 0; i < ndups; i++)
+            printf("Duplicate video found!\n%s",
+                   dups[i] + strcspn(dups[i], " ") + 1);
+    }
+
+    if (parsed->has_meta)
+        store_meta(&parsed->meta, ndups > 0 || parsed->nblocked > 0);
+}
+
+void store_run(run_t *run, const parsed_t *parsed)
+{
+    char *found[RUN_MAX_VIDEOS];
+    for (size_t i = 0; i < run->nvids; i++) {
+        const uint64_t start = metrics_now();
+        found[i] = store_find(&runs_db, parsed->game, parsed->category,
+                              run->vids[i], cross_shard, run->arena);
+        metrics_time(HIST_LOOKUP, start);
+    }
+    settle_run(run, parsed, found);
+}
+
+void warm_run(void)
+{
+    store_warm(&runs_db, cross_shard);
+    open_meta();
+}
+
+void check_run(run_t *run)
+{
+    parsed_t parsed;
+    parse_run(run, &parsed);
+    store_run(run, &parsed);
+}
+
+/*
+ * Remove the runs read from STDIN, given by run ID, by their URI on sr.c or by
+ * the URI of their video
+ */
+static void remove_runs(void)
+{
+    size_t removed = 0;
+    ssize_t read;
+    while ((read = getline(&line, &line_size, stdin)) != -1) {
+        if (read > 0 && line[read - 1] == '\n')
+            line[--read] = '\0';
+        if (read == 0)
+            continue;
+
+        if (strstr(line, "speedrun.com/") != NULL) {
+            /* Trailing slashes are not part of the ID */
+            while (read > 0 && line[read - 1] == '/')
+                line[--read] = '\0';
+            const char *id = strrchr(line, '/');
+            removed +=
+                store_remove(&runs_db, id != NULL ? id + 1 : line, true);
+        } else if (strchr(line, '/') == NULL) {
+            removed += store_remove(&runs_db, line, true);
+        } else {
+            char uri[CANON_SIZE(read)];
+            canon_uri(line, read, uri);
+            removed += store_remove(&runs_db, uri, false);
+        }
+    }
+    if (ferror(stdin)) {
+        perror("drun");
+        exit(EXIT_FAILURE);
+    }
+
+    if (removed > 0)
+        printf("Removed %zu run%s\n", removed, removed == 1 ? "" : "s");
+    else
+        puts("No run found");
+}
+
+static void print_run(const char *run, const size_t len, void *arg)
+{
+    (void) arg;
+    fwrite(run, 1, len, stdout);
+}
+
+/*
+ * Add the runs read from STDIN, given as lines like those of -L, e.g. to move
+ * them from one backend to another. Tombstones are skipped.
+ */
+static void import_runs(void)
+{
+    size_t added = 0;
+    ssize_t read;
+    while ((read = getline(&line, &line_size, stdin)) != -1) {
+        if (read > 0 && line[read - 1] == '\n')
+            line[--read] = '\0';
+        const char *run = strchr(line, ' ');
+        if (line[0] == '-' || run == NULL)
+            continue;
+
+        /* The run ID is the last component of the run URI */
+        const char *id = strrchr(run, '/');
+        char uri[CANON_SIZE(run - line)];
+        canon_uri(line, run - line, uri);
+        store_add(&runs_db, NULL, NULL, uri, id != NULL ? id + 1 : run + 1);
+        added++;
+    }
+    if (ferror(stdin)) {
+        perror("drun");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Added %zu run%s\n", added, added == 1 ? "" : "s");
+}
+
+int drun_main(int argc, char **argv)
+{
+    const char *query = NULL, *game = NULL;
+    unsigned int interval = 60;
+    meta_filter_t filter = {NULL, NULL, NULL};
+    int shard_by = SHARD_NONE;
+    const char *backend = STORE_DEFAULT, *block = NULL;
+    bool compact = false, remove = false, list = false, import = false,
+         batched = false, reindex = false, verify = false;
+    size_t keep = 0;
+    unsigned int jobs = 1;
+
     int opt;
-    while ((opt = getopt(argc, argv, ":hv")) != -1) {
+    while ((opt = getopt(argc, argv,
+                         ":hvq:g:c:p:w:i:M:sS:bxZ:RVDB:LIK:C:T:r:Hj:"))
+           != -1) {
         switch (opt) {
+        case 'q':
+            query = optarg;
+            break;
+        case 'g':
+            filter.game = optarg;
+            break;
+        case 'c':
+            filter.category = optarg;
+            break;
+        case 'p':
+            filter.player = optarg;
+            break;
+        case 'w':
+            game = optarg;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 10);
+            break;
+        case 'M':
+            metrics.textfile = optarg;
+            break;
+        case 's':
+            metrics.stats = true;
+            break;
+        case 'S':
+            if (strcmp(optarg, "game") == 0) {
+                shard_by = SHARD_GAME;
+            } else if (strcmp(optarg, "category") == 0) {
+                shard_by = SHARD_CATEGORY;
+            } else {
+                fprintf(stderr,
+                        "drun: invalid shard key '%s' \nTry 'drun -h' for "
+                        "more information.\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            batched = true;
+            break;
+        case 'x':
+            cross_shard = true;
+            break;
+        case 'Z':
+            compact = true;
+            keep = strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            reindex = true;
+            break;
+        case 'V':
+            reindex = verify = true;
+            break;
+        case 'D':
+            remove = true;
+            break;
+        case 'B':
+            backend = optarg;
+            break;
+        case 'L':
+            list = true;
+            break;
+        case 'I':
+            import = true;
+            break;
+        case 'K':
+            block = optarg;
+            break;
+        case 'C':
+            fetch_opts.connect_ms = strtol(optarg, NULL, 10);
+            break;
+        case 'T':
+            fetch_opts.total_ms = strtol(optarg, NULL, 10);
+            break;
+        case 'r':
+            fetch_opts.retries = strtoul(optarg, NULL, 10);
+            break;
+        case 'H':
+            fetch_opts.hedge = true;
+            break;
+        case 'j':
+            jobs = strtoul(optarg, NULL, 10);
+            if (jobs < 1)
+                jobs = 1;
+            if (jobs > PIPELINE_MAX_JOBS)
+                jobs = PIPELINE_MAX_JOBS;
+            break;
         case 'h':
             puts(HELP_MSG);
             return EXIT_SUCCESS;
         case 'v':
             puts(VERSION_MSG);
             return EXIT_SUCCESS;
+        case ':':
+            fprintf(stderr,
+                    "drun: option requires an argument -- '%c' \nTry 'drun -h' "
+                    "for more information.\n",
+                    optopt);
+            return EXIT_FAILURE;
         default:
             fprintf(stderr,
                     "drun: invalid option -- '%c' \nTry 'drun -h' for more "
@@ -227,67 +744,88 @@ int main(int argc, char **argv)
         }
     }
 
-    run_t run;
-    get_id(&run);
-    init_string(&run.json);
-    dl_json(run.id, &run.json);
+    if (query != NULL && strcmp(query, "clusters") != 0) {
+        char meta_dir[PATH_MAX];
+        snprintf(meta_dir, PATH_MAX, "%s/meta", data_dir());
 
-    run.vid = parse_json(&run.json);
-    if (run.vid == NULL) {
-        fputs("No video found\n", stderr);
-        goto EXIT;
+        meta_db_t db;
+        meta_open(&db, meta_dir);
+        const int ret = meta_query(&db, query, &filter);
+        meta_close(&db);
+        return ret;
     }
 
-    /* Differs per system, and there is no easy way to get get the limit */
-#ifdef PATH_MAX
-#    undef PATH_MAX
-#endif
-#define PATH_MAX 1028
-    const char *HOME = getenv("HOME");
-    char xdg_data_home[PATH_MAX - 5], runs_file[PATH_MAX];
-    snprintf(xdg_data_home, PATH_MAX - 5, "%s/.local/share/drun", HOME);
-    snprintf(runs_file, PATH_MAX, "%s/runs", xdg_data_home);
-
-    /* Create ~/.local/share/drun if it doesn't exist */
-    struct stat st = {0};
-    if (stat(xdg_data_home, &st) == -1) {
-        if (mkdir(xdg_data_home, 0777) == -1) {
+    char block_path[PATH_MAX + 8];
+    snprintf(block_path, sizeof(block_path), "%s/blocklist", data_dir());
+    if (block != NULL) {
+        FILE *in = strcmp(block, "-") == 0 ? stdin : fopen(block, "r");
+        if (in == NULL) {
             perror("drun");
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
+        blocklist_build(block_path, in);
+        if (in != stdin)
+            fclose(in);
+        return EXIT_SUCCESS;
     }
 
-    FILE *fp = fopen(runs_file, "a+");
-    if (fp == NULL) {
-        perror("drun");
-        exit(EXIT_FAILURE);
+    if (!store_open(&runs_db, backend, data_dir(), shard_by)) {
+        fprintf(stderr,
+                "drun: invalid backend '%s' \nTry 'drun -h' for more "
+                "information.\n",
+                backend);
+        return EXIT_FAILURE;
     }
+    atexit(cleanup);
 
-    /*
-     * For glibc, the initial file position for reading is at the beginning of
-     * the file, but for Android/BSD/MacOS, the initial file position for
-     * reading is at the end of the file.
-     */
-#if defined(__APPLE__) || defined(__FreeBSD__)
-    rewind(fp);
-#endif
+    /* Clusters need the database as well as the metadata */
+    if (query != NULL) {
+        open_meta();
+        return cluster_query(&runs_db, &meta_db, &filter);
+    }
 
-    char *duplicate = find_duplicate(fp, run.vid);
-    if (duplicate == NULL) {
-        puts("No duplicate found");
-        fprintf(fp, "%s https://www.speedrun.com/run/%s\n", run.vid, run.id);
-    } else {
-        /* Offset the return to get the sr.c run URI */
-        printf("Duplicate video found!\n%s", duplicate + strlen(run.vid) + 1);
+    if (compact) {
+        if (!store_compact(&runs_db, keep)) {
+            fprintf(stderr, "drun: the %s backend can't be compacted\n",
+                    backend);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (reindex) {
+        size_t differ;
+        if (!store_reindex(&runs_db, !verify, &differ)) {
+            fprintf(stderr, "drun: the %s backend has no indexes\n", backend);
+            return EXIT_FAILURE;
+        }
+        return verify && differ > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (list) {
+        store_iterate(&runs_db, print_run, NULL);
+        return EXIT_SUCCESS;
+    }
+
+    if (import) {
+        import_runs();
+        return EXIT_SUCCESS;
     }
 
-    fclose(fp);
-    if (duplicate != NULL)
-        free(duplicate);
+    if (remove) {
+        remove_runs();
+        return EXIT_SUCCESS;
+    }
+
+    /* Mapping it costs next to nothing, however large it is */
+    blocklist_open(&blocklist, block_path);
+
+    if (game != NULL)
+        return watch(game, interval) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-EXIT:
-    free(run.id);
-    free(run.vid);
-    free(run.json.ptr);
-    return EXIT_SUCCESS;
+    /* Check every run read from STDIN */
+    const bool ok = batched ? batch(&runs_db, jobs)
+                            : pipeline(jobs, warm_run, store_run);
+    metrics_flush();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
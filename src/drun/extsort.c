@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "alloc.h"
+#include "extsort.h"
+#include "util.h"
+
+/* The lines being sorted by qsort(), which has no argument for them */
+static __thread const char *sort_buf;
+
+static int cmp_offs(const void *a, const void *b)
+{
+    return strcmp(sort_buf + *(const size_t *) a,
+                  sort_buf + *(const size_t *) b);
+}
+
+static void sort_lines(extsort_t *xs)
+{
+    sort_buf = xs->buf;
+    qsort(xs->offs, xs->n, sizeof(size_t), cmp_offs);
+}
+
+/* Write the lines in memory to a new sorted run and forget them */
+static void spill(extsort_t *xs)
+{
+    FILE *fp = tmpfile();
+    if (fp == NULL)
+        die();
+
+    sort_lines(xs);
+    for (size_t i = 0; i < xs->n; i++) {
+        fputs(xs->buf + xs->offs[i], fp);
+        putc('\n', fp);
+    }
+    if (ferror(fp))
+        die();
+
+    xs->spills = xrealloc(xs->spills, sizeof(FILE *) * (xs->nspills + 1));
+    xs->spills[xs->nspills++] = fp;
+    xs->used = xs->n = 0;
+}
+
+void extsort_init(extsort_t *xs, const size_t budget)
+{
+    memset(xs, 0, sizeof(*xs));
+    xs->budget = budget;
+}
+
+void extsort_add(extsort_t *xs, const char *line, const size_t len)
+{
+    if (xs->n > 0 && xs->used + len + 1 + xs->n * sizeof(size_t) > xs->budget)
+        spill(xs);
+
+    if (xs->used + len + 1 > xs->cap) {
+        size_t cap = xs->cap ? xs->cap * 2 : 4096;
+        while (cap < xs->used + len + 1)
+            cap *= 2;
+        xs->buf = xrealloc(xs->buf, cap);
+        xs->cap = cap;
+    }
+    if (xs->n == xs->ncap) {
+        xs->ncap = xs->ncap ? xs->ncap * 2 : 256;
+        xs->offs = xrealloc(xs->offs, sizeof(size_t) * xs->ncap);
+    }
+
+    xs->offs[xs->n++] = xs->used;
+    memcpy(xs->buf + xs->used, line, len);
+    xs->buf[xs->used + len] = '\0';
+    xs->used += len + 1;
+}
+
+/* Read the next line of a run, or close it at its end */
+static bool read_run(xs_run_t *run)
+{
+    const ssize_t read = getline(&run->line, &run->size, run->fp);
+    if (read == -1) {
+        if (ferror(run->fp))
+            die();
+        fclose(run->fp);
+        free(run->line);
+        return false;
+    }
+    run->len = read;
+    if (run->len > 0 && run->line[run->len - 1] == '\n')
+        run->line[--run->len] = '\0';
+    return true;
+}
+
+static void sift_down(extsort_t *xs, size_t i)
+{
+    xs_run_t *heap = xs->heap;
+    for (;;) {
+        size_t min = i;
+        const size_t l = 2 * i + 1, r = 2 * i + 2;
+        if (l < xs->nheap && strcmp(heap[l].line, heap[min].line) < 0)
+            min = l;
+        if (r < xs->nheap && strcmp(heap[r].line, heap[min].line) < 0)
+            min = r;
+        if (min == i)
+            return;
+
+        const xs_run_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+/* Start merging the spilled runs `first` up to `last` */
+static void start_merge(extsort_t *xs, const size_t first, const size_t last)
+{
+    xs->heap = xrealloc(xs->heap, sizeof(xs_run_t) * (last - first));
+    xs->nheap = 0;
+    xs->advance = false;
+    for (size_t i = first; i < last; i++) {
+        xs_run_t *run = &xs->heap[xs->nheap];
+        *run = (xs_run_t){xs->spills[i], NULL, 0, 0};
+        rewind(run->fp);
+        if (read_run(run))
+            xs->nheap++;
+    }
+    for (size_t i = xs->nheap / 2; i-- > 0;)
+        sift_down(xs, i);
+}
+
+static const char *merge_next(extsort_t *xs, size_t *len)
+{
+    if (xs->advance && !read_run(&xs->heap[0]))
+        xs->heap[0] = xs->heap[--xs->nheap];
+    if (xs->advance && xs->nheap > 0)
+        sift_down(xs, 0);
+    xs->advance = false;
+
+    if (xs->nheap == 0)
+        return NULL;
+    xs->advance = true;
+    *len = xs->heap[0].len;
+    return xs->heap[0].line;
+}
+
+void extsort_finish(extsort_t *xs)
+{
+    if (xs->nspills == 0) {
+        sort_lines(xs);
+        xs->next = 0;
+        return;
+    }
+
+    /* Everything goes through the disk once anything has to */
+    if (xs->n > 0)
+        spill(xs);
+    free(xs->buf);
+    free(xs->offs);
+    xs->buf = NULL, xs->offs = NULL;
+    xs->cap = xs->ncap = 0;
+
+    /* Merge the oldest runs into one until few enough are left */
+    while (xs->nspills > EXTSORT_FANIN) {
+        FILE *fp = tmpfile();
+        if (fp == NULL)
+            die();
+
+        start_merge(xs, 0, EXTSORT_FANIN);
+        const char *line;
+        size_t len;
+        while ((line = merge_next(xs, &len)) != NULL) {
+            fwrite(line, 1, len, fp);
+            putc('\n', fp);
+        }
+        if (ferror(fp))
+            die();
+
+        memmove(xs->spills + 1, xs->spills + EXTSORT_FANIN,
+                sizeof(FILE *) * (xs->nspills - EXTSORT_FANIN));
+        xs->spills[0] = fp;
+        xs->nspills -= EXTSORT_FANIN - 1;
+    }
+    start_merge(xs, 0, xs->nspills);
+    xs->nspills = 0;
+}
+
+const char *extsort_next(extsort_t *xs, size_t *len)
+{
+    if (xs->buf == NULL && xs->heap != NULL)
+        return merge_next(xs, len);
+    if (xs->next == xs->n)
+        return NULL;
+
+    const char *line = xs->buf + xs->offs[xs->next++];
+    *len = strlen(line);
+    return line;
+}
+
+void extsort_free(extsort_t *xs)
+{
+    for (size_t i = 0; i < xs->nheap; i++) {
+        fclose(xs->heap[i].fp);
+        free(xs->heap[i].line);
+    }
+    for (size_t i = 0; i < xs->nspills; i++)
+        fclose(xs->spills[i]);
+    free(xs->heap);
+    free(xs->spills);
+    free(xs->buf);
+    free(xs->offs);
+    memset(xs, 0, sizeof(*xs));
+}
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "idset.h"
+
+static int cmp_id(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t low_mask(const idset_t *set)
+{
+    return set->low_bits ? ((uint64_t) 1 << set->low_bits) - 1 : 0;
+}
+
+static uint64_t get_low(const idset_t *set, const size_t i)
+{
+    const uint64_t bit = (uint64_t) i * set->low_bits;
+    const size_t word = bit / 64;
+    const unsigned int off = bit % 64;
+    uint64_t low = set->lows[word] >> off;
+    if (off + set->low_bits > 64)
+        low |= set->lows[word + 1] << (64 - off);
+    return low & low_mask(set);
+}
+
+static void set_low(idset_t *set, const size_t i, const uint64_t low)
+{
+    const uint64_t bit = (uint64_t) i * set->low_bits;
+    const size_t word = bit / 64;
+    const unsigned int off = bit % 64;
+    set->lows[word] |= low << off;
+    if (off + set->low_bits > 64)
+        set->lows[word + 1] |= low >> (64 - off);
+}
+
+/* Record where every `IDSET_SAMPLE`th zero of the unary part is */
+static void sample_zeros(idset_t *set)
+{
+    const uint64_t nzeros = (set->max >> set->low_bits) + 1;
+    set->zeros = xmalloc(sizeof(uint64_t)
+                         * ((nzeros + IDSET_SAMPLE - 1) / IDSET_SAMPLE));
+
+    uint64_t seen = 0, next = 0;
+    for (uint64_t word = 0; word * 64 < set->nhighs; word++) {
+        uint64_t z = ~set->highs[word];
+        if (set->nhighs - word * 64 < 64)
+            z &= ((uint64_t) 1 << (set->nhighs - word * 64)) - 1;
+
+        const uint64_t count = __builtin_popcountll(z);
+        while (next < seen + count) {
+            /* Skip to the zero that is sampled next */
+            uint64_t rest = z;
+            for (uint64_t skip = next - seen; skip > 0; skip--)
+                rest &= rest - 1;
+            set->zeros[next / IDSET_SAMPLE] = word * 64
+                                              + __builtin_ctzll(rest);
+            next += IDSET_SAMPLE;
+        }
+        seen += count;
+    }
+}
+
+void idset_build(idset_t *set, uint64_t *ids, const size_t n)
+{
+    memset(set, 0, sizeof(*set));
+    qsort(ids, n, sizeof(uint64_t), cmp_id);
+    size_t uniq = 0;
+    for (size_t i = 0; i < n; i++)
+        if (uniq == 0 || ids[i] != ids[uniq - 1])
+            ids[uniq++] = ids[i];
+
+    set->n = uniq;
+    set->max = uniq > 0 ? ids[uniq - 1] : 0;
+    if (uniq > 0 && set->max / uniq > 0)
+        set->low_bits = 63 - __builtin_clzll(set->max / uniq);
+
+    /* A word more than needed, so a low can always be read as two words */
+    const size_t nlows = ((uint64_t) uniq * set->low_bits + 63) / 64 + 1;
+    set->lows = xcalloc(nlows, sizeof(uint64_t));
+    set->nhighs = uniq + (set->max >> set->low_bits) + 1;
+    set->highs = xcalloc((set->nhighs + 63) / 64, sizeof(uint64_t));
+
+    for (size_t i = 0; i < uniq; i++) {
+        const uint64_t pos = (ids[i] >> set->low_bits) + i;
+        set->highs[pos / 64] |= (uint64_t) 1 << (pos % 64);
+        set_low(set, i, ids[i] & low_mask(set));
+    }
+    sample_zeros(set);
+}
+
+/* Get the position of the zero of the unary part with the index `n` */
+static uint64_t select_zero(const idset_t *set, const uint64_t n)
+{
+    const uint64_t sampled = set->zeros[n / IDSET_SAMPLE];
+    uint64_t rest = n % IDSET_SAMPLE;
+    if (rest == 0)
+        return sampled;
+
+    uint64_t word = (sampled + 1) / 64;
+    uint64_t z = ~set->highs[word] & (~(uint64_t) 0 << ((sampled + 1) % 64));
+    for (;;) {
+        const uint64_t count = __builtin_popcountll(z);
+        if (rest <= count)
+            break;
+        rest -= count;
+        z = ~set->highs[++word];
+    }
+    while (--rest > 0)
+        z &= z - 1;
+    return word * 64 + __builtin_ctzll(z);
+}
+
+bool idset_has(const idset_t *set, const uint64_t id)
+{
+    if (set->n == 0 || id > set->max)
+        return false;
+
+    /* The IDs with the same high bits follow the zero of the ones before */
+    const uint64_t high = id >> set->low_bits, low = id & low_mask(set);
+    uint64_t pos = high > 0 ? select_zero(set, high - 1) + 1 : 0;
+    for (size_t i = pos - high;
+         set->highs[pos / 64] >> (pos % 64) & 1; pos++, i++) {
+        const uint64_t other = get_low(set, i);
+        if (other >= low)
+            return other == low;
+    }
+    return false;
+}
+
+size_t idset_bytes(const idset_t *set)
+{
+    const uint64_t nzeros = (set->max >> set->low_bits) + 1;
+    return sizeof(uint64_t)
+           * (((uint64_t) set->n * set->low_bits + 63) / 64 + 1
+              + (set->nhighs + 63) / 64
+              + (nzeros + IDSET_SAMPLE - 1) / IDSET_SAMPLE);
+}
+
+void idset_free(idset_t *set)
+{
+    free(set->lows);
+    free(set->highs);
+    free(set->zeros);
+    memset(set, 0, sizeof(*set));
+}
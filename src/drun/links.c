@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "links.h"
+
+/* The hosts of the platforms in canon.c, in lowercase */
+static const char *const hosts[] = {
+    "youtube.com/", "youtu.be/",    "youtube-nocookie.com/",
+    "twitch.tv/",   "bilibili.com/", "vimeo.com/",
+};
+
+/*
+ * The automaton as a DFA over ASCII, the failure links are folded into the
+ * transitions. `found` is the length of the longest host that ends in a
+ * state, or 0.
+ */
+static uint8_t next[LINKS_STATES][128];
+static uint8_t found[LINKS_STATES];
+static pthread_once_t built = PTHREAD_ONCE_INIT;
+
+static char lower(const char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static bool host_char(const char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+           || (c >= '0' && c <= '9') || c == '-' || c == '.';
+}
+
+static bool link_char(const char c)
+{
+    return c > ' ' && c < 127 && strchr("\"'<>\\()[]{}|^`", c) == NULL;
+}
+
+static void build(void)
+{
+    /* The trie of the hosts, 0 is the root and no state goes back to it */
+    unsigned int nstates = 1;
+    for (size_t i = 0; i < sizeof(hosts) / sizeof(*hosts); i++) {
+        unsigned int state = 0;
+        for (const char *c = hosts[i]; *c != '\0'; c++) {
+            if (next[state][(unsigned char) *c] == 0)
+                next[state][(unsigned char) *c] = nstates++;
+            state = next[state][(unsigned char) *c];
+        }
+        found[state] = strlen(hosts[i]);
+    }
+
+    /*
+     * Breadth first, so the failure state of every state is done before it.
+     * A missing transition goes where the failure state would go.
+     */
+    uint8_t queue[LINKS_STATES], fail[LINKS_STATES] = {0};
+    unsigned int head = 0, tail = 0;
+    for (unsigned int c = 0; c < 128; c++)
+        if (next[0][c] != 0)
+            queue[tail++] = next[0][c];
+    while (head < tail) {
+        const unsigned int state = queue[head++];
+        if (found[fail[state]] > found[state])
+            found[state] = found[fail[state]];
+        for (unsigned int c = 0; c < 128; c++) {
+            const unsigned int to = next[state][c];
+            if (to == 0) {
+                next[state][c] = next[fail[state]][c];
+            } else {
+                fail[to] = next[fail[state]][c];
+                queue[tail++] = to;
+            }
+        }
+    }
+}
+
+/*
+ * Widen the host that was found at `start` to `end` to the whole link, or
+ * return false if it is only part of another host or has no path
+ */
+static bool widen(const char *text, const size_t len, size_t start,
+                  const size_t end, link_t *link)
+{
+    if (start > 0 && host_char(text[start - 1]) && text[start - 1] != '.')
+        return false;
+    while (start > 0 && host_char(text[start - 1]))
+        start--;
+
+    /* The scheme, e.g. https:// */
+    if (start >= 3 && memcmp(text + start - 3, "://", 3) == 0) {
+        size_t scheme = start - 3;
+        while (scheme > 0 && lower(text[scheme - 1]) >= 'a'
+               && lower(text[scheme - 1]) <= 'z')
+            scheme--;
+        if (scheme < start - 3)
+            start = scheme;
+    }
+
+    size_t stop = end;
+    while (stop < len && link_char(text[stop]))
+        stop++;
+    while (stop > end && strchr(".,;:!?", text[stop - 1]) != NULL)
+        stop--;
+    if (stop == end)
+        return false;
+
+    link->ptr = text + start;
+    link->len = stop - start;
+    return true;
+}
+
+size_t links_find(const char *text, const size_t len, link_t *links,
+                  const size_t max)
+{
+    pthread_once(&built, build);
+
+    size_t n = 0;
+    unsigned int state = 0;
+    for (size_t i = 0; i < len && n < max; i++) {
+        const unsigned char c = lower(text[i]);
+        state = c < 128 ? next[state][c] : 0;
+        if (found[state] == 0
+            || !widen(text, len, i + 1 - found[state], i + 1, &links[n]))
+            continue;
+
+        /* Go on after the link, a link in a link is not another video */
+        i = links[n].ptr + links[n].len - text - 1;
+        state = 0;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "lz.h"
+
+/* The last match starts at least 12 bytes and ends 5 bytes before the end */
+#define MF_LIMIT      12
+#define LAST_LITERALS 5
+
+static uint32_t read32(const uint8_t *ptr)
+{
+    uint32_t ret;
+    memcpy(&ret, ptr, sizeof(ret));
+    return ret;
+}
+
+static uint32_t hash_seq(const uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* Write the remainder of a length that did not fit in its token nibble */
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, const size_t nlit,
+                             const size_t dist, const size_t mlen)
+{
+    uint8_t *token = op++;
+    *token = (nlit < 15 ? nlit : 15) << 4;
+    if (nlit >= 15)
+        op = put_length(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+
+    /* The last sequence only has literals */
+    if (mlen == 0)
+        return op;
+
+    *op++ = dist & 0xff;
+    *op++ = dist >> 8;
+    const size_t m = mlen - LZ_MIN_MATCH;
+    *token |= m < 15 ? m : 15;
+    if (m >= 15)
+        op = put_length(op, m - 15);
+    return op;
+}
+
+size_t lz_bound(const size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t *src, const size_t len, uint8_t *dst)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst;
+
+    if (len > MF_LIMIT) {
+        const uint8_t *limit = end - MF_LIMIT;
+        while (ip < limit) {
+            const uint32_t seq = read32(ip), h = hash_seq(seq);
+            const uint8_t *ref = src + table[h];
+            table[h] = ip - src;
+
+            if (ref >= ip || ip - ref > LZ_MAX_DIST || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *m = ip + LZ_MIN_MATCH;
+            ref += LZ_MIN_MATCH;
+            while (m < end - LAST_LITERALS && *m == *ref)
+                m++, ref++;
+
+            op = put_sequence(op, anchor, ip - anchor, m - ref, m - ip);
+            ip = anchor = m;
+        }
+    }
+
+    op = put_sequence(op, anchor, end - anchor, 0, 0);
+    return op - dst;
+}
+
+bool lz_decompress(const uint8_t *src, const size_t len, uint8_t *dst,
+                   const size_t raw)
+{
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst, *oend = dst + raw;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        uint8_t b;
+
+        size_t nlit = token >> 4;
+        if (nlit == 15) {
+            do {
+                if (ip >= iend)
+                    return false;
+                nlit += b = *ip++;
+            } while (b == 255);
+        }
+        if (nlit > (size_t) (iend - ip) || nlit > (size_t) (oend - op))
+            return false;
+        memcpy(op, ip, nlit);
+        ip += nlit, op += nlit;
+
+        /* The last sequence ends the block after its literals */
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        const size_t dist = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (dist == 0 || dist > (size_t) (op - dst))
+            return false;
+
+        size_t mlen = token & 15;
+        if (mlen == 15) {
+            do {
+                if (ip >= iend)
+                    return false;
+                mlen += b = *ip++;
+            } while (b == 255);
+        }
+        mlen += LZ_MIN_MATCH;
+        if (mlen > (size_t) (oend - op))
+            return false;
+
+        /* Matches may overlap their own output, so copy byte by byte */
+        const uint8_t *m = op - dist;
+        while (mlen-- > 0)
+            *op++ = *m++;
+    }
+
+    return op == oend;
+}
@@ -0,0 +1,7 @@
+#include "modutils.h"
+
+/* drun on its own, see modutils.c for the multicall binary */
+int main(int argc, char **argv)
+{
+    return drun_main(argc, argv);
+}
@@ -0,0 +1,665 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "meta.h"
+#include "util.h"
+
+/* The file name and row width of every column, 0 for variable width */
+static const struct {
+    const char *name;
+    size_t width;
+} columns[NCOLS] = {
+    [COL_ID] = {"id", META_ID_LEN},
+    [COL_GAME] = {"game", sizeof(uint32_t)},
+    [COL_CATEGORY] = {"category", sizeof(uint32_t)},
+    [COL_SUBMITTED] = {"submitted", sizeof(uint32_t)},
+    [COL_FLAGS] = {"flags", sizeof(uint8_t)},
+    [COL_PLAYERS_IDX] = {"players.idx", sizeof(uint32_t)},
+    [COL_PLAYERS] = {"players", 0},
+    [COL_VIDEOS_IDX] = {"videos.idx", sizeof(uint64_t)},
+    [COL_VIDEOS] = {"videos", 0},
+};
+
+static const char *dict_names[NDICTS] = {
+    [DICT_GAME] = "game.dict",
+    [DICT_CATEGORY] = "category.dict",
+    [DICT_PLAYER] = "player.dict",
+};
+
+static uint64_t pack_id(const char *id, const size_t len)
+{
+    uint64_t ret = 0;
+    memcpy(&ret, id, len < META_ID_LEN ? len : META_ID_LEN);
+    return ret;
+}
+
+static int open_at(const char *dir, const char *name, const int flags)
+{
+    char path[2048];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return open(path, flags, 0666);
+}
+
+static void write_all(const int fd, const void *buf, size_t len, off_t off)
+{
+    const char *ptr = buf;
+    while (len > 0) {
+        const ssize_t ret = pwrite(fd, ptr, len, off);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            die();
+        }
+        ptr += ret, off += ret, len -= ret;
+    }
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static int64_t days_from_civil(int64_t y, const unsigned int m,
+                               const unsigned int d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned int yoe = (unsigned int) (y - era * 400);
+    const unsigned int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t) doe - 719468;
+}
+
+uint32_t meta_date(const char *str, const size_t len)
+{
+    unsigned int y, mo, d, h = 0, mi = 0, s = 0;
+    char buf[32];
+
+    if (len >= sizeof(buf))
+        return 0;
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+
+    if (sscanf(buf, "%4u-%2u-%2uT%2u:%2u:%2u", &y, &mo, &d, &h, &mi, &s) < 3)
+        return 0;
+
+    return (uint32_t) (days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60
+                       + s);
+}
+
+static string_t tok_str(const run_t *run, const int i)
+{
+    string_t ret = {NULL, 0};
+    if (i >= 0 && run->tokens[i].type == JSMN_STRING) {
+        ret.ptr = run->json.ptr + run->tokens[i].start;
+        ret.len = run->tokens[i].end - run->tokens[i].start;
+    }
+    return ret;
+}
+
+bool meta_parse(const run_t *run, meta_t *meta)
+{
+    const char *js = run->json.ptr;
+    const jsmntok_t *tokens = run->tokens;
+    memset(meta, 0, sizeof(*meta));
+
+    /* Single runs are wrapped in "data", runs from a listing are not */
+    int data = json_get(js, tokens, 0, "data");
+    if (data == -1)
+        data = 0;
+
+    meta->id = tok_str(run, json_get(js, tokens, data, "id"));
+    meta->game = tok_str(run, json_get(js, tokens, data, "game"));
+    meta->category = tok_str(run, json_get(js, tokens, data, "category"));
+    if (meta->id.ptr == NULL)
+        return false;
+
+    const string_t date = tok_str(run, json_get(js, tokens, data, "submitted"));
+    if (date.ptr != NULL)
+        meta->submitted = meta_date(date.ptr, date.len);
+
+    /* Registered players are stored by ID, guests by name */
+    const int players = json_get(js, tokens, data, "players");
+    if (players != -1 && tokens[players].type == JSMN_ARRAY) {
+        for (int i = players + 1, n = 0;
+             n < tokens[players].size && meta->nplayers < META_MAX_PLAYERS;
+             n++, i = json_skip(tokens, i)) {
+            string_t player = tok_str(run, json_get(js, tokens, i, "id"));
+            if (player.ptr == NULL)
+                player = tok_str(run, json_get(js, tokens, i, "name"));
+            if (player.ptr != NULL)
+                meta->players[meta->nplayers++] = player;
+        }
+    }
+
+    const int links = json_get(js, tokens, json_get(js, tokens, data, "videos"),
+                               "links");
+    if (links != -1 && tokens[links].type == JSMN_ARRAY) {
+        for (int i = links + 1, n = 0;
+             n < tokens[links].size && meta->nvideos < META_MAX_VIDEOS;
+             n++, i = json_skip(tokens, i)) {
+            const string_t uri = tok_str(run, json_get(js, tokens, i, "uri"));
+            if (uri.ptr != NULL)
+                meta->videos[meta->nvideos++] = uri;
+        }
+    }
+
+    return true;
+}
+
+static void dict_insert(dict_t *dict, const uint32_t code)
+{
+    const char *entry = dict->buf + dict->offs[code];
+    const size_t len = dict->offs[code + 1] - dict->offs[code] - 1;
+
+    size_t i = hash(entry, len) & dict->mask;
+    while (dict->table[i])
+        i = (i + 1) & dict->mask;
+    dict->table[i] = code + 1;
+}
+
+/* Resize the hash table to fit at least twice the number of entries */
+static void dict_grow(dict_t *dict)
+{
+    free(dict->table);
+    dict->mask = 1023;
+    while (dict->mask < dict->n * 2)
+        dict->mask = dict->mask * 2 + 1;
+    dict->table = xcalloc(dict->mask + 1, sizeof(uint32_t));
+    for (uint32_t i = 0; i < dict->n; i++)
+        dict_insert(dict, i);
+}
+
+/*
+ * Read the entries appended to the dictionary since it was last read, by this
+ * process or another one. Only called with the store locked.
+ */
+static void dict_load(dict_t *dict)
+{
+    struct stat st;
+    if (fstat(dict->fd, &st) == -1)
+        die();
+    const size_t end = st.st_size;
+    if (end <= dict->size)
+        return;
+
+    if (end + 1 > dict->cap) {
+        dict->cap = end + 1;
+        dict->buf = xrealloc(dict->buf, dict->cap);
+    }
+    for (size_t off = dict->size; off < end;) {
+        const ssize_t ret = pread(dict->fd, dict->buf + off, end - off, off);
+        if (ret <= 0)
+            die();
+        off += ret;
+    }
+
+    /* Drop a torn last entry, it is written again when needed */
+    size_t size = end;
+    while (size > dict->size && dict->buf[size - 1] != '\n')
+        size--;
+    if (size != end && ftruncate(dict->fd, size))
+        die();
+
+    size_t n = 0;
+    for (size_t i = dict->size; i < size; i++)
+        n += dict->buf[i] == '\n';
+
+    const uint32_t first = dict->n;
+    dict->offs = xrealloc(dict->offs, sizeof(uint32_t) * (dict->n + n + 1));
+    for (size_t i = dict->size; i < size; i++)
+        if (dict->buf[i] == '\n')
+            dict->offs[++dict->n] = i + 1;
+    dict->size = size;
+
+    if (dict->mask < dict->n * 2)
+        dict_grow(dict);
+    else
+        for (uint32_t code = first; code < dict->n; code++)
+            dict_insert(dict, code);
+}
+
+static void dict_open(dict_t *dict, const char *dir, const char *name)
+{
+    memset(dict, 0, sizeof(*dict));
+    if ((dict->fd = open_at(dir, name, O_RDWR | O_CREAT)) == -1)
+        die();
+    dict->offs = xcalloc(1, sizeof(uint32_t));
+    dict_load(dict);
+}
+
+/* Get the code of `str`, or UINT32_MAX if it is not in the dictionary */
+uint32_t dict_find(const dict_t *dict, const char *str, const size_t len)
+{
+    if (dict->table == NULL)
+        return UINT32_MAX;
+
+    for (size_t i = hash(str, len) & dict->mask; dict->table[i];
+         i = (i + 1) & dict->mask) {
+        const uint32_t code = dict->table[i] - 1;
+        if (dict->offs[code + 1] - dict->offs[code] - 1 == len
+            && memcmp(dict->buf + dict->offs[code], str, len) == 0)
+            return code;
+    }
+
+    return UINT32_MAX;
+}
+
+static uint32_t dict_add(dict_t *dict, const string_t *str)
+{
+    uint32_t code = dict_find(dict, str->ptr, str->len);
+    if (code != UINT32_MAX)
+        return code;
+
+    /* Entries are separated by newlines, so they can't contain any */
+    char entry[256];
+    size_t len = str->len < sizeof(entry) - 1 ? str->len : sizeof(entry) - 1;
+    for (size_t i = 0; i < len; i++)
+        entry[i] = str->ptr[i] == '\n' ? ' ' : str->ptr[i];
+    if ((code = dict_find(dict, entry, len)) != UINT32_MAX)
+        return code;
+    entry[len++] = '\n';
+
+    write_all(dict->fd, entry, len, dict->size);
+
+    if (dict->size + len > dict->cap) {
+        dict->cap = (dict->size + len) * 2;
+        dict->buf = xrealloc(dict->buf, dict->cap);
+    }
+    memcpy(dict->buf + dict->size, entry, len);
+    dict->size += len;
+
+    code = dict->n++;
+    dict->offs = xrealloc(dict->offs, sizeof(uint32_t) * (dict->n + 1));
+    dict->offs[dict->n] = dict->size;
+
+    if (dict->mask < dict->n * 2)
+        dict_grow(dict);
+    else
+        dict_insert(dict, code);
+
+    return code;
+}
+
+void dict_print(const dict_t *dict, const uint32_t code)
+{
+    if (code >= dict->n) {
+        fputs("-", stdout);
+        return;
+    }
+    fwrite(dict->buf + dict->offs[code], 1,
+           dict->offs[code + 1] - dict->offs[code] - 1, stdout);
+}
+
+static void dict_close(dict_t *dict)
+{
+    close(dict->fd);
+    free(dict->buf);
+    free(dict->offs);
+    free(dict->table);
+}
+
+static void lock(const meta_db_t *db, const int op)
+{
+    while (flock(db->lock, op) == -1)
+        if (errno != EINTR)
+            die();
+}
+
+/*
+ * Read the size of every column, which other processes may have appended to.
+ * The columns are appended one after another, so a crash can leave some of
+ * them longer than the others. Cut every column at the last row that is
+ * complete in all of them, only with the store locked so that no row is
+ * still being written.
+ */
+static void recover(meta_db_t *db)
+{
+    db->rows = SIZE_MAX;
+    for (int i = 0; i < NCOLS; i++) {
+        struct stat st;
+        if (fstat(db->fd[i], &st) == -1)
+            die();
+        db->size[i] = st.st_size;
+
+        if (columns[i].width && db->size[i] / columns[i].width < db->rows)
+            db->rows = db->size[i] / columns[i].width;
+    }
+
+    for (int i = 0; i < NCOLS; i++) {
+        size_t size = db->rows * columns[i].width;
+        if (i == COL_PLAYERS || i == COL_VIDEOS) {
+            const int idx = i - 1;
+            const size_t w = columns[idx].width;
+            uint64_t end = 0;
+            if (db->rows > 0
+                && pread(db->fd[idx], &end, w, (db->rows - 1) * w)
+                       != (ssize_t) w)
+                die();
+            size = i == COL_PLAYERS ? end * sizeof(uint32_t) : end;
+        }
+
+        if (db->size[i] != size && ftruncate(db->fd[i], size) == -1)
+            die();
+        db->size[i] = size;
+    }
+}
+
+void meta_open(meta_db_t *db, const char *dir)
+{
+    memset(db, 0, sizeof(*db));
+    snprintf(db->dir, sizeof(db->dir), "%s", dir);
+
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST)
+        die();
+    if ((db->lock = open_at(dir, "lock", O_RDWR | O_CREAT)) == -1)
+        die();
+
+    lock(db, LOCK_EX);
+    for (int i = 0; i < NDICTS; i++)
+        dict_open(&db->dicts[i], dir, dict_names[i]);
+    for (int i = 0; i < NCOLS; i++)
+        if ((db->fd[i] = open_at(dir, columns[i].name, O_RDWR | O_CREAT))
+            == -1)
+            die();
+    recover(db);
+    lock(db, LOCK_UN);
+
+    for (int i = 0; i < NCOLS; i++) {
+        if (db->size[i] > 0) {
+            db->map[i] = mmap(NULL, db->size[i], PROT_READ, MAP_SHARED,
+                              db->fd[i], 0);
+            if (db->map[i] == MAP_FAILED)
+                die();
+            db->mapped[i] = db->size[i];
+        }
+    }
+}
+
+/* Add `id` to the set, returns false if it was already in there */
+static bool add_id(meta_db_t *db, const uint64_t id)
+{
+    size_t i = hash((const char *) &id, sizeof(id)) & db->idmask;
+    for (; db->ids[i]; i = (i + 1) & db->idmask)
+        if (db->ids[i] == id)
+            return false;
+    db->ids[i] = id;
+    return true;
+}
+
+/* Resize the set of run IDs, building it from the ID column the first time */
+static void grow_ids(meta_db_t *db)
+{
+    uint64_t *old = db->ids;
+    const size_t oldcap = old != NULL ? db->idmask + 1 : 0;
+
+    size_t cap = 1024;
+    while (cap < (db->rows + 1) * 2)
+        cap *= 2;
+
+    db->idmask = cap - 1;
+    db->ids = xcalloc(cap, sizeof(uint64_t));
+
+    if (old == NULL) {
+        for (size_t r = 0; r < db->rows; r++)
+            add_id(db, pack_id((const char *) db->map[COL_ID]
+                                   + r * META_ID_LEN,
+                               META_ID_LEN));
+    } else {
+        for (size_t i = 0; i < oldcap; i++)
+            if (old[i])
+                add_id(db, old[i]);
+        free(old);
+    }
+}
+
+/*
+ * Catch up with the rows and dictionary entries other processes appended
+ * since the store was last read, with the store locked
+ */
+static void catch_up(meta_db_t *db)
+{
+    /* The first time, the set is built from the rows that were mapped */
+    if (db->ids == NULL)
+        grow_ids(db);
+
+    const size_t rows = db->rows;
+    recover(db);
+    if ((db->rows + 1) * 2 > db->idmask)
+        grow_ids(db);
+    for (size_t r = rows; r < db->rows; r++) {
+        char id[META_ID_LEN];
+        if (pread(db->fd[COL_ID], id, META_ID_LEN, r * META_ID_LEN)
+            != META_ID_LEN)
+            die();
+        add_id(db, pack_id(id, META_ID_LEN));
+    }
+
+    for (int i = 0; i < NDICTS; i++)
+        dict_load(&db->dicts[i]);
+}
+
+bool meta_append(meta_db_t *db, const meta_t *meta, const uint8_t flags)
+{
+    lock(db, LOCK_EX);
+    catch_up(db);
+
+    const uint64_t id = pack_id(meta->id.ptr, meta->id.len);
+    if (!add_id(db, id)) {
+        lock(db, LOCK_UN);
+        return false;
+    }
+
+    const uint32_t game = dict_add(&db->dicts[DICT_GAME], &meta->game),
+                   category = dict_add(&db->dicts[DICT_CATEGORY],
+                                       &meta->category);
+
+    /* Variable width data first, the fixed width columns commit the row */
+    uint32_t players[META_MAX_PLAYERS];
+    for (unsigned int i = 0; i < meta->nplayers; i++)
+        players[i] = dict_add(&db->dicts[DICT_PLAYER], &meta->players[i]);
+    write_all(db->fd[COL_PLAYERS], players, meta->nplayers * sizeof(uint32_t),
+              db->size[COL_PLAYERS]);
+    db->size[COL_PLAYERS] += meta->nplayers * sizeof(uint32_t);
+
+    for (unsigned int i = 0; i < meta->nvideos; i++) {
+        write_all(db->fd[COL_VIDEOS], meta->videos[i].ptr, meta->videos[i].len,
+                  db->size[COL_VIDEOS]);
+        db->size[COL_VIDEOS] += meta->videos[i].len;
+        write_all(db->fd[COL_VIDEOS], "\n", 1, db->size[COL_VIDEOS]++);
+    }
+
+    const uint32_t players_end = db->size[COL_PLAYERS] / sizeof(uint32_t);
+    const uint64_t videos_end = db->size[COL_VIDEOS];
+    const void *row[NCOLS] = {
+        [COL_ID] = &id,
+        [COL_GAME] = &game,
+        [COL_CATEGORY] = &category,
+        [COL_SUBMITTED] = &meta->submitted,
+        [COL_FLAGS] = &flags,
+        [COL_PLAYERS_IDX] = &players_end,
+        [COL_VIDEOS_IDX] = &videos_end,
+    };
+
+    /* The ID is written last, a row without it does not exist */
+    for (int i = NCOLS - 1; i >= 0; i--) {
+        if (columns[i].width == 0)
+            continue;
+        write_all(db->fd[i], row[i], columns[i].width, db->size[i]);
+        db->size[i] += columns[i].width;
+    }
+    db->rows++;
+
+    lock(db, LOCK_UN);
+    return true;
+}
+
+void meta_close(meta_db_t *db)
+{
+    for (int i = 0; i < NCOLS; i++) {
+        if (db->map[i] != NULL)
+            munmap(db->map[i], db->mapped[i]);
+        close(db->fd[i]);
+    }
+    for (int i = 0; i < NDICTS; i++)
+        dict_close(&db->dicts[i]);
+    close(db->lock);
+    free(db->ids);
+}
+
+/* Sort groups by their count, largest first */
+static int cmp_groups(const void *a, const void *b)
+{
+    const uint64_t x = ((const uint64_t *) a)[1], y = ((const uint64_t *) b)[1];
+    return (x < y) - (x > y);
+}
+
+int meta_query(const meta_db_t *db, const char *query,
+               const meta_filter_t *filter)
+{
+    const uint32_t *games = db->map[COL_GAME],
+                   *categories = db->map[COL_CATEGORY],
+                   *submitted = db->map[COL_SUBMITTED],
+                   *players_idx = db->map[COL_PLAYERS_IDX],
+                   *players = db->map[COL_PLAYERS];
+    const uint64_t *videos_idx = db->map[COL_VIDEOS_IDX];
+    const uint8_t *flags = db->map[COL_FLAGS];
+    const char *ids = db->map[COL_ID], *videos = db->map[COL_VIDEOS];
+
+    enum { COUNT, RUNS, DUPS, PLAYERS } kind;
+    if (strcmp(query, "count") == 0)
+        kind = COUNT;
+    else if (strcmp(query, "runs") == 0)
+        kind = RUNS;
+    else if (strcmp(query, "dups") == 0)
+        kind = DUPS;
+    else if (strcmp(query, "players") == 0)
+        kind = PLAYERS;
+    else {
+        fprintf(stderr, "drun: unknown query '%s'\n", query);
+        return EXIT_FAILURE;
+    }
+
+    /* Translate the filters to dictionary codes once */
+    const char *names[NDICTS] = {filter->game, filter->category,
+                                 filter->player};
+    uint32_t codes[NDICTS];
+    for (int i = 0; i < NDICTS; i++) {
+        codes[i] = UINT32_MAX;
+        if (names[i] == NULL)
+            continue;
+        codes[i] = dict_find(&db->dicts[i], names[i], strlen(names[i]));
+
+        /* A value that was never stored matches nothing */
+        if (codes[i] == UINT32_MAX) {
+            if (kind == COUNT)
+                puts("0 runs, 0 duplicates");
+            return EXIT_SUCCESS;
+        }
+    }
+
+    /*
+     * Groups as (key, count) pairs, indexed directly by dictionary codes.
+     * Every category belongs to a single game, so duplicates are grouped by
+     * category and the game is kept in the upper half of the key.
+     */
+    uint64_t *groups = NULL;
+    size_t ngroups = 0;
+    if (kind == DUPS || kind == PLAYERS) {
+        ngroups = db->dicts[kind == PLAYERS ? DICT_PLAYER : DICT_CATEGORY].n;
+        groups = xcalloc(ngroups + 1, 2 * sizeof(uint64_t));
+        for (size_t i = 0; i < ngroups; i++)
+            groups[i * 2] = i;
+    }
+
+    size_t matched = 0, duplicates = 0;
+    for (size_t r = 0; r < db->rows; r++) {
+        if (codes[DICT_GAME] != UINT32_MAX && games[r] != codes[DICT_GAME])
+            continue;
+        if (codes[DICT_CATEGORY] != UINT32_MAX
+            && categories[r] != codes[DICT_CATEGORY])
+            continue;
+
+        const uint32_t pstart = r ? players_idx[r - 1] : 0,
+                       pend = players_idx[r];
+        if (codes[DICT_PLAYER] != UINT32_MAX) {
+            uint32_t p = pstart;
+            while (p < pend && players[p] != codes[DICT_PLAYER])
+                p++;
+            if (p == pend)
+                continue;
+        }
+
+        matched++;
+        duplicates += flags[r] & META_DUPLICATE;
+
+        switch (kind) {
+        case RUNS: {
+            const uint64_t vstart = r ? videos_idx[r - 1] : 0,
+                           vend = videos_idx[r];
+            const time_t date = submitted[r];
+            char datestr[32] = "-";
+            if (date)
+                strftime(datestr, sizeof(datestr), "%Y-%m-%d", gmtime(&date));
+
+            printf("%.*s ", META_ID_LEN, ids + r * META_ID_LEN);
+            dict_print(&db->dicts[DICT_GAME], games[r]);
+            putchar(' ');
+            dict_print(&db->dicts[DICT_CATEGORY], categories[r]);
+            printf(" %s %s", datestr,
+                   flags[r] & META_DUPLICATE ? "duplicate" : "new");
+            for (uint64_t v = vstart; v < vend;) {
+                const char *end = memchr(videos + v, '\n', vend - v);
+                if (end == NULL)
+                    break;
+                printf(" %.*s", (int) (end - videos - v), videos + v);
+                v = end - videos + 1;
+            }
+            putchar('\n');
+            break;
+        }
+        case DUPS:
+            groups[categories[r] * 2] = (uint64_t) games[r] << 32
+                                        | categories[r];
+            groups[categories[r] * 2 + 1] += flags[r] & META_DUPLICATE;
+            break;
+        case PLAYERS:
+            if (flags[r] & META_DUPLICATE)
+                for (uint32_t p = pstart; p < pend; p++)
+                    groups[players[p] * 2 + 1]++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (kind == COUNT)
+        printf("%zu runs, %zu duplicates\n", matched, duplicates);
+
+    if (groups != NULL) {
+        qsort(groups, ngroups, 2 * sizeof(uint64_t), cmp_groups);
+        for (size_t i = 0; i < ngroups && groups[i * 2 + 1]; i++) {
+            const uint64_t key = groups[i * 2];
+            printf("%" PRIu64 " ", groups[i * 2 + 1]);
+            if (kind == PLAYERS) {
+                dict_print(&db->dicts[DICT_PLAYER], key);
+            } else {
+                dict_print(&db->dicts[DICT_GAME], key >> 32);
+                putchar(' ');
+                dict_print(&db->dicts[DICT_CATEGORY], key & UINT32_MAX);
+            }
+            putchar('\n');
+        }
+        free(groups);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "metrics.h"
+
+metrics_t metrics;
+
+static const struct {
+    const char *name;
+    const char *help;
+} hists[NHISTS] = {
+    [HIST_FETCH] = {"fetch", "Time to download a response from the API"},
+    [HIST_PARSE] = {"parse", "Time to parse a run"},
+    [HIST_LOOKUP] = {"lookup", "Time to look up a video in the database"},
+    [HIST_STORE] = {"store", "Time to store the metadata of a run"},
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} counters[NCOUNTERS] = {
+    [CNT_RUNS] = {"runs", "Runs checked"},
+    [CNT_DUPLICATES] = {"duplicates", "Runs whose video was in the database"},
+    [CNT_NEW] = {"new", "Runs whose video was added to the database"},
+    [CNT_NO_VIDEO] = {"no_video", "Runs without a video"},
+    [CNT_BLOCKED] = {"blocked", "Runs with a video on the blocklist"},
+    [CNT_REQUESTS] = {"requests", "Requests to the API"},
+    [CNT_RETRIES] = {"retries", "Requests to the API that were retried"},
+    [CNT_HEDGED] = {"hedged", "Requests to the API that were hedged"},
+    [CNT_BYTES] = {"downloaded_bytes", "Bytes downloaded from the API"},
+};
+
+uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void metrics_time(const int hist, const uint64_t start)
+{
+    hist_record(&metrics.hists[hist], metrics_now() - start);
+}
+
+void metrics_count(const int counter, const uint64_t n)
+{
+    __atomic_fetch_add(&metrics.counters[counter], n, __ATOMIC_RELAXED);
+}
+
+static unsigned int bucket(const uint64_t value)
+{
+    if (value < HIST_SUB)
+        return value;
+
+    /* Keep the HIST_SUB_BITS most significant bits of the value */
+    const unsigned int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS + 1;
+    return (shift + 1) * HIST_HALF + (value >> shift) - HIST_HALF;
+}
+
+/* The highest value that falls into the bucket */
+static uint64_t bucket_max(const unsigned int i)
+{
+    if (i < HIST_SUB)
+        return i;
+
+    const unsigned int shift = i / HIST_HALF - 1;
+    return ((uint64_t) (i % HIST_HALF + HIST_HALF) << shift)
+           + ((uint64_t) 1 << shift) - 1;
+}
+
+void hist_record(hist_t *hist, const uint64_t value)
+{
+    /* Stages of the pipeline record from their own threads */
+    __atomic_fetch_add(&hist->counts[bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (value > max
+           && !__atomic_compare_exchange_n(&hist->max, &max, value, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+uint64_t hist_percentile(const hist_t *hist, const double p)
+{
+    /* Values may still be recorded meanwhile, so read every field once */
+    const uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED),
+                   hmax = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (p / 100 * count + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            const uint64_t max = bucket_max(i);
+            return max < hmax ? max : hmax;
+        }
+    }
+
+    return hmax;
+}
+
+void metrics_print(FILE *fp)
+{
+    const uint64_t *c = metrics.counters;
+    fprintf(fp,
+            "drun: %" PRIu64 " runs, %" PRIu64 " duplicates, %" PRIu64
+            " new, %" PRIu64 " without video, %" PRIu64 " blocked, %" PRIu64
+            " requests, %" PRIu64 " retries, %" PRIu64 " hedged, %" PRIu64
+            " bytes",
+            c[CNT_RUNS], c[CNT_DUPLICATES], c[CNT_NEW], c[CNT_NO_VIDEO],
+            c[CNT_BLOCKED], c[CNT_REQUESTS], c[CNT_RETRIES], c[CNT_HEDGED],
+            c[CNT_BYTES]);
+
+    for (int i = 0; i < NHISTS; i++) {
+        const hist_t *h = &metrics.hists[i];
+        if (h->count == 0)
+            continue;
+        fprintf(fp,
+                "; %s p50 %.3fms p90 %.3fms p99 %.3fms max %.3fms",
+                hists[i].name, hist_percentile(h, 50) / 1000.0,
+                hist_percentile(h, 90) / 1000.0,
+                hist_percentile(h, 99) / 1000.0, h->max / 1000.0);
+    }
+    fputc('\n', fp);
+}
+
+void metrics_export(const char *path)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 1};
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        perror("drun");
+        return;
+    }
+
+    for (int i = 0; i < NCOUNTERS; i++)
+        fprintf(fp,
+                "# HELP drun_%s_total %s.\n# TYPE drun_%s_total counter\n"
+                "drun_%s_total %" PRIu64 "\n",
+                counters[i].name, counters[i].help, counters[i].name,
+                counters[i].name, metrics.counters[i]);
+
+    for (int i = 0; i < NHISTS; i++) {
+        const hist_t *h = &metrics.hists[i];
+        const char *name = hists[i].name;
+
+        fprintf(fp,
+                "# HELP drun_%s_seconds %s.\n# TYPE drun_%s_seconds summary\n",
+                name, hists[i].help, name);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(*quantiles); q++)
+            fprintf(fp, "drun_%s_seconds{quantile=\"%g\"} %.6f\n", name,
+                    quantiles[q], hist_percentile(h, quantiles[q] * 100) / 1e6);
+        fprintf(fp,
+                "drun_%s_seconds_sum %.6f\ndrun_%s_seconds_count %" PRIu64
+                "\n",
+                name, h->sum / 1e6, name, h->count);
+    }
+
+    if (fclose(fp) == EOF || rename(tmp, path) == -1)
+        perror("drun");
+}
+
+void metrics_flush(void)
+{
+    if (metrics.textfile != NULL)
+        metrics_export(metrics.textfile);
+    if (metrics.stats)
+        metrics_print(stderr);
+}
@@ -0,0 +1,190 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <curl/curl.h>
+
+#include "alloc.h"
+#include "pipeline.h"
+#include "queue.h"
+
+/*
+ * The queues between the stages. Every download thread has a queue of runs to
+ * download and one of downloaded runs, the other stages are single threads.
+ */
+static queue_t free_jobs, parsed_jobs;
+static queue_t to_fetch[PIPELINE_MAX_JOBS], fetched[PIPELINE_MAX_JOBS];
+static unsigned int njobs;
+
+/*
+ * The position of the first run that could not be downloaded, SIZE_MAX while
+ * there is none. The runs after it are not downloaded and no more are read.
+ */
+static size_t failed_at;
+
+static void start(pthread_t *thread, void *(*stage)(void *), void *arg)
+{
+    const int ret = pthread_create(thread, NULL, stage, arg);
+    if (ret != 0) {
+        errno = ret;
+        perror("drun");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Every download thread stops at the end of its queue */
+static void end_input(void *arg)
+{
+    (void) arg;
+    for (unsigned int i = 0; i < njobs; i++)
+        queue_push(&to_fetch[i], NULL);
+}
+
+/*
+ * Read the IDs from STDIN and hand the runs to the download threads in turns.
+ * The thread can only be cancelled while it waits for input, and still ends
+ * the input of the download threads then.
+ */
+static void *read_ids(void *arg)
+{
+    (void) arg;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_cleanup_push(end_input, NULL);
+    job_t *job = queue_pop(&free_jobs);
+    for (size_t turn = 0;
+         __atomic_load_n(&failed_at, __ATOMIC_RELAXED) == SIZE_MAX;) {
+        arena_reset(&job->arena);
+        job->run = (run_t){.arena = &job->arena};
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        pthread_testcancel();
+        const bool read = get_id(&job->run);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        if (!read)
+            break;
+        if (job->run.id[0] == '\0')
+            continue;
+
+        job->seq = turn;
+        queue_push(&to_fetch[turn++ % njobs], job);
+        job = queue_pop(&free_jobs);
+    }
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+/* Remember that the run at `seq` failed, if it is the first one that did */
+static void fail_at(const size_t seq)
+{
+    size_t at = __atomic_load_n(&failed_at, __ATOMIC_RELAXED);
+    while (seq < at
+           && !__atomic_compare_exchange_n(&failed_at, &at, seq, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void *download(void *arg)
+{
+    const unsigned int i = (uintptr_t) arg;
+
+    job_t *job;
+    while ((job = queue_pop(&to_fetch[i])) != NULL) {
+        /* The runs after one that failed are only passed on */
+        job->failed = job->seq > __atomic_load_n(&failed_at, __ATOMIC_RELAXED);
+        if (!job->failed) {
+            init_string(&job->run.json, &job->arena);
+            job->failed = dl_json(job->run.id, &job->run.json, &job->arena)
+                          == NULL;
+            if (job->failed)
+                fail_at(job->seq);
+        }
+        queue_push(&fetched[i], job);
+    }
+
+    queue_push(&fetched[i], NULL);
+    dl_cleanup();
+    return NULL;
+}
+
+/* Take the downloaded runs back in the turns they were handed out in */
+static void *parse(void *arg)
+{
+    (void) arg;
+
+    job_t *job;
+    for (size_t turn = 0; (job = queue_pop(&fetched[turn % njobs])) != NULL;
+         turn++) {
+        if (!job->failed)
+            parse_run(&job->run, &job->parsed);
+        queue_push(&parsed_jobs, job);
+    }
+
+    queue_push(&parsed_jobs, NULL);
+    return NULL;
+}
+
+bool pipeline(const unsigned int jobs, const pipeline_warm_t warm,
+              const pipeline_sink_t sink)
+{
+    njobs = jobs;
+    failed_at = SIZE_MAX;
+
+    /* curl has to be set up before several threads use it */
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+        exit(EXIT_FAILURE);
+
+    /* A queue holds every job and the end of the input at most */
+    job_t *pool = xcalloc(PIPELINE_DEPTH, sizeof(job_t));
+    queue_init(&free_jobs, PIPELINE_DEPTH + 1);
+    queue_init(&parsed_jobs, PIPELINE_DEPTH + 1);
+    for (unsigned int i = 0; i < njobs; i++) {
+        queue_init(&to_fetch[i], PIPELINE_DEPTH + 1);
+        queue_init(&fetched[i], PIPELINE_DEPTH + 1);
+    }
+    for (size_t i = 0; i < PIPELINE_DEPTH; i++)
+        queue_push(&free_jobs, &pool[i]);
+
+    pthread_t reader, parser, downloaders[PIPELINE_MAX_JOBS];
+    start(&reader, read_ids, NULL);
+    for (unsigned int i = 0; i < njobs; i++)
+        start(&downloaders[i], download, (void *) (uintptr_t) i);
+    start(&parser, parse, NULL);
+
+    /* The database is only ever touched by this thread, which is idle now */
+    if (warm != NULL)
+        warm();
+    /*
+     * The runs after one that failed are dropped until every stage ended, the
+     * reader is cancelled so that it does not wait for more input
+     */
+    bool ok = true;
+    job_t *job;
+    while ((job = queue_pop(&parsed_jobs)) != NULL) {
+        if (ok && job->failed) {
+            ok = false;
+            pthread_cancel(reader);
+        }
+        if (ok)
+            sink(&job->run, &job->parsed);
+        queue_push(&free_jobs, job);
+    }
+
+    pthread_join(reader, NULL);
+    for (unsigned int i = 0; i < njobs; i++)
+        pthread_join(downloaders[i], NULL);
+    pthread_join(parser, NULL);
+
+    for (size_t i = 0; i < PIPELINE_DEPTH; i++)
+        arena_free(&pool[i].arena);
+    free(pool);
+    queue_free(&free_jobs);
+    queue_free(&parsed_jobs);
+    for (unsigned int i = 0; i < njobs; i++) {
+        queue_free(&to_fetch[i]);
+        queue_free(&fetched[i]);
+    }
+    return ok;
+}
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "queue.h"
+
+/*
+ * Wait for the other side of the queue. Stages are mostly waiting on the
+ * network, so after a few spins the thread naps, twice as long every time.
+ */
+static void backoff(unsigned int *spins, long *nap)
+{
+    if (*spins < QUEUE_SPINS) {
+        (*spins)++;
+        sched_yield();
+        return;
+    }
+
+    const struct timespec ts = {0, *nap};
+    nanosleep(&ts, NULL);
+    if (*nap < QUEUE_MAX_SLEEP)
+        *nap *= 2;
+}
+
+void queue_init(queue_t *queue, const size_t cap)
+{
+    size_t size = 2;
+    while (size < cap)
+        size *= 2;
+
+    queue->head = queue->tail = 0;
+    queue->mask = size - 1;
+    queue->items = xmalloc(sizeof(void *) * size);
+}
+
+void queue_push(queue_t *queue, void *item)
+{
+    const size_t tail = queue->tail;
+    unsigned int spins = 0;
+    long nap = 1000;
+    while (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)
+           > queue->mask)
+        backoff(&spins, &nap);
+
+    /* The item is written before the consumer can see the new tail */
+    queue->items[tail & queue->mask] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void *queue_pop(queue_t *queue)
+{
+    const size_t head = queue->head;
+    unsigned int spins = 0;
+    long nap = 1000;
+    while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == head)
+        backoff(&spins, &nap);
+
+    /* The slot is read before the producer can see it is free */
+    void *item = queue->items[head & queue->mask];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+void queue_free(queue_t *queue)
+{
+    free(queue->items);
+    queue->items = NULL;
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "alloc.h"
+#include "store.h"
+
+/*
+ * The runs are rows of one table, indexed by video and by run. The game and
+ * category of every run are kept, so that a lookup without -x sees the runs
+ * that would be in its shard.
+ */
+static const char schema[] =
+    "PRAGMA journal_mode = WAL;"
+    "PRAGMA synchronous = NORMAL;"
+    "CREATE TABLE IF NOT EXISTS runs ("
+    "    video TEXT NOT NULL,"
+    "    run TEXT NOT NULL,"
+    "    game TEXT,"
+    "    category TEXT"
+    ");"
+    "CREATE INDEX IF NOT EXISTS runs_video ON runs (video);"
+    "CREATE INDEX IF NOT EXISTS runs_run ON runs (run);";
+
+/* The statements, in the order of `queries` */
+enum {
+    SQL_FIND,
+    SQL_FIND_GAME,
+    SQL_FIND_CATEGORY,
+    SQL_ADD,
+    SQL_REMOVE_VIDEO,
+    SQL_REMOVE_RUN,
+    SQL_ALL,
+    SQL_COUNT
+};
+
+static const char *const queries[SQL_COUNT] = {
+    "SELECT video, run FROM runs WHERE video = ?1 ORDER BY rowid DESC LIMIT 1",
+    "SELECT video, run FROM runs WHERE video = ?1 AND game IS ?2 "
+    "ORDER BY rowid DESC LIMIT 1",
+    "SELECT video, run FROM runs WHERE video = ?1 AND game IS ?2 "
+    "AND category IS ?3 ORDER BY rowid DESC LIMIT 1",
+    "INSERT INTO runs (video, run, game, category) VALUES (?1, ?2, ?3, ?4)",
+    "DELETE FROM runs WHERE video = ?1",
+    "DELETE FROM runs WHERE run = ?1",
+    "SELECT video, run FROM runs ORDER BY rowid",
+};
+
+/**
+ * @brief The state of the sqlite backend
+ *
+ * @param path The database file
+ * @param by How the hashed backend would partition runs into shards
+ * @param db The connection, opened on first use
+ * @param stmts The prepared statements, e.g. `stmts[SQL_FIND]`
+ */
+typedef struct {
+    char path[1100];
+    int by;
+    sqlite3 *db;
+    sqlite3_stmt *stmts[SQL_COUNT];
+} sql_t;
+
+static void sql_die(sqlite3 *db)
+{
+    fprintf(stderr, "drun: %s\n", sqlite3_errmsg(db));
+    exit(EXIT_FAILURE);
+}
+
+/* Get a statement ready to be bound, the database is opened on first use */
+static sqlite3_stmt *statement(store_t *store, const int which)
+{
+    sql_t *sql = store->sql;
+    if (sql->db == NULL) {
+        if (sqlite3_open(sql->path, &sql->db) != SQLITE_OK
+            || sqlite3_busy_timeout(sql->db, 5000) != SQLITE_OK
+            || sqlite3_exec(sql->db, schema, NULL, NULL, NULL) != SQLITE_OK)
+            sql_die(sql->db);
+        for (int i = 0; i < SQL_COUNT; i++)
+            if (sqlite3_prepare_v2(sql->db, queries[i], -1, &sql->stmts[i],
+                                   NULL)
+                != SQLITE_OK)
+                sql_die(sql->db);
+    }
+
+    sqlite3_stmt *stmt = sql->stmts[which];
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return stmt;
+}
+
+static void bind(store_t *store, sqlite3_stmt *stmt, const int i,
+                 const char *text)
+{
+    if (sqlite3_bind_text(stmt, i, text, -1, SQLITE_STATIC) != SQLITE_OK)
+        sql_die(((sql_t *) store->sql)->db);
+}
+
+static int step(store_t *store, sqlite3_stmt *stmt)
+{
+    const int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_ROW && ret != SQLITE_DONE)
+        sql_die(((sql_t *) store->sql)->db);
+    return ret;
+}
+
+/* Format the current row like a line of the `runs` file */
+static int row_line(sqlite3_stmt *stmt, char *buf, const size_t size)
+{
+    return snprintf(buf, size, "%s https://www.speedrun.com/run/%s\n",
+                    sqlite3_column_text(stmt, 0),
+                    sqlite3_column_text(stmt, 1));
+}
+
+static void sqlite_open(store_t *store, const char *dir, const int by)
+{
+    sql_t *sql = xcalloc(1, sizeof(sql_t));
+    snprintf(sql->path, sizeof(sql->path), "%s/runs.sqlite", dir);
+    sql->by = by;
+    store->sql = sql;
+}
+
+static char *sqlite_find(store_t *store, const char *game,
+                         const char *category, const char *video_uri,
+                         const bool cross, arena_t *arena)
+{
+    const sql_t *sql = store->sql;
+    int which = SQL_FIND;
+    if (!cross && sql->by == SHARD_GAME)
+        which = SQL_FIND_GAME;
+    else if (!cross && sql->by == SHARD_CATEGORY)
+        which = SQL_FIND_CATEGORY;
+
+    sqlite3_stmt *stmt = statement(store, which);
+    bind(store, stmt, 1, video_uri);
+    if (which != SQL_FIND && game != NULL)
+        bind(store, stmt, 2, game);
+    if (which == SQL_FIND_CATEGORY && category != NULL)
+        bind(store, stmt, 3, category);
+    if (step(store, stmt) != SQLITE_ROW)
+        return NULL;
+
+    const size_t size = sqlite3_column_bytes(stmt, 0)
+                        + sqlite3_column_bytes(stmt, 1) + 64;
+    char *line = arena_alloc(arena, size);
+    row_line(stmt, line, size);
+    return line;
+}
+
+/* Opening the database reads its schema and prepares the statements */
+static void sqlite_warm(store_t *store, const bool cross)
+{
+    (void) cross;
+    statement(store, SQL_FIND);
+}
+
+static void sqlite_add(store_t *store, const char *game, const char *category,
+                       const char *video_uri, const char *runid)
+{
+    sqlite3_stmt *stmt = statement(store, SQL_ADD);
+    bind(store, stmt, 1, video_uri);
+    bind(store, stmt, 2, runid);
+    if (game != NULL)
+        bind(store, stmt, 3, game);
+    if (category != NULL)
+        bind(store, stmt, 4, category);
+    step(store, stmt);
+}
+
+static size_t sqlite_remove(store_t *store, const char *key, const bool by_run)
+{
+    sqlite3_stmt *stmt =
+        statement(store, by_run ? SQL_REMOVE_RUN : SQL_REMOVE_VIDEO);
+    bind(store, stmt, 1, key);
+    step(store, stmt);
+    return sqlite3_changes(((sql_t *) store->sql)->db);
+}
+
+static void sqlite_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    sqlite3_stmt *stmt = statement(store, SQL_ALL);
+    char *line = NULL;
+    size_t size = 0;
+    while (step(store, stmt) == SQLITE_ROW) {
+        const size_t need = sqlite3_column_bytes(stmt, 0)
+                            + sqlite3_column_bytes(stmt, 1) + 64;
+        if (need > size) {
+            free(line);
+            line = xmalloc(need);
+            size = need;
+        }
+        visit(line, row_line(stmt, line, size), arg);
+    }
+    free(line);
+}
+
+static void sqlite_close(store_t *store)
+{
+    sql_t *sql = store->sql;
+    for (int i = 0; i < SQL_COUNT; i++)
+        sqlite3_finalize(sql->stmts[i]);
+    sqlite3_close(sql->db);
+    free(sql);
+    store->sql = NULL;
+}
+
+const store_ops_t sqlite_store = {
+    .name = "sqlite",
+    .open = sqlite_open,
+    .find = sqlite_find,
+    .warm = sqlite_warm,
+    .add = sqlite_add,
+    .remove = sqlite_remove,
+    .iterate = sqlite_iterate,
+    .close = sqlite_close,
+};
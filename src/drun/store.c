@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "canon.h"
+#include "store.h"
+#include "util.h"
+
+static const store_ops_t *const backends[] = {
+    &text_store,
+    &hashed_store,
+#ifdef DRUN_SQLITE
+    &sqlite_store,
+#endif
+};
+
+bool store_open(store_t *store, const char *backend, const char *dir,
+                const int by)
+{
+    memset(store, 0, sizeof(*store));
+    for (size_t i = 0; i < sizeof(backends) / sizeof(*backends); i++) {
+        if (strcmp(backends[i]->name, backend) == 0) {
+            store->ops = backends[i];
+            store->ops->open(store, dir, by);
+            return true;
+        }
+    }
+    return false;
+}
+
+char *store_find(store_t *store, const char *game, const char *category,
+                 const char *video_uri, const bool cross, arena_t *arena)
+{
+    return store->ops->find(store, game, category, video_uri, cross, arena);
+}
+
+void store_warm(store_t *store, const bool cross)
+{
+    if (store->ops->warm != NULL)
+        store->ops->warm(store, cross);
+}
+
+void store_add(store_t *store, const char *game, const char *category,
+               const char *video_uri, const char *runid)
+{
+    store->ops->add(store, game, category, video_uri, runid);
+}
+
+size_t store_remove(store_t *store, const char *key, const bool by_run)
+{
+    return store->ops->remove(store, key, by_run);
+}
+
+void store_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    store->ops->iterate(store, visit, arg);
+}
+
+bool store_compact(store_t *store, const size_t keep)
+{
+    if (store->ops->compact == NULL)
+        return false;
+    store->ops->compact(store, keep);
+    return true;
+}
+
+bool store_reindex(store_t *store, const bool fix, size_t *differ)
+{
+    if (store->ops->reindex == NULL)
+        return false;
+    *differ = store->ops->reindex(store, fix);
+    return true;
+}
+
+void store_close(store_t *store)
+{
+    if (store->ops != NULL)
+        store->ops->close(store);
+    store->ops = NULL;
+}
+
+/* The hashed backend is the sharded database of db.h as it is */
+
+static void hashed_open(store_t *store, const char *dir, const int by)
+{
+    db_open(&store->db, dir, by);
+}
+
+static char *hashed_find(store_t *store, const char *game,
+                         const char *category, const char *video_uri,
+                         const bool cross, arena_t *arena)
+{
+    return db_find(&store->db, game, category, video_uri, cross, arena);
+}
+
+static void hashed_warm(store_t *store, const bool cross)
+{
+    db_warm(&store->db, cross);
+}
+
+static void hashed_add(store_t *store, const char *game, const char *category,
+                       const char *video_uri, const char *runid)
+{
+    db_add(&store->db, game, category, video_uri, runid);
+}
+
+static size_t hashed_remove(store_t *store, const char *key, const bool by_run)
+{
+    return db_remove(&store->db, key, by_run);
+}
+
+static void hashed_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    db_iterate(&store->db, visit, arg);
+}
+
+static void hashed_compact(store_t *store, const size_t keep)
+{
+    db_compact(&store->db, keep);
+}
+
+static size_t hashed_reindex(store_t *store, const bool fix)
+{
+    return db_reindex(&store->db, fix);
+}
+
+static void hashed_close(store_t *store)
+{
+    db_close(&store->db);
+}
+
+const store_ops_t hashed_store = {
+    .name = "hashed",
+    .open = hashed_open,
+    .find = hashed_find,
+    .warm = hashed_warm,
+    .add = hashed_add,
+    .remove = hashed_remove,
+    .iterate = hashed_iterate,
+    .compact = hashed_compact,
+    .reindex = hashed_reindex,
+    .close = hashed_close,
+};
+
+/*
+ * The text backend reads the flat `runs` file line by line, as drun did
+ * before it had an index. It understands the tombstones of the hashed
+ * backend, and removes runs the same way, but knows nothing of shards and
+ * cold segments.
+ */
+
+static void text_open(store_t *store, const char *dir, const int by)
+{
+    (void) by;
+    snprintf(store->path, sizeof(store->path), "%s/runs", dir);
+}
+
+static FILE *text_file(store_t *store)
+{
+    if (store->fp == NULL) {
+        if ((store->fp = fopen(store->path, "a+")) == NULL)
+            die();
+        db_recover(store->fp, store->path);
+    }
+    return store->fp;
+}
+
+/* Every lookup reads the whole file, so have the kernel read it ahead */
+static void text_warm(store_t *store, const bool cross)
+{
+    (void) cross;
+    const int ret = posix_fadvise(fileno(text_file(store)), 0, 0,
+                                  POSIX_FADV_WILLNEED);
+    if (ret != 0) {
+        errno = ret;
+        die();
+    }
+}
+
+/* Whether the line is a run of the video, or the run, `key` */
+static bool text_match(const char *line, const size_t n, const char *key,
+                       const bool by_run)
+{
+    const size_t len = strlen(key);
+    if (!by_run) {
+        const size_t field = strcspn(line, " \n");
+        return field < n && canon_eq(line, field, key, len);
+    }
+
+    /* The run ID is the last component of the run URI */
+    const size_t end = db_unseal(line, n);
+    return end > len && line[end - len - 1] == '/'
+           && memcmp(line + end - len, key, len) == 0;
+}
+
+/*
+ * Get the newest run of `key` that no later tombstone removed, with its CRC.
+ * The runs found so far are kept one after another in `found`.
+ */
+static char *text_lookup(store_t *store, const char *key, const bool by_run,
+                         arena_t *arena)
+{
+    FILE *fp = text_file(store);
+    if (fseeko(fp, 0, SEEK_SET) == -1)
+        die();
+
+    char *found = NULL;
+    size_t found_len = 0, found_size = 0;
+    ssize_t read;
+    while ((read = getline(&store->line, &store->line_size, fp)) != -1) {
+        /* A line that is still being written is not there yet */
+        const char *line = store->line;
+        if (line[read - 1] != '\n')
+            break;
+        if (line[0] != '-') {
+            if (!text_match(line, read, key, by_run))
+                continue;
+            if (found_len + read > found_size) {
+                const size_t size = (found_len + read) * 2;
+                found = found == NULL ? arena_alloc(arena, size)
+                                      : arena_grow(arena, found, found_size,
+                                                   size);
+                found_size = size;
+            }
+            memcpy(found + found_len, line, read);
+            found_len += read;
+            continue;
+        }
+
+        /* A tombstone removes every earlier copy of its line */
+        for (size_t i = 0; i < found_len;) {
+            const char *nl = memchr(found + i, '\n', found_len - i);
+            const size_t n = (size_t) (nl - found) + 1 - i;
+            if (n + 1 == (size_t) read && memcmp(found + i, line + 1, n) == 0) {
+                memmove(found + i, found + i + n, found_len - i - n);
+                found_len -= n;
+            } else {
+                i += n;
+            }
+        }
+    }
+    if (ferror(fp))
+        die();
+
+    if (found_len == 0)
+        return NULL;
+    size_t last = found_len - 1;
+    while (last > 0 && found[last - 1] != '\n')
+        last--;
+    return arena_strndup(arena, found + last, found_len - last);
+}
+
+static void text_append(store_t *store, const char *line, const size_t len)
+{
+    db_append(text_file(store), line, len);
+}
+
+static char *text_find(store_t *store, const char *game, const char *category,
+                       const char *video_uri, const bool cross, arena_t *arena)
+{
+    (void) game, (void) category, (void) cross;
+    char *line = text_lookup(store, video_uri, false, arena);
+    if (line != NULL)
+        strcpy(line + db_unseal(line, strlen(line)), "\n");
+    return line;
+}
+
+static void text_add(store_t *store, const char *game, const char *category,
+                     const char *video_uri, const char *runid)
+{
+    (void) game, (void) category;
+    char line[strlen(video_uri) + strlen(runid) + 64];
+    text_append(store, line, db_format(line, sizeof(line), video_uri, runid));
+}
+
+static size_t text_remove(store_t *store, const char *key, const bool by_run)
+{
+    arena_t arena = {0};
+    size_t removed = 0;
+    char *line;
+    while ((line = text_lookup(store, key, by_run, &arena)) != NULL) {
+        const size_t len = strlen(line);
+        char tomb[len + 1];
+        tomb[0] = '-';
+        memcpy(tomb + 1, line, len);
+        text_append(store, tomb, len + 1);
+        removed++;
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+    return removed;
+}
+
+/* A tombstone and the line it is on */
+typedef struct {
+    size_t line;
+    char *text;
+    size_t len;
+} text_tomb_t;
+
+static void text_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    FILE *fp = text_file(store);
+    arena_t arena = {0};
+    text_tomb_t *tombs = NULL;
+    size_t ntombs = 0, cap = 0;
+
+    /* Tombstones only remove earlier lines, so find them all first */
+    ssize_t read;
+    if (fseeko(fp, 0, SEEK_SET) == -1)
+        die();
+    for (size_t line = 0;
+         (read = getline(&store->line, &store->line_size, fp)) != -1; line++) {
+        if (store->line[read - 1] != '\n')
+            break;
+        if (store->line[0] != '-')
+            continue;
+        if (ntombs == cap) {
+            const size_t size = cap ? cap * 2 : 16;
+            tombs = tombs == NULL
+                        ? arena_alloc(&arena, sizeof(*tombs) * size)
+                        : arena_grow(&arena, tombs, sizeof(*tombs) * cap,
+                                     sizeof(*tombs) * size);
+            cap = size;
+        }
+        tombs[ntombs++] = (text_tomb_t){
+            line, arena_strndup(&arena, store->line + 1, read - 1), read - 1};
+    }
+
+    if (fseeko(fp, 0, SEEK_SET) == -1)
+        die();
+    for (size_t line = 0;
+         (read = getline(&store->line, &store->line_size, fp)) != -1; line++) {
+        if (store->line[read - 1] != '\n')
+            break;
+        bool removed = store->line[0] == '-';
+        for (size_t i = 0; i < ntombs && !removed; i++)
+            removed = tombs[i].line > line && tombs[i].len == (size_t) read
+                      && memcmp(tombs[i].text, store->line, read) == 0;
+        if (!removed) {
+            const size_t len = db_unseal(store->line, read);
+            store->line[len] = '\n';
+            visit(store->line, len + 1, arg);
+        }
+    }
+    if (ferror(fp))
+        die();
+    arena_free(&arena);
+}
+
+static void text_close(store_t *store)
+{
+    if (store->fp != NULL)
+        fclose(store->fp);
+    free(store->line);
+    store->fp = NULL;
+    store->line = NULL;
+    store->line_size = 0;
+}
+
+const store_ops_t text_store = {
+    .name = "text",
+    .open = text_open,
+    .find = text_find,
+    .warm = text_warm,
+    .add = text_add,
+    .remove = text_remove,
+    .iterate = text_iterate,
+    .close = text_close,
+};
@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "drun.h"
+#include "metrics.h"
+#include "watch.h"
+
+/* A run of the listing that is newer than the checkpoint */
+typedef struct {
+    char *json;
+    size_t len;
+    char id[META_ID_LEN + 1];
+    uint32_t submitted;
+} pending_t;
+
+/* Room for one more ID in the checkpoint, which is returned */
+static char *new_id(checkpoint_t *cp)
+{
+    if (cp->nids == cp->cap) {
+        cp->cap = cp->cap ? cp->cap * 2 : 16;
+        cp->ids = xrealloc(cp->ids, sizeof(*cp->ids) * cp->cap);
+    }
+    return cp->ids[cp->nids];
+}
+
+static void load_checkpoint(checkpoint_t *cp, const char *cpfile)
+{
+    memset(cp, 0, sizeof(*cp));
+
+    FILE *fp = fopen(cpfile, "r");
+    if (fp == NULL)
+        return;
+
+    if (fscanf(fp, "%u", &cp->submitted) == 1)
+        while (fscanf(fp, " %8s", new_id(cp)) == 1)
+            cp->nids++;
+
+    fclose(fp);
+}
+
+/*
+ * Write the checkpoint, a watcher that cannot goes on with the one in memory
+ * and writes it again after the next run
+ */
+static void save_checkpoint(const checkpoint_t *cp, const char *cpfile)
+{
+    char tmp[2048];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cpfile);
+
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        perror("drun");
+        return;
+    }
+
+    fprintf(fp, "%u", cp->submitted);
+    for (unsigned int i = 0; i < cp->nids; i++)
+        fprintf(fp, " %s", cp->ids[i]);
+    fputc('\n', fp);
+
+    /* Replace the old checkpoint atomically */
+    if (fclose(fp) == EOF || rename(tmp, cpfile) == -1)
+        perror("drun");
+}
+
+/* Whether the run was already processed according to the checkpoint */
+static bool seen(const checkpoint_t *cp, const uint32_t submitted,
+                 const char *id)
+{
+    if (submitted != cp->submitted)
+        return submitted < cp->submitted;
+
+    for (unsigned int i = 0; i < cp->nids; i++)
+        if (strcmp(cp->ids[i], id) == 0)
+            return true;
+
+    return false;
+}
+
+static void copy_token(char *dst, const size_t size, const char *js,
+                       const jsmntok_t *tok)
+{
+    size_t len = tok->end - tok->start;
+    if (len >= size)
+        len = size - 1;
+    memcpy(dst, js + tok->start, len);
+    dst[len] = '\0';
+}
+
+/*
+ * Whether the run is pending already, a submission during the poll shifts the
+ * pages so that the last run of a page is also the first of the next one
+ */
+static bool is_pending(const pending_t *pending, size_t npending,
+                       const pending_t *run)
+{
+    while (npending-- > 0 && pending[npending].submitted == run->submitted)
+        if (strcmp(pending[npending].id, run->id) == 0)
+            return true;
+    return false;
+}
+
+bool watch_poll(const char *game, checkpoint_t *cp, const char *cpfile)
+{
+    pending_t *pending = NULL;
+    size_t npending = 0, cap = 0;
+    bool ok = true;
+
+    /*
+     * The pages and the copies of the pending runs live until the end of the
+     * poll, everything allocated while checking a run only until the next run
+     */
+    static arena_t poll_arena, run_arena;
+
+    /* Newest first, until the first run the checkpoint has already covered */
+    for (size_t offset = 0;; offset += WATCH_PAGE) {
+        char uri[1024];
+        snprintf(uri, sizeof(uri),
+                 "%s/runs?game=%s&status=new&orderby=submitted"
+                 "&direction=desc&max=%d&offset=%zu",
+                 api_uri(), game, WATCH_PAGE, offset);
+
+        string_t page;
+        init_string(&page, &poll_arena);
+        if (!dl_uri(uri, &page, &poll_arena)) {
+            ok = false;
+            break;
+        }
+
+        jsmntok_t *tokens = NULL;
+        const int ntokens = json_tokenize(page.ptr, page.len, &tokens,
+                                          &poll_arena);
+        const int data = ntokens > 0 ? json_get(page.ptr, tokens, 0, "data")
+                                     : -1;
+        if (data == -1 || tokens[data].type != JSMN_ARRAY) {
+            fprintf(stderr, "drun: invalid runs listing from %s\n", uri);
+            ok = false;
+            break;
+        }
+
+        bool done = tokens[data].size < WATCH_PAGE;
+        for (int i = data + 1, n = 0; n < tokens[data].size;
+             n++, i = json_skip(tokens, i)) {
+            const int id = json_get(page.ptr, tokens, i, "id"),
+                      date = json_get(page.ptr, tokens, i, "submitted");
+            if (id == -1)
+                continue;
+
+            pending_t run = {0};
+            copy_token(run.id, sizeof(run.id), page.ptr, &tokens[id]);
+            if (date != -1 && tokens[date].type == JSMN_STRING)
+                run.submitted = meta_date(page.ptr + tokens[date].start,
+                                          tokens[date].end
+                                              - tokens[date].start);
+
+            if (seen(cp, run.submitted, run.id)) {
+                if (run.submitted < cp->submitted) {
+                    done = true;
+                    break;
+                }
+                continue;
+            }
+            if (is_pending(pending, npending, &run))
+                continue;
+
+            /* Keep a copy of the run object to check it later */
+            run.len = tokens[i].end - tokens[i].start;
+            run.json = arena_strndup(&poll_arena, page.ptr + tokens[i].start,
+                                     run.len);
+            if (npending == cap) {
+                cap = cap ? cap * 2 : 16;
+                pending = xrealloc(pending, sizeof(pending_t) * cap);
+            }
+            pending[npending++] = run;
+        }
+
+        if (done)
+            break;
+    }
+
+    /* Older runs may be on the page that failed, try them all next poll */
+    if (!ok) {
+        fputs("drun: poll failed, retrying after the interval\n", stderr);
+        npending = 0;
+    }
+
+    /* Oldest first, so the checkpoint only ever moves forward */
+    for (size_t i = npending; i-- > 0;) {
+        run_t run = {.arena = &run_arena};
+        run.json.ptr = pending[i].json;
+        run.json.len = pending[i].len;
+        run.id = pending[i].id;
+
+        printf("https://www.speedrun.com/run/%s\n", run.id);
+        check_run(&run);
+        fflush(stdout);
+
+        if (pending[i].submitted > cp->submitted) {
+            cp->submitted = pending[i].submitted;
+            cp->nids = 0;
+        }
+        strcpy(new_id(cp), pending[i].id);
+        cp->nids++;
+        save_checkpoint(cp, cpfile);
+        arena_reset(&run_arena);
+    }
+
+    arena_reset(&poll_arena);
+    free(pending);
+    return ok;
+}
+
+bool watch(const char *game, const unsigned int interval)
+{
+    char dir[2048], cpfile[4096];
+    snprintf(dir, sizeof(dir), "%s/watch", data_dir());
+    snprintf(cpfile, sizeof(cpfile), "%s/%s", dir, game);
+
+    struct stat st = {0};
+    if (stat(dir, &st) == -1) {
+        if (mkdir(dir, 0777) == -1) {
+            perror("drun");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    checkpoint_t cp;
+    load_checkpoint(&cp, cpfile);
+
+    for (;;) {
+        const bool ok = watch_poll(game, &cp, cpfile);
+        metrics_flush();
+        if (interval == 0) {
+            free(cp.ids);
+            return ok;
+        }
+        sleep(interval);
+    }
+}
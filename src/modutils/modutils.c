@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modutils.h"
+
+/**
+ * @brief A tool of the multicall binary
+ *
+ * @param name The name the tool is called by
+ * @param main The main() of the tool
+ */
+typedef struct {
+    const char *name;
+    int (*main)(int argc, char **argv);
+} tool_t;
+
+static const tool_t tools[] = {
+    {"drun", drun_main},
+    {"retime", retime_main},
+};
+
+static const tool_t *find_tool(const char *name)
+{
+    for (size_t i = 0; i < sizeof(tools) / sizeof(*tools); i++)
+        if (strcmp(tools[i].name, name) == 0)
+            return &tools[i];
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    /* Called through a link named after a tool, e.g. /usr/local/bin/drun */
+    const char *name = strrchr(argv[0], '/');
+    const tool_t *tool = find_tool(name != NULL ? name + 1 : argv[0]);
+    if (tool != NULL)
+        return tool->main(argc, argv);
+
+    /* Or with the tool as the first argument, which it sees as its name */
+    if (argc > 1 && (tool = find_tool(argv[1])) != NULL)
+        return tool->main(argc - 1, argv + 1);
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        puts(MODUTILS_VERSION_MSG);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && strcmp(argv[1], "-h") != 0) {
+        fprintf(stderr,
+                "modutils: unknown tool '%s' \nTry 'modutils -h' for more "
+                "information.\n",
+                argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    puts(MODUTILS_HELP_MSG);
+    return argc > 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
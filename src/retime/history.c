@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#    include <direct.h>
+#    define mkdir(path, mode) _mkdir(path)
+#endif
+#include "alloc.h"
+#include "history.h"
+#include "util.h"
+
+static uint64_t hash_video(const char *video)
+{
+    return hash(video, strlen(video));
+}
+
+/* Copy a field of a line, tabs and newlines would end it early */
+static void clean(const char *field, char *out, const size_t size)
+{
+    size_t i = 0;
+    for (; field[i] != '\0' && i + 1 < size; i++)
+        out[i] = field[i] == '\t' || field[i] == '\n' ? ' ' : field[i];
+    out[i] = '\0';
+}
+
+/*
+ * Copy the video into the key it is logged under, if it fits. A key that was
+ * cut would never be found again.
+ */
+static bool video_key(const char *video, char key[HISTORY_VIDEO])
+{
+    if (strlen(video) >= HISTORY_VIDEO)
+        return false;
+    clean(video, key, HISTORY_VIDEO);
+    return true;
+}
+
+/* Get the directory of the history, creating it and its parents if needed */
+static bool history_dir(char *dir, const size_t size)
+{
+#ifdef _WIN32
+    const char *home = getenv("APPDATA");
+    const char *sub = "\\retime";
+#else
+    const char *home = getenv("HOME");
+    const char *sub = "/.local/share/retime";
+#endif
+    if (home == NULL || home[0] == '\0')
+        return false;
+
+    const size_t len = strlen(home);
+    snprintf(dir, size, "%s%s", home, sub);
+    for (char *c = dir + len + 1;; c++) {
+        if (*c != '/' && *c != '\\' && *c != '\0')
+            continue;
+
+        const char end = *c;
+        *c = '\0';
+        if (mkdir(dir, 0777) == -1 && errno != EEXIST)
+            return false;
+        *c = end;
+        if (end == '\0')
+            return true;
+    }
+}
+
+static void push(history_t *history, const hist_entry_t entry)
+{
+    if (history->n == history->cap) {
+        history->cap = history->cap ? history->cap * 2 : 256;
+        history->entries = xrealloc(history->entries,
+                                    sizeof(hist_entry_t) * history->cap);
+    }
+    history->entries[history->n++] = entry;
+}
+
+/* Hash the video of a line, which is cut at the first tab */
+static uint64_t hash_line(char *line)
+{
+    line[strcspn(line, "\t\n")] = '\0';
+    return hash_video(line);
+}
+
+/* Index the complete lines of the log from `off` on */
+static void index_from(history_t *history, long off)
+{
+    char line[HISTORY_LINE];
+    fseek(history->log, off, SEEK_SET);
+    while (fgets(line, sizeof(line), history->log) != NULL) {
+        const size_t len = strlen(line);
+        if (line[len - 1] != '\n')
+            break;
+
+        const hist_entry_t entry = {hash_line(line), off};
+        push(history, entry);
+        fwrite(&entry, sizeof(entry), 1, history->idx);
+        off += len;
+    }
+    fflush(history->idx);
+}
+
+bool history_open(history_t *history)
+{
+    memset(history, 0, sizeof(*history));
+    char dir[1024], path[1100];
+    if (!history_dir(dir, sizeof(dir)))
+        return false;
+
+    snprintf(path, sizeof(path), "%s/history", dir);
+    if ((history->log = fopen(path, "a+b")) == NULL)
+        return false;
+    fseek(history->log, 0, SEEK_END);
+    const long size = ftell(history->log);
+
+    /* The index is trusted as far as its last entry matches the log */
+    snprintf(path, sizeof(path), "%s/history.idx", dir);
+    FILE *idx = fopen(path, "rb");
+    hist_entry_t entry;
+    while (idx != NULL && fread(&entry, sizeof(entry), 1, idx) == 1)
+        push(history, entry);
+    const bool torn = idx != NULL && fgetc(idx) != EOF;
+    if (idx != NULL)
+        fclose(idx);
+
+    long indexed = 0;
+    char line[HISTORY_LINE];
+    if (history->n > 0) {
+        const hist_entry_t *last = &history->entries[history->n - 1];
+        if (!torn && last->off < (uint64_t) size
+            && fseek(history->log, last->off, SEEK_SET) == 0
+            && fgets(line, sizeof(line), history->log) != NULL
+            && line[strlen(line) - 1] == '\n')
+            indexed = last->off + strlen(line);
+        if (indexed == 0 || hash_line(line) != last->hash)
+            history->n = 0, indexed = 0;
+    }
+
+    history->idx = fopen(path, indexed > 0 ? "ab" : "wb");
+    if (history->idx == NULL) {
+        history_close(history);
+        return false;
+    }
+    index_from(history, indexed);
+    return true;
+}
+
+bool history_find(history_t *history, const char *video, char *note,
+                  const size_t size)
+{
+    char key[HISTORY_VIDEO];
+    if (history->log == NULL || !video_key(video, key))
+        return false;
+
+    const uint64_t hash = hash_video(key);
+    for (size_t i = history->n; i-- > 0;) {
+        char line[HISTORY_LINE];
+        if (history->entries[i].hash != hash
+            || fseek(history->log, history->entries[i].off, SEEK_SET) != 0
+            || fgets(line, sizeof(line), history->log) == NULL)
+            continue;
+
+        /* Different videos can have the same hash */
+        char *field = line;
+        const size_t len = strcspn(line, "\t");
+        if (len != strlen(key) || strncmp(line, key, len) != 0)
+            continue;
+
+        /* The note is the sixth field */
+        for (int tabs = 0; field != NULL && tabs < 5; tabs++)
+            if ((field = strchr(field, '\t')) != NULL)
+                field++;
+        if (field == NULL)
+            continue;
+        field[strcspn(field, "\n")] = '\0';
+        snprintf(note, size, "%s", field);
+        return true;
+    }
+    return false;
+}
+
+void history_add(history_t *history, const retime_t *retime)
+{
+    if (history->log == NULL)
+        return;
+
+    char video[HISTORY_VIDEO], note[HISTORY_LINE / 4];
+    if (!video_key(retime->video, video)) {
+        fputs("retime: the video name is too long to keep the retime\n",
+              stderr);
+        return;
+    }
+    clean(retime->note, note, sizeof(note));
+
+    /* A line left incomplete by a crash is ended first */
+    fseek(history->log, 0, SEEK_END);
+    long off = ftell(history->log);
+    if (off > 0) {
+        fseek(history->log, off - 1, SEEK_SET);
+        const bool ended = fgetc(history->log) == '\n';
+        fseek(history->log, 0, SEEK_END);
+        if (!ended) {
+            fputc('\n', history->log);
+            off++;
+        }
+    }
+
+    fprintf(history->log, "%s\t%lu\t%lu\t%s\t%s\t%s\n", video, retime->start,
+            retime->end, retime->fps, retime->time, note);
+    if (fflush(history->log) == EOF) {
+        perror("retime");
+        return;
+    }
+
+    const hist_entry_t entry = {hash_video(video), off};
+    push(history, entry);
+    fwrite(&entry, sizeof(entry), 1, history->idx);
+    if (fflush(history->idx) == EOF)
+        perror("retime");
+}
+
+void history_close(history_t *history)
+{
+    if (history->log != NULL)
+        fclose(history->log);
+    if (history->idx != NULL)
+        fclose(history->idx);
+    free(history->entries);
+    memset(history, 0, sizeof(*history));
+}
@@ -0,0 +1,7 @@
+#include "modutils.h"
+
+/* retime on its own, see modutils.c for the multicall binary */
+int main(int argc, char **argv)
+{
+    return retime_main(argc, argv);
+}
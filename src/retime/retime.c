@@ -11,18 +11,15 @@
 #ifdef _WIN32
 #    include "getline.h"
 #endif
-#include "jsmn.h"
+#include "alloc.h"
+#include "arena.h"
+#include "history.h"
+#include "json.h"
 #include "retime.h"
+#include "video.h"
 
-void *smalloc(const size_t size)
-{
-    void *ret = malloc(size);
-    if (ret == NULL) {
-        fputs("Allocation error\n", stderr);
-        exit(EXIT_FAILURE);
-    }
-    return ret;
-}
+/* Every retime is kept, unless -n was given */
+static history_t history;
 
 double str_to_double(const char *str_time)
 {
@@ -62,7 +59,7 @@ INVALID_FPS:
     exit(BAD_FPS);
 }
 
-double get_time(void)
+double get_time(char *video, const size_t video_size)
 {
     char *string = NULL;
     size_t size = 0;
@@ -74,55 +71,36 @@ double get_time(void)
         exit(EXIT_FAILURE);
     }
 
-    jsmn_parser parser;
-    jsmn_init(&parser);
-
-    /* Parse the JSON */
-#define TOKBUF 1024
-    jsmntok_t tokens[TOKBUF];
-    if (tokens == NULL) {
-        fputs("Allocation error\n", stderr);
-        exit(EXIT_FAILURE);
-    }
-    int ret = jsmn_parse(&parser, string, strlen(string), tokens, TOKBUF);
-
-#define JSON_ERR(STR)                                                          \
-    fputs(STR, stderr);                                                        \
-    free(string);                                                              \
-    exit(EXIT_FAILURE);
-
-    switch (ret) {
-    case JSMN_ERROR_INVAL:
-        JSON_ERR("bad token, JSON string is corrupted\n");
-    case JSMN_ERROR_NOMEM:
-        JSON_ERR("not enough tokens, JSON string is too large\n");
-    case JSMN_ERROR_PART:
-        JSON_ERR("JSON string is too short, expecting more JSON data\n");
-    }
-
-    /* Find the value of "cmt" */
-    for (int i = 0; i < ret; i++) {
-        if (tokens[i].type == JSMN_STRING) {
-            int start = tokens[i].start, end = tokens[i].end;
-            if (strncmp(&string[start], "cmt", end - start) == 0) {
-                char *time = smalloc(end - start + 1);
-                start = tokens[i + 1].start, end = tokens[i + 1].end;
-                strncpy(time, &string[start], end - start);
-                time[end - start] = '\0';
-
-                free(string);
-                return str_to_double(time);
-            }
-        }
-    }
-
-    return -1;
+    /* Parse the JSON, with as many tokens as it has */
+    arena_t arena = {0};
+    jsmntok_t *tokens;
+    const int ret = json_tokenize(string, strlen(string), &tokens, &arena);
+    json_check(ret);
+
+    /* Find the value of "cmt", and the video the debug info is of */
+    double time = -1;
+    const int cmt = ret > 0 ? json_get(string, tokens, 0, "cmt") : -1;
+    if (cmt != -1)
+        time = str_to_double(arena_strndup(&arena, string + tokens[cmt].start,
+                                           tokens[cmt].end - tokens[cmt].start));
+
+    int id = ret > 0 ? json_get(string, tokens, 0, "debug_videoId") : -1;
+    if (id == -1 && ret > 0)
+        id = json_get(string, tokens, 0, "docid");
+    video[0] = '\0';
+    if (id != -1 && tokens[id].type == JSMN_STRING)
+        snprintf(video, video_size, "%.*s", tokens[id].end - tokens[id].start,
+                 string + tokens[id].start);
+
+    arena_free(&arena);
+    free(string);
+    return time;
 }
 
 char *format_time(const double time)
 {
 #define FTIME_BUF 32
-    char *formatted_time = smalloc(FTIME_BUF);
+    char *formatted_time = xmalloc(FTIME_BUF);
     const unsigned int hours = time / 3600,
                        minutes = fmod(time, (double) 3600) / 60,
                        seconds = fmod(time, (double) 60),
@@ -143,13 +121,140 @@ char *format_time(const double time)
     return formatted_time;
 }
 
-int main(int argc, char **argv)
+size_t get_position(const video_t *video, const char *prompt)
+{
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t read;
+
+    fputs(prompt, stderr);
+    if ((read = getline(&line, &size, stdin)) == -1) {
+        free(line);
+        if (feof(stdin))
+            exit(EXIT_SUCCESS);
+
+        perror("retime");
+        exit(EXIT_FAILURE);
+    }
+    while (read > 0 && (line[read - 1] == '\n' || line[read - 1] == '\r'))
+        line[--read] = '\0';
+
+    bool timestamp = false;
+    for (ssize_t i = 0; i < read; i++) {
+        if (line[i] == ':' || line[i] == '.')
+            timestamp = true;
+        else if (!isdigit(line[i]))
+            goto INVALID_POSITION;
+    }
+    if (read == 0)
+        goto INVALID_POSITION;
+
+    size_t frame;
+    if (timestamp) {
+        /* [[HH:]MM:]SS[.mmm] */
+        double seconds = 0;
+        for (char *part = strtok(line, ":"); part; part = strtok(NULL, ":"))
+            seconds = seconds * 60 + str_to_double(part);
+        frame = video_frame_at(video, seconds);
+    } else {
+        frame = strtoul(line, NULL, 10);
+        if (frame > video->frames)
+            goto INVALID_POSITION;
+    }
+
+    free(line);
+    return frame;
+
+INVALID_POSITION:
+    fprintf(stderr,
+            "retime: '%s' is not a frame number from 0 to %lu or a "
+            "timestamp\n",
+            line, (unsigned long) video->frames);
+    free(line);
+    exit(BAD_VIDEO);
+}
+
+/*
+ * The key of a local file in the history, its absolute path, as the same file
+ * can be given by many relative paths and different files by the same one
+ */
+static char *file_key(const char *path)
+{
+#ifdef _WIN32
+    char *key = _fullpath(NULL, path, 0);
+#else
+    char *key = realpath(path, NULL);
+#endif
+    if (key == NULL) {
+        perror("retime");
+        exit(BAD_VIDEO);
+    }
+    return key;
+}
+
+void retime_file(const char *path, const bool bflag, const bool mflag)
 {
-    bool bflag = false, mflag = false;
+    video_t video;
+    video_open(&video, path);
+
+    /* Common framerates like 59.94 are not whole numbers */
+    char fps[16];
+    const double exact_fps = video_fps(&video);
+    if (fabs(exact_fps - round(exact_fps)) < 0.005)
+        snprintf(fps, sizeof(fps), "%.0f", exact_fps);
+    else
+        snprintf(fps, sizeof(fps), "%.2f", exact_fps);
+
+    fprintf(stderr, "%lu frames, %s FPS%s\n", (unsigned long) video.frames,
+            fps, video.vfr ? " (variable framerate)" : "");
+
+    char *key = file_key(path), prior[HISTORY_LINE];
+    if (history_find(&history, key, prior, sizeof(prior)))
+        fprintf(stderr, "Retimed before: %s\n", prior);
+
+    do {
+        const size_t start = get_position(
+                         &video, "Start of the run (frame or timestamp): "),
+                     end = get_position(
+                         &video, "End of the run (frame or timestamp): ");
+        if (end < start) {
+            fputs("retime: the run ends before it starts\n", stderr);
+            exit(BAD_VIDEO);
+        }
+
+        const double duration = video_frame_time(&video, end)
+                                - video_frame_time(&video, start);
+        char *formatted_duration = format_time(duration);
+
+        char note[NOTE_BUF];
+        snprintf(note, sizeof(note),
+                 "Mod Note: Retimed (Start: Frame %lu, End: Frame %lu, FPS: "
+                 "%s, Total Time: %s)",
+                 (unsigned long) start, (unsigned long) end, fps,
+                 formatted_duration);
+        if (mflag)
+            puts(note);
+        else
+            printf("Final Time: %s\n", formatted_duration);
+
+        const retime_t retime = {key, start, end, fps, formatted_duration,
+                                 note};
+        history_add(&history, &retime);
+        free(formatted_duration);
+    } while (bflag);
+
+    free(key);
+    video_close(&video);
+}
+
+int retime_main(int argc, char **argv)
+{
+    bool bflag = false, mflag = false, nflag = false;
     unsigned int fps = 0;
+    const char *video = NULL;
 
     int opt;
-    while ((opt = getopt(argc, argv, ":bf:mhv")) != -1) {
+    while ((opt = getopt(argc, argv, ":bf:i:mnhv")) != -1) {
         switch (opt) {
         case 'b':
             bflag = true;
@@ -157,9 +262,15 @@ int main(int argc, char **argv)
         case 'f':
             fps = check_fps(optarg);
             break;
+        case 'i':
+            video = optarg;
+            break;
         case 'm':
             mflag = true;
             break;
+        case 'n':
+            nflag = true;
+            break;
         case 'h':
             fputs(HELP_MSG, stderr);
             return EXIT_SUCCESS;
@@ -173,6 +284,12 @@ int main(int argc, char **argv)
                       stderr);
                 return BAD_FPS;
             }
+            if (optopt == 'i') {
+                fputs("retime: option requires an argument -- 'i'\nTry "
+                      "'retime -h' for more information\n",
+                      stderr);
+                return BAD_FLAG;
+            }
 
             fprintf(stderr,
                     "retime: invalid option -- '%c'\nTry 'retime -h' for "
@@ -182,6 +299,16 @@ int main(int argc, char **argv)
         }
     }
 
+    if (!nflag)
+        history_open(&history);
+
+    /* The framerate and frame times come from the file itself */
+    if (video != NULL) {
+        retime_file(video, bflag, mflag);
+        history_close(&history);
+        return EXIT_SUCCESS;
+    }
+
 LOOP:
     if (!fps) {
         char *fpsstr = NULL;
@@ -205,10 +332,15 @@ LOOP:
     }
 
     /* Prompt the user for the start and end of the run */
+    char id[64], end_id[64], prior[HISTORY_LINE];
     puts("Paste the debug info of the start of the run:");
-    const unsigned int start_time = get_time() * fps / 1;
+    const unsigned int start_time = get_time(id, sizeof(id)) * fps / 1;
+    const bool retimed =
+        id[0] != '\0' && history_find(&history, id, prior, sizeof(prior));
+    if (retimed)
+        printf("Retimed before: %s\n", prior);
     puts("Paste the debug info of the end of the run:");
-    const unsigned int end_time = get_time() * fps / 1;
+    const unsigned int end_time = get_time(end_id, sizeof(end_id)) * fps / 1;
 
     /* Clear the screen */
     write(STDOUT_FILENO, "\x1b[2J", 4);
@@ -217,14 +349,28 @@ LOOP:
     const double duration = (end_time - start_time) / (double) fps;
     char *formatted_duration = format_time(duration);
 
+    char note[NOTE_BUF];
+    snprintf(note, sizeof(note),
+             "Mod Note: Retimed (Start: Frame %u, End: Frame %u, FPS: %u, "
+             "Total Time: %s)",
+             start_time, end_time, fps, formatted_duration);
     if (mflag)
-        printf("Mod Note: Retimed (Start: Frame %u, End: Frame %u, FPS: "
-               "%u, "
-               "Total Time: %s)\n",
-               start_time, end_time, fps, formatted_duration);
+        puts(note);
     else
         printf("Final Time: %s\n", formatted_duration);
 
+    /* The screen was cleared, so the last retime is shown again */
+    if (retimed)
+        printf("Retimed before: %s\n", prior);
+
+    /* Debug info without a video ID can't be looked up again */
+    if (id[0] != '\0') {
+        char fps_str[16];
+        snprintf(fps_str, sizeof(fps_str), "%u", fps);
+        const retime_t retime = {id, start_time, end_time, fps_str,
+                                 formatted_duration, note};
+        history_add(&history, &retime);
+    }
     free(formatted_duration);
 
     /* Loop when bulk_retime is true */
@@ -234,5 +380,6 @@ LOOP:
         goto LOOP;
     }
 
+    history_close(&history);
     return EXIT_SUCCESS;
 }
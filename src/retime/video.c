@@ -0,0 +1,382 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 700
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "alloc.h"
+#include "retime.h"
+#include "video.h"
+
+/* A box or the unread part of one */
+typedef struct {
+    const uint8_t *ptr;
+    size_t len;
+} buf_t;
+
+/* The video track while its sample tables are being read */
+typedef struct {
+    uint32_t id;
+    uint32_t timescale;
+    uint32_t default_duration;
+    uint64_t next_dts;
+    int64_t *pts;
+    size_t n, cap;
+    uint64_t duration;
+    uint32_t first_duration, last_duration;
+    bool reordered, vfr;
+} track_t;
+
+static void bad_video(const char *msg)
+{
+    fprintf(stderr, "retime: %s\n", msg);
+    exit(BAD_VIDEO);
+}
+
+static uint64_t get(buf_t *buf, const unsigned int bytes)
+{
+    if (buf->len < bytes)
+        bad_video("truncated box in video file");
+
+    uint64_t ret = 0;
+    for (unsigned int i = 0; i < bytes; i++)
+        ret = ret << 8 | buf->ptr[i];
+    buf->ptr += bytes, buf->len -= bytes;
+    return ret;
+}
+
+/* Split the next box off the front of `buf`, returns false at the end */
+static bool next_box(buf_t *buf, const char **type, buf_t *payload)
+{
+    if (buf->len < 8)
+        return false;
+
+    buf_t hdr = *buf;
+    uint64_t size = get(&hdr, 4);
+    *type = (const char *) hdr.ptr;
+    get(&hdr, 4);
+
+    if (size == 1) {
+        if (hdr.len < 8)
+            return false;
+        size = get(&hdr, 8);
+    } else if (size == 0) {
+        size = buf->len;
+    }
+
+    const size_t hdrlen = buf->len - hdr.len;
+    if (size < hdrlen || size > buf->len)
+        bad_video("invalid box size in video file");
+
+    payload->ptr = buf->ptr + hdrlen;
+    payload->len = size - hdrlen;
+    buf->ptr += size, buf->len -= size;
+    return true;
+}
+
+static bool find_box(buf_t buf, const char *type, buf_t *payload)
+{
+    const char *t;
+    while (next_box(&buf, &t, payload))
+        if (memcmp(t, type, 4) == 0)
+            return true;
+    return false;
+}
+
+static void push(track_t *track, const int64_t pts, const uint32_t duration)
+{
+    if (track->n == track->cap) {
+        track->cap = track->cap ? track->cap * 2 : 4096;
+        track->pts = xrealloc(track->pts, sizeof(int64_t) * track->cap);
+    }
+
+    /* Only the last frame may have a different duration in constant FPS */
+    if (track->n == 0)
+        track->first_duration = duration;
+    else if (track->last_duration != track->first_duration)
+        track->vfr = true;
+    if (track->n > 0 && pts < track->pts[track->n - 1])
+        track->reordered = true;
+
+    track->pts[track->n++] = pts;
+    track->last_duration = duration;
+    track->duration += duration;
+}
+
+/* Read the sample tables of a non-fragmented track */
+static void read_stbl(track_t *track, buf_t stbl)
+{
+    buf_t stts, ctts = {NULL, 0};
+    if (!find_box(stbl, "stts", &stts))
+        bad_video("video track has no sample timestamps");
+
+    bool has_ctts = find_box(stbl, "ctts", &ctts);
+    uint32_t ctts_left = 0;
+    int32_t offset = 0;
+    if (has_ctts) {
+        get(&ctts, 4);
+        get(&ctts, 4);
+    }
+
+    get(&stts, 4);
+    for (uint32_t entries = get(&stts, 4); entries > 0; entries--) {
+        const uint32_t count = get(&stts, 4), delta = get(&stts, 4);
+        for (uint32_t i = 0; i < count; i++) {
+            /* Composition offsets are run length encoded too */
+            if (has_ctts && ctts_left == 0 && ctts.len >= 8) {
+                ctts_left = get(&ctts, 4);
+                offset = (int32_t) get(&ctts, 4);
+            }
+            if (ctts_left > 0)
+                ctts_left--;
+
+            push(track, (int64_t) track->next_dts + offset, delta);
+            track->next_dts += delta;
+        }
+    }
+}
+
+/* Read the track fragments of the video track in a moof box */
+static void read_moof(track_t *track, buf_t moof)
+{
+    const char *type;
+    buf_t traf;
+    while (next_box(&moof, &type, &traf)) {
+        if (memcmp(type, "traf", 4) != 0)
+            continue;
+
+        buf_t tfhd, tfdt, box;
+        if (!find_box(traf, "tfhd", &tfhd))
+            continue;
+        const uint32_t tfhd_flags = get(&tfhd, 4) & 0xffffff;
+        if (get(&tfhd, 4) != track->id)
+            continue;
+
+        uint32_t default_duration = track->default_duration;
+        if (tfhd_flags & 0x01)
+            get(&tfhd, 8);
+        if (tfhd_flags & 0x02)
+            get(&tfhd, 4);
+        if (tfhd_flags & 0x08)
+            default_duration = get(&tfhd, 4);
+
+        if (find_box(traf, "tfdt", &tfdt))
+            track->next_dts = get(&tfdt, 4) >> 24 == 1 ? get(&tfdt, 8)
+                                                       : get(&tfdt, 4);
+
+        while (next_box(&traf, &type, &box)) {
+            if (memcmp(type, "trun", 4) != 0)
+                continue;
+
+            const uint32_t flags = get(&box, 4) & 0xffffff;
+            uint32_t count = get(&box, 4);
+            if (flags & 0x001)
+                get(&box, 4);
+            if (flags & 0x004)
+                get(&box, 4);
+
+            for (; count > 0; count--) {
+                uint32_t duration = default_duration;
+                int32_t offset = 0;
+                if (flags & 0x100)
+                    duration = get(&box, 4);
+                if (flags & 0x200)
+                    get(&box, 4);
+                if (flags & 0x400)
+                    get(&box, 4);
+                if (flags & 0x800)
+                    offset = (int32_t) get(&box, 4);
+
+                push(track, (int64_t) track->next_dts + offset, duration);
+                track->next_dts += duration;
+            }
+        }
+    }
+}
+
+/* Find the first video track and read its sample tables */
+static bool read_moov(track_t *track, const buf_t moov)
+{
+    const char *type;
+    buf_t children = moov, trak, box, mdia, stbl;
+    while (next_box(&children, &type, &trak)) {
+        if (memcmp(type, "trak", 4) != 0 || !find_box(trak, "mdia", &mdia))
+            continue;
+
+        /* The handler type comes after the version, flags and pre_defined */
+        if (!find_box(mdia, "hdlr", &box) || box.len < 12
+            || memcmp(box.ptr + 8, "vide", 4) != 0)
+            continue;
+
+        if (!find_box(mdia, "mdhd", &box))
+            bad_video("video track has no timescale");
+        const bool v1 = get(&box, 4) >> 24 == 1;
+        get(&box, v1 ? 16 : 8);
+        track->timescale = get(&box, 4);
+
+        if (find_box(trak, "tkhd", &box)) {
+            get(&box, get(&box, 4) >> 24 == 1 ? 16 : 8);
+            track->id = get(&box, 4);
+        }
+
+        if (find_box(mdia, "minf", &box) && find_box(box, "stbl", &stbl))
+            read_stbl(track, stbl);
+        break;
+    }
+
+    if (track->timescale == 0)
+        return false;
+
+    /* The default sample duration of the fragments of the track */
+    buf_t mvex;
+    if (find_box(moov, "mvex", &mvex)) {
+        while (next_box(&mvex, &type, &box)) {
+            if (memcmp(type, "trex", 4) != 0)
+                continue;
+            get(&box, 4);
+            if (get(&box, 4) == track->id) {
+                get(&box, 4);
+                track->default_duration = get(&box, 4);
+            }
+        }
+    }
+
+    return true;
+}
+
+static int cmp_pts(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+void video_open(video_t *video, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror("retime");
+        exit(BAD_VIDEO);
+    }
+
+    /* Box sizes are checked against it before anything is allocated */
+    struct stat st;
+    if (fstat(fileno(fp), &st) == -1) {
+        perror("retime");
+        exit(BAD_VIDEO);
+    }
+
+    track_t track;
+    memset(&track, 0, sizeof(track));
+
+    /*
+     * Walk the top level boxes, only reading the ones holding sample tables
+     * and seeking over everything else, including all media data
+     */
+    uint8_t hdr[16];
+    while (fread(hdr, 1, 8, fp) == 8) {
+        uint64_t size = (uint64_t) hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8
+                        | hdr[3];
+        unsigned int hdrlen = 8;
+        if (size == 1) {
+            if (fread(hdr + 8, 1, 8, fp) != 8)
+                break;
+            size = 0;
+            for (int i = 8; i < 16; i++)
+                size = size << 8 | hdr[i];
+            hdrlen = 16;
+        }
+
+        /* A box of size 0 runs to the end of the file */
+        const off_t left = st.st_size - ftello(fp);
+        const bool moov = memcmp(hdr + 4, "moov", 4) == 0,
+                   moof = memcmp(hdr + 4, "moof", 4) == 0;
+        if (size == 0)
+            size = hdrlen + left;
+        if (size < hdrlen)
+            bad_video("invalid box size in video file");
+
+        if (!moov && !moof) {
+            if (fseeko(fp, (off_t) (size - hdrlen), SEEK_CUR) == -1)
+                break;
+            continue;
+        }
+
+        if (size - hdrlen > (uint64_t) left)
+            bad_video("truncated video file");
+        buf_t buf = {NULL, size - hdrlen};
+        uint8_t *data = xmalloc(buf.len);
+        if (fread(data, 1, buf.len, fp) != buf.len)
+            bad_video("truncated video file");
+        buf.ptr = data;
+
+        if (moov) {
+            if (!read_moov(&track, buf))
+                bad_video("no video track found");
+        } else if (track.timescale != 0) {
+            read_moof(&track, buf);
+        }
+        free(data);
+    }
+    fclose(fp);
+
+    if (track.timescale == 0)
+        bad_video("not an MP4 or QuickTime file, or no video track found");
+    if (track.n == 0)
+        bad_video("video track has no frames");
+
+    /* With B-frames the decoding order differs from the display order */
+    if (track.reordered)
+        qsort(track.pts, track.n, sizeof(int64_t), cmp_pts);
+
+    video->pts = (uint64_t *) track.pts;
+    for (size_t i = track.n; i-- > 0;)
+        video->pts[i] = track.pts[i] - track.pts[0];
+    video->frames = track.n;
+    video->timescale = track.timescale;
+    video->duration = track.duration;
+    video->vfr = track.vfr;
+}
+
+double video_fps(const video_t *video)
+{
+    if (video->duration == 0)
+        return 0;
+    return (double) video->frames * video->timescale / video->duration;
+}
+
+size_t video_frame_at(const video_t *video, const double seconds)
+{
+    const double target = round(seconds * video->timescale);
+    if (target <= 0)
+        return 0;
+
+    /* The last frame that starts at or before the target */
+    size_t lo = 0, hi = video->frames;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if ((double) video->pts[mid] <= target)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+double video_frame_time(const video_t *video, const size_t frame)
+{
+    if (frame >= video->frames)
+        return (double) video->duration / video->timescale;
+    return (double) video->pts[frame] / video->timescale;
+}
+
+void video_close(video_t *video)
+{
+    free(video->pts);
+    video->pts = NULL;
+    video->frames = 0;
+}
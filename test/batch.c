@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "pipeline.h"
+
+/*
+ * Tests of the join of a batch, with the download pipeline, the database and
+ * the report of the runs replaced by the tables below
+ */
+
+#define MAX_VIDEOS 2
+
+/* The lines of the database, in the order they were added */
+static const char *const db_lines[] = {
+    "https://www.youtube.com/watch?v=AAAAAAAAAA0 "
+    "https://www.speedrun.com/run/old00001",
+    "https://youtu.be/AAAAAAAAAA0 https://www.speedrun.com/run/old00002",
+    "https://www.twitch.tv/videos/111 https://www.speedrun.com/run/old00003",
+    "https://youtu.be/BBBBBBBBBB0 https://www.speedrun.com/run/old00004",
+    "https://youtu.be/DDDDDDDDDD0 https://www.speedrun.com/run/old00005",
+    "not-a-line-of-the-database",
+};
+
+/*
+ * The runs of the batch with their canonical videos, whether their first one
+ * is on the blocklist, and the line each video should be found in
+ */
+static const struct {
+    const char *id;
+    const char *vids[MAX_VIDEOS];
+    bool blocked;
+    const char *found[MAX_VIDEOS];
+} runs[] = {
+    /* Of two lines of the video, the one added last */
+    {"new00001", {"https://youtu.be/AAAAAAAAAA0"}, false,
+     {"https://youtu.be/AAAAAAAAAA0 https://www.speedrun.com/run/old00002\n"}},
+    {"new00002", {"https://youtu.be/CCCCCCCCCC0"}, false, {NULL}},
+    /* Added by the run before, after the database was read */
+    {"new00003", {"https://vimeo.com/5", "https://youtu.be/CCCCCCCCCC0"}, false,
+     {NULL,
+      "https://youtu.be/CCCCCCCCCC0 https://www.speedrun.com/run/new00002\n"}},
+    {"new00004", {"https://www.twitch.tv/videos/111"}, true,
+     {"https://www.twitch.tv/videos/111 "
+      "https://www.speedrun.com/run/old00003\n"}},
+    /* In an earlier run, which was not added as it was a duplicate */
+    {"new00005", {"https://vimeo.com/5", "https://youtu.be/BBBBBBBBBB0"}, false,
+     {NULL,
+      "https://youtu.be/BBBBBBBBBB0 https://www.speedrun.com/run/old00004\n"}},
+    {"new00006", {NULL}, false, {NULL}},
+};
+
+#define NRUNS (sizeof(runs) / sizeof(*runs))
+
+static int failed;
+
+static void fail(const char *what, const char *id)
+{
+    fprintf(stderr, "FAIL: %s: %s\n", what, id);
+    failed = 1;
+}
+
+/* The runs added by `settle_run()`, looked up by `store_find()` */
+static char added[NRUNS][128];
+static size_t nadded, nsettled;
+
+bool pipeline(const unsigned int jobs, const pipeline_warm_t warm,
+              const pipeline_sink_t sink)
+{
+    (void) jobs;
+    if (warm != NULL)
+        warm();
+
+    arena_t arena = {0};
+    for (size_t i = 0; i < NRUNS; i++) {
+        arena_reset(&arena);
+        run_t run = {.id = (char *) runs[i].id, .arena = &arena};
+        parsed_t parsed = {.has_meta = false};
+        while (run.nvids < MAX_VIDEOS && runs[i].vids[run.nvids] != NULL) {
+            run.vids[run.nvids] = (char *) runs[i].vids[run.nvids];
+            run.nvids++;
+        }
+        if (runs[i].blocked)
+            parsed.blocked[parsed.nblocked++] = run.vids[0];
+        sink(&run, &parsed);
+    }
+    arena_free(&arena);
+    return true;
+}
+
+void store_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    (void) store;
+    for (size_t i = 0; i < sizeof(db_lines) / sizeof(*db_lines); i++) {
+        char line[128];
+        const int len = snprintf(line, sizeof(line), "%s\n", db_lines[i]);
+        visit(line, len, arg);
+    }
+}
+
+char *store_find(store_t *store, const char *game, const char *category,
+                 const char *video_uri, const bool cross, arena_t *arena)
+{
+    (void) store, (void) game, (void) category;
+    if (!cross)
+        fail("not looked up in every shard", video_uri);
+    for (size_t i = 0; i < nadded; i++) {
+        const size_t len = strcspn(added[i], " ");
+        if (strlen(video_uri) == len && memcmp(video_uri, added[i], len) == 0) {
+            char *found = arena_alloc(arena, strlen(added[i]) + 1);
+            return strcpy(found, added[i]);
+        }
+    }
+    return NULL;
+}
+
+/* Check the duplicates of a run, which is added if it has none */
+void settle_run(run_t *run, const parsed_t *parsed, char *const *found)
+{
+    const size_t seq = nsettled++;
+    if (seq >= NRUNS || strcmp(run->id, runs[seq].id) != 0) {
+        fail("run out of order", run->id);
+        return;
+    }
+    if (parsed->nblocked != runs[seq].blocked
+        || (parsed->nblocked > 0 && parsed->blocked[0] != run->vids[0]))
+        fail("the blocked videos were lost", run->id);
+
+    bool dup = false;
+    for (size_t i = 0; i < run->nvids; i++) {
+        const char *want = runs[seq].found[i];
+        if (i >= MAX_VIDEOS || strcmp(run->vids[i], runs[seq].vids[i]) != 0)
+            fail("wrong video", run->id);
+        else if ((found[i] == NULL) != (want == NULL)
+                 || (want != NULL && strcmp(found[i], want) != 0))
+            fail("wrong duplicate", run->vids[i]);
+        dup |= found[i] != NULL;
+    }
+    if (!dup && run->nvids > 0)
+        snprintf(added[nadded++], sizeof(*added),
+                 "%s https://www.speedrun.com/run/%s\n", run->vids[0], run->id);
+}
+
+int main(void)
+{
+    if (!batch(NULL, 1))
+        fail("the batch failed", "");
+    if (nsettled != NRUNS)
+        fail("runs went missing", "");
+    puts(failed ? "batch: FAIL" : "batch: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "blocklist.h"
+
+/*
+ * Tests of the blocklist, built from lists of videos and looked up through
+ * the mapped file
+ */
+
+/* Videos on the blocklist, and videos looked up that are not */
+#define LISTED 20000
+#define OTHERS 200000
+
+static int failed;
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failed = 1;
+}
+
+/* The ID of the `i`th YouTube video, 11 characters of the ID alphabet */
+static void video_id(const unsigned int i, char *id)
+{
+    snprintf(id, 12, "v%010u", i);
+}
+
+/* Build the blocklist from the lines of `list` */
+static void build(const char *path, const char *list)
+{
+    FILE *in = fmemopen((void *) list, strlen(list), "r");
+    if (in == NULL) {
+        fail("fmemopen");
+        return;
+    }
+    blocklist_build(path, in);
+    fclose(in);
+}
+
+/* Every listed video is found however it was given, and few others are */
+static void test_lookup(const char *path)
+{
+    size_t size = 0;
+    char *list = NULL;
+    FILE *out = open_memstream(&list, &size);
+    fputs("# comments and empty lines are skipped\n\n", out);
+    for (unsigned int i = 0; i < LISTED; i++) {
+        char id[12];
+        video_id(i, id);
+        if (i % 3 == 0)
+            fprintf(out, "%s\n", id);
+        else if (i % 3 == 1)
+            fprintf(out, "https://www.youtube.com/watch?v=%s\n", id);
+        else
+            fprintf(out, "  https://youtu.be/%s \r\n", id);
+    }
+    fputs("https://www.twitch.tv/videos/123456789\n", out);
+    fclose(out);
+    build(path, list);
+    free(list);
+
+    blocklist_t bl;
+    if (!blocklist_open(&bl, path)) {
+        fail("the blocklist was not opened");
+        return;
+    }
+    if (bl.hdr->nkeys != LISTED + 1)
+        fail("videos are missing from the blocklist");
+
+    for (unsigned int i = 0; i < LISTED; i++) {
+        char uri[64];
+        snprintf(uri, sizeof(uri), "https://youtu.be/v%010u", i);
+        if (!blocklist_has(&bl, uri)) {
+            fail("a listed video was not found");
+            break;
+        }
+    }
+    if (!blocklist_has(&bl, "https://www.twitch.tv/videos/123456789"))
+        fail("a listed video of another platform was not found");
+
+    /* One in 2^16 is found by chance */
+    unsigned int found = 0;
+    for (unsigned int i = LISTED; i < LISTED + OTHERS; i++) {
+        char uri[64];
+        snprintf(uri, sizeof(uri), "https://youtu.be/v%010u", i);
+        found += blocklist_has(&bl, uri);
+    }
+    if (found > 4 * OTHERS / 65536 + 4)
+        fail("too many videos that are not listed were found");
+    blocklist_close(&bl);
+}
+
+/* A blocklist without videos, and a missing one */
+static void test_empty(const char *path)
+{
+    build(path, "# nothing yet\n");
+    blocklist_t bl;
+    if (!blocklist_open(&bl, path) || bl.hdr->nkeys != 0
+        || blocklist_has(&bl, "https://youtu.be/dQw4w9WgXcQ"))
+        fail("an empty blocklist has videos");
+    blocklist_close(&bl);
+
+    unlink(path);
+    if (blocklist_open(&bl, path)
+        || blocklist_has(&bl, "https://youtu.be/dQw4w9WgXcQ"))
+        fail("a missing blocklist has videos");
+}
+
+/* Whether opening the file at `path` ends drun as a corrupt blocklist */
+static bool rejected(const char *path)
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        blocklist_t bl;
+        blocklist_open(&bl, path);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    return pid != -1 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+           && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+/* Damaged files are refused before anything is looked up in them */
+static void test_corrupt(const char *path)
+{
+    build(path, "dQw4w9WgXcQ\nhttps://vimeo.com/76979871\n");
+    FILE *fp = fopen(path, "r+b");
+    bl_header_t hdr;
+    bl_level_t level;
+    if (fp == NULL || fread(&hdr, sizeof(hdr), 1, fp) != 1
+        || fread(&level, sizeof(level), 1, fp) != 1) {
+        fail("the blocklist could not be read");
+        return;
+    }
+
+    /* A level past the bits, then one without bits */
+    bl_level_t bad = {hdr.nwords, level.bits};
+    fseek(fp, sizeof(hdr), SEEK_SET);
+    fwrite(&bad, sizeof(bad), 1, fp);
+    fflush(fp);
+    if (!rejected(path))
+        fail("a level past the bits was not refused");
+
+    bad = (bl_level_t){0, 0};
+    fseek(fp, sizeof(hdr), SEEK_SET);
+    fwrite(&bad, sizeof(bad), 1, fp);
+    fflush(fp);
+    if (!rejected(path))
+        fail("a level without bits was not refused");
+
+    /* More words than the file has room for */
+    hdr.nwords = UINT64_MAX / 4;
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fclose(fp);
+    if (!rejected(path))
+        fail("a header larger than the file was not refused");
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/drun-test-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/blocklist", dir);
+    test_lookup(path);
+    test_empty(path);
+    test_corrupt(path);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fail("the blocklist could not be removed");
+    puts(failed ? "blocklist: FAIL" : "blocklist: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canon.h"
+
+/*
+ * Tests of the canonical forms of video URIs, and of the packed IDs of
+ * YouTube videos the batch filters on
+ */
+
+static int failed;
+
+static void fail(const char *what, const char *uri)
+{
+    fprintf(stderr, "FAIL: %s: %s\n", what, uri);
+    failed = 1;
+}
+
+/* URIs and their canonical forms */
+static const char *const forms[][2] = {
+    {"https://www.youtube.com/watch?v=dQw4w9WgXcQ",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"http://youtube.com/watch?feature=share&v=dQw4w9WgXcQ&t=42s",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"  https://M.YouTube.com/watch?v=dQw4w9WgXcQ#t=1\r\n",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"youtu.be/dQw4w9WgXcQ?si=abc", "https://youtu.be/dQw4w9WgXcQ"},
+    {"https://www.youtube.com/shorts/dQw4w9WgXcQ",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"https://www.youtube-nocookie.com/embed/dQw4w9WgXcQ?start=3",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"https://www.youtube.com:443/live/dQw4w9WgXcQ",
+     "https://youtu.be/dQw4w9WgXcQ"},
+    {"https://www.twitch.tv/videos/123456789",
+     "https://www.twitch.tv/videos/123456789"},
+    {"https://twitch.tv/someone/v/123456789",
+     "https://www.twitch.tv/videos/123456789"},
+    {"https://player.twitch.tv/?video=v123456789&parent=x",
+     "https://www.twitch.tv/videos/123456789"},
+    {"https://www.twitch.tv/someone/clip/FunnyClip-abc_1",
+     "https://clips.twitch.tv/FunnyClip-abc_1"},
+    {"https://clips.twitch.tv/embed?clip=FunnyClip&parent=x",
+     "https://clips.twitch.tv/FunnyClip"},
+    {"https://www.bilibili.com/video/BV1xx411c7mD?p=1",
+     "https://www.bilibili.com/video/BV1xx411c7mD"},
+    {"https://m.bilibili.com/video/BV1xx411c7mD/?p=2&t=5",
+     "https://www.bilibili.com/video/BV1xx411c7mD?p=2"},
+    {"https://vimeo.com/76979871", "https://vimeo.com/76979871"},
+    {"https://player.vimeo.com/video/76979871?h=1",
+     "https://vimeo.com/76979871"},
+    {"HTTPS://WWW.Example.COM/Some/Path/?q=1#frag",
+     "https://example.com/Some/Path?q=1"},
+    {"https://vimeo.com/channels/staffpicks",
+     "https://vimeo.com/channels/staffpicks"},
+    {"https://www.youtube.com/channel/UC123",
+     "https://youtube.com/channel/UC123"},
+};
+
+/* URIs on the known platforms that are no video */
+static const char *const not_videos[] = {
+    "https://www.youtube.com/channel/UC123",
+    "https://www.youtube.com/watch?list=PL123",
+    "https://www.twitch.tv/someone",
+    "https://vimeo.com/channels/staffpicks",
+    "https://www.bilibili.com/read/cv123",
+    "https://example.com/video.mp4",
+    "",
+};
+
+static void test_forms(void)
+{
+    for (size_t i = 0; i < sizeof(forms) / sizeof(*forms); i++) {
+        const char *uri = forms[i][0], *want = forms[i][1];
+        const size_t len = strlen(uri);
+        char out[CANON_SIZE(len)];
+        if (canon_uri(uri, len, out) != strlen(want) || strcmp(out, want) != 0)
+            fail("wrong canonical form", uri);
+
+        /* A canonical form is its own canonical form */
+        char again[CANON_SIZE(strlen(want))];
+        canon_uri(want, strlen(want), again);
+        if (strcmp(again, want) != 0)
+            fail("canonical form changed when canonicalized again", want);
+        if (!canon_eq(uri, len, want, strlen(want)))
+            fail("not equal to its canonical form", uri);
+    }
+
+    for (size_t i = 0; i < sizeof(not_videos) / sizeof(*not_videos); i++) {
+        const char *uri = not_videos[i];
+        char out[CANON_SIZE(strlen(uri))];
+        if (canon_video(uri, strlen(uri), out) != 0)
+            fail("taken for a video", uri);
+    }
+
+    /* Other videos of the same platform are told apart */
+    const char *key = "https://youtu.be/dQw4w9WgXcQ";
+    const char *other = "https://www.youtube.com/watch?v=dQw4w9WgXcR";
+    if (canon_eq(other, strlen(other), key, strlen(key)))
+        fail("equal to another video", other);
+}
+
+/* IDs in ASCII order, which packing them must keep */
+static const char *const sorted_ids[] = {
+    "----------0",
+    "-0000000000",
+    "09AZ_az-00w",
+    "A---------0",
+    "Zzzzzzzzzzw",
+    "_0000000000",
+    "a0000000000",
+    "dQw4w9WgXcQ",
+    "zzzzzzzzzzw",
+};
+
+static void test_pack(void)
+{
+    uint64_t id;
+    if (!canon_pack("https://youtu.be/dQw4w9WgXcQ", 28, &id)
+        || id != 0xa5bf05f0a86c8a87)
+        fail("wrong packed ID", "dQw4w9WgXcQ");
+    if (!canon_pack("https://youtu.be/zzzzzzzzzzw", 28, &id)
+        || id != UINT64_MAX)
+        fail("wrong packed ID", "zzzzzzzzzzw");
+
+    /* A last character YouTube never picks does not pack */
+    if (canon_pack("https://youtu.be/dQw4w9WgXcR", 28, &id))
+        fail("packed an impossible ID", "dQw4w9WgXcR");
+    if (canon_pack("https://youtu.be/dQw4w9WgXc", 27, &id))
+        fail("packed a short ID", "dQw4w9WgXc");
+    if (canon_pack("https://vimeo.com/76979871", 26, &id))
+        fail("packed another platform", "https://vimeo.com/76979871");
+
+    uint64_t last = 0;
+    for (size_t i = 0; i < sizeof(sorted_ids) / sizeof(*sorted_ids); i++) {
+        char key[64];
+        const size_t len = snprintf(key, sizeof(key), "https://youtu.be/%s",
+                                    sorted_ids[i]);
+        if (!canon_pack(key, len, &id))
+            fail("did not pack", key);
+        else if (i > 0 && id <= last)
+            fail("packed out of order", key);
+        last = id;
+    }
+}
+
+int main(void)
+{
+    test_forms();
+    test_pack();
+    puts(failed ? "canon: FAIL" : "canon: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cluster.h"
+
+/*
+ * Tests of the clusters of runs and players, with the database replaced by
+ * the lines below or a chain of runs, and the clusters printed read back
+ */
+
+/* Runs of the chain, enough for the edges to be merged on two threads */
+#define CHAIN (3 * 1024 * 1024 / 2)
+
+/* The lines of the database, some with videos in forms before canon_uri() */
+static const char *const db_lines[] = {
+    "https://youtu.be/AAAAAAAAAA0 https://www.speedrun.com/run/run00001",
+    "https://www.youtube.com/watch?v=AAAAAAAAAA0 "
+    "https://www.speedrun.com/run/run00002",
+    "https://vimeo.com/9 https://www.speedrun.com/run/run00011",
+    "https://www.twitch.tv/videos/1 https://www.speedrun.com/run/run00003",
+    "https://twitch.tv/someone/v/1 https://www.speedrun.com/run/run00004",
+    "https://youtu.be/BBBBBBBBBB0 https://www.speedrun.com/run/run00005",
+    "https://vimeo.com/7 https://www.speedrun.com/run/run00006",
+    "not-a-line-of-the-database",
+};
+
+/* The stored metadata, the players are numbered in the order they come */
+static const struct {
+    const char *id, *game, *player, *video;
+} rows[] = {
+    {"run00006", "g1", "pA", "https://vimeo.com/7"},
+    {"run00007", "g2", "pA", "https://vimeo.com/8"},
+    {"run00005", "g1", "pB", "https://youtu.be/BBBBBBBBBB0"},
+    {"run00008", "g1", "pB", "https://youtu.be/CCCCCCCCCC0"},
+    {"run00009", "g1", "pC", "https://youtu.be/AAAAAAAAAA0"},
+    {"run00010", "g1", "pD", "https://youtu.be/DDDDDDDDDD0"},
+    {"run00012", "g1", NULL, "https://vimeo.com/9"},
+};
+
+/* Largest first, the smallest node first of clusters of the same size */
+static const char *const all[] = {
+    "3 runs, 1 players: run00001 run00002 run00009 pC\n",
+    "2 runs, 1 players: run00006 run00007 pA\n",
+    "2 runs, 1 players: run00005 run00008 pB\n",
+    "2 runs, 0 players: run00011 run00012\n",
+    "2 runs, 0 players: run00003 run00004\n",
+};
+
+static int failed;
+static size_t chain;
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failed = 1;
+}
+
+void store_iterate(store_t *store, const db_visit_t visit, void *arg)
+{
+    (void) store;
+    char line[128];
+    int len;
+
+    /* A video shared by every run and the next */
+    for (size_t i = 0; i < chain; i++) {
+        for (size_t j = i; j < i + 2 && j < chain; j++) {
+            len = snprintf(line, sizeof(line), "https://youtu.be/%010zx0 "
+                           "https://www.speedrun.com/run/%08zx\n", i, j);
+            visit(line, len, arg);
+        }
+    }
+    for (size_t i = 0; chain == 0 && i < sizeof(db_lines) / sizeof(*db_lines);
+         i++) {
+        len = snprintf(line, sizeof(line), "%s\n", db_lines[i]);
+        visit(line, len, arg);
+    }
+}
+
+/* Run the query and return what it printed */
+static char *query(const meta_db_t *meta, const meta_filter_t *filter)
+{
+    FILE *out = tmpfile();
+    const int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(fileno(out), STDOUT_FILENO);
+    cluster_query(NULL, meta, filter);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    const off_t size = lseek(fileno(out), 0, SEEK_END);
+    char *printed = malloc(size + 1);
+    rewind(out);
+    printed[fread(printed, 1, size, out)] = '\0';
+    fclose(out);
+    return printed;
+}
+
+static void check(const meta_db_t *meta, const meta_filter_t *filter,
+                  const char *want, const char *what)
+{
+    char *printed = query(meta, filter);
+    if (strcmp(printed, want) != 0)
+        fail(what);
+    free(printed);
+}
+
+static void test_clusters(const char *dir)
+{
+    meta_db_t meta;
+    meta_open(&meta, dir);
+    for (size_t i = 0; i < sizeof(rows) / sizeof(*rows); i++) {
+        meta_t row = {
+            .id = {(char *) rows[i].id, strlen(rows[i].id)},
+            .game = {(char *) rows[i].game, strlen(rows[i].game)},
+            .category = {"7kjpl1gk", 8},
+            .nplayers = rows[i].player != NULL,
+            .nvideos = 1,
+            .submitted = 1600000000 + i,
+        };
+        if (rows[i].player != NULL)
+            row.players[0] = (string_t) {(char *) rows[i].player, 2};
+        row.videos[0] = (string_t) {(char *) rows[i].video,
+                                    strlen(rows[i].video)};
+        if (!meta_append(&meta, &row, 0))
+            fail("a run was not appended");
+    }
+    meta_close(&meta);
+    meta_open(&meta, dir);
+
+    char want[256] = "";
+    for (size_t i = 0; i < sizeof(all) / sizeof(*all); i++)
+        strcat(want, all[i]);
+    check(&meta, &(meta_filter_t) {NULL, NULL, NULL}, want, "all clusters");
+    check(&meta, &(meta_filter_t) {NULL, NULL, "pB"}, all[2],
+          "the clusters of a player");
+    check(&meta, &(meta_filter_t) {"g2", NULL, NULL}, all[1],
+          "the clusters of a game");
+    check(&meta, &(meta_filter_t) {NULL, NULL, "pD"}, "",
+          "the cluster of a single run");
+    check(&meta, &(meta_filter_t) {NULL, NULL, "nobody"}, "",
+          "the clusters of an unknown player");
+    meta_close(&meta);
+}
+
+/* One cluster of every run, linked one after the other */
+static void test_chain(const char *dir)
+{
+    meta_db_t meta;
+    meta_open(&meta, dir);
+    chain = CHAIN;
+    char *printed = query(&meta, &(meta_filter_t) {NULL, NULL, NULL});
+    chain = 0;
+
+    char head[64];
+    snprintf(head, sizeof(head), "%d runs, 0 players: 00000000 00000001 ",
+             CHAIN);
+    const size_t len = strlen(printed);
+    if (strncmp(printed, head, strlen(head)) != 0
+        || len != strlen(head) - 19 + (size_t) CHAIN * 9 + 1
+        || strchr(printed, '\n') != printed + len - 1)
+        fail("the runs of a chain are not one cluster");
+    free(printed);
+    meta_close(&meta);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/drun-test-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    char sub[64];
+    snprintf(sub, sizeof(sub), "%s/meta", dir);
+    test_clusters(sub);
+    snprintf(sub, sizeof(sub), "%s/empty", dir);
+    test_chain(sub);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fail("the clusters could not be removed");
+    puts(failed ? "cluster: FAIL" : "cluster: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
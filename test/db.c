@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "db.h"
+
+/*
+ * Tests of the runs database with several processes appending to the same
+ * shard at once, as when scripts run drun in parallel
+ */
+
+/* Processes appending at once, and the runs each appends */
+#define WRITERS 4
+#define WRITES  2000
+
+static int failed;
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failed = 1;
+}
+
+/* The video and the run ID of the `i`th run of a writer */
+static void run_at(const unsigned int w, const unsigned int i, char *video,
+                   const size_t size, char *id)
+{
+    snprintf(video, size, "https://youtu.be/w%uv%08u", w, i);
+    snprintf(id, 16, "r%u%06u", w, i);
+}
+
+/* Whether the database finds the run, with the line it was added with */
+static bool found(db_t *db, const unsigned int w, const unsigned int i,
+                  arena_t *arena)
+{
+    char video[64], id[16];
+    run_at(w, i, video, sizeof(video), id);
+    const char *line = db_find(db, NULL, NULL, video, false, arena);
+    return line != NULL && strstr(line, id) != NULL;
+}
+
+/*
+ * Append runs while the others do, looking up runs in between so the index
+ * follows the lines the others append
+ */
+static void write_runs(const char *dir, const unsigned int w)
+{
+    db_t db;
+    arena_t arena = {0};
+    db_open(&db, dir, SHARD_NONE);
+    for (unsigned int i = 0; i < WRITES; i++) {
+        char video[64], id[16];
+        run_at(w, i, video, sizeof(video), id);
+        db_add(&db, NULL, NULL, video, id);
+        if (i % 10 == 0 && !found(&db, w, i, &arena))
+            fail("a run was not found right after it was added");
+        arena_reset(&arena);
+    }
+
+    for (unsigned int i = 0; i < WRITES; i++, arena_reset(&arena))
+        if (!found(&db, w, i, &arena)) {
+            fail("the index of a writer lost a run");
+            break;
+        }
+    db_close(&db);
+    arena_free(&arena);
+}
+
+/* Processes that add runs to the same shard at once */
+static void test_writers(const char *dir)
+{
+    for (unsigned int w = 0; w < WRITERS; w++) {
+        const pid_t pid = fork();
+        if (pid == -1) {
+            fail("fork");
+            break;
+        }
+        if (pid == 0) {
+            write_runs(dir, w);
+            _exit(failed);
+        }
+    }
+    for (unsigned int w = 0; w < WRITERS; w++) {
+        int status;
+        if (wait(&status) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+            fail("a writer failed");
+    }
+
+    /* Every run is found through the index the writers published */
+    db_t db;
+    arena_t arena = {0};
+    db_open(&db, dir, SHARD_NONE);
+    for (unsigned int w = 0; w < WRITERS; w++)
+        for (unsigned int i = 0; i < WRITES; i++, arena_reset(&arena))
+            if (!found(&db, w, i, &arena)) {
+                fail("the published index lost a run");
+                w = WRITERS;
+                break;
+            }
+    db_close(&db);
+    arena_free(&arena);
+}
+
+/*
+ * A shard rewritten in place after its index was published, so that the
+ * lines of the index no longer start where it says
+ */
+static void test_stale(const char *dir)
+{
+    db_t db;
+    arena_t arena = {0};
+    db_open(&db, dir, SHARD_NONE);
+    for (unsigned int i = 0; i < 100; i++) {
+        char video[64], id[16];
+        run_at(0, i, video, sizeof(video), id);
+        db_add(&db, NULL, NULL, video, id);
+    }
+    db_close(&db);
+
+    char path[128], line[256];
+    snprintf(path, sizeof(path), "%s/runs", dir);
+    FILE *fp = fopen(path, "r+");
+    if (fp == NULL || ftruncate(fileno(fp), 0) == -1) {
+        fail("the shard could not be rewritten");
+        return;
+    }
+    for (unsigned int i = 0; i < 100; i++) {
+        char video[64], id[16];
+        snprintf(video, sizeof(video), "https://youtu.be/stale-index%05u", i);
+        snprintf(id, sizeof(id), "s%08u", i);
+        fwrite(line, 1, db_format(line, sizeof(line), video, id), fp);
+    }
+    fclose(fp);
+
+    db_open(&db, dir, SHARD_NONE);
+    for (unsigned int i = 0; i < 100; i++, arena_reset(&arena)) {
+        char video[64];
+        snprintf(video, sizeof(video), "https://youtu.be/stale-index%05u", i);
+        if (db_find(&db, NULL, NULL, video, false, &arena) == NULL) {
+            fail("an index that does not fit the shard was used");
+            break;
+        }
+    }
+    db_close(&db);
+    arena_free(&arena);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/drun-test-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    /* Every test gets a database of its own */
+    char path[64];
+    snprintf(path, sizeof(path), "%s/writers", dir);
+    if (mkdir(path, 0755) == 0)
+        test_writers(path);
+    snprintf(path, sizeof(path), "%s/stale", dir);
+    if (mkdir(path, 0755) == 0)
+        test_stale(path);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fail("the database could not be removed");
+    puts(failed ? "db: FAIL" : "db: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
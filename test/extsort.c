@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extsort.h"
+
+/*
+ * Tests of the external sort, in memory and spilled to more runs than are
+ * merged at once, against qsort() of the same lines
+ */
+
+/* Lines of the large sort, and its budget, which spills every 100 or so */
+#define LINES 100000
+#define BUDGET 4096
+
+static int failed;
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failed = 1;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* A line of up to 40 bytes, any but newline and NUL */
+static char *random_line(uint64_t *state)
+{
+    *state = *state * 6364136223846793005u + 1442695040888963407u;
+    const size_t len = *state >> 33 & 0x3f;
+    char *line = malloc(41);
+    size_t n = 0;
+    for (size_t i = 0; i < len && i < 40; i++) {
+        *state = *state * 6364136223846793005u + 1442695040888963407u;
+        const unsigned char c = *state >> 56;
+        if (c != '\0' && c != '\n')
+            line[n++] = c;
+    }
+    line[n] = '\0';
+    return line;
+}
+
+/* Sort `lines` with a budget of `budget` and check they come out in order */
+static void check_sort(char **lines, const size_t n, const size_t budget,
+                       const size_t min_spills)
+{
+    extsort_t xs;
+    extsort_init(&xs, budget);
+    for (size_t i = 0; i < n; i++)
+        extsort_add(&xs, lines[i], strlen(lines[i]));
+    if (xs.nspills < min_spills)
+        fail("too few runs were spilled");
+    extsort_finish(&xs);
+
+    qsort(lines, n, sizeof(char *), cmp_str);
+    size_t i = 0, len;
+    const char *line;
+    while ((line = extsort_next(&xs, &len)) != NULL) {
+        if (i == n || len != strlen(lines[i]) || strcmp(line, lines[i]) != 0) {
+            fail("a line is out of order");
+            break;
+        }
+        i++;
+    }
+    if (line == NULL && i != n)
+        fail("lines went missing");
+    extsort_free(&xs);
+}
+
+/* Empty lines, repeats and bytes past ASCII, all in memory */
+static void test_memory(void)
+{
+    char *lines[] = {
+        "b", "", "a\tb", "\xff", "a", "", "ab", "a", "\x80x", "B", "a\t",
+    };
+    const size_t n = sizeof(lines) / sizeof(*lines);
+    check_sort(lines, n, 1 << 20, 0);
+
+    extsort_t xs;
+    size_t len;
+    extsort_init(&xs, 1 << 20);
+    extsort_finish(&xs);
+    if (extsort_next(&xs, &len) != NULL)
+        fail("an empty sort has lines");
+    extsort_free(&xs);
+}
+
+/* More runs than EXTSORT_FANIN, which are merged in two passes */
+static void test_spill(void)
+{
+    char **lines = malloc(sizeof(char *) * LINES);
+    uint64_t state = 42;
+    for (size_t i = 0; i < LINES; i++)
+        lines[i] = random_line(&state);
+    check_sort(lines, LINES, BUDGET, EXTSORT_FANIN + 1);
+
+    /* A budget smaller than a line spills every line on its own */
+    check_sort(lines, 200, 1, 199);
+    for (size_t i = 0; i < LINES; i++)
+        free(lines[i]);
+    free(lines);
+}
+
+int main(void)
+{
+    test_memory();
+    test_spill();
+    puts(failed ? "extsort: FAIL" : "extsort: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
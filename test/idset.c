@@ -0,0 +1,152 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "idset.h"
+
+/*
+ * Tests of the sets of packed IDs, looked up against a sorted copy of the IDs
+ * they were built from. Sets with long runs of zeros in their unary part look
+ * up zeros past many samples and words.
+ */
+
+static int failed;
+
+static void fail(const char *what, const uint64_t id)
+{
+    fprintf(stderr, "FAIL: %s: %#" PRIx64 "\n", what, id);
+    failed = 1;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static bool member(const uint64_t *sorted, const size_t n, const uint64_t id)
+{
+    return bsearch(&id, sorted, n, sizeof(uint64_t), cmp_id) != NULL;
+}
+
+/*
+ * Build a set of the `n` IDs and look up every one of them, their neighbours
+ * and `others` random IDs
+ */
+static void check_set(const uint64_t *ids, const size_t n, const size_t others)
+{
+    uint64_t *sorted = malloc(sizeof(uint64_t) * (n + 1));
+    memcpy(sorted, ids, sizeof(uint64_t) * n);
+    qsort(sorted, n, sizeof(uint64_t), cmp_id);
+
+    /* The IDs are sorted in place, so the set gets a copy */
+    uint64_t *copy = malloc(sizeof(uint64_t) * (n + 1));
+    memcpy(copy, ids, sizeof(uint64_t) * n);
+    idset_t set;
+    idset_build(&set, copy, n);
+    free(copy);
+
+    size_t uniq = 0;
+    for (size_t i = 0; i < n; i++)
+        uniq += i == 0 || sorted[i] != sorted[i - 1];
+    if (set.n != uniq)
+        fail("wrong number of IDs", set.n);
+    if (n > 0 && idset_bytes(&set) >= 8 * uniq + 64)
+        fail("larger than the IDs", idset_bytes(&set));
+
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t id = ids[i];
+        if (!idset_has(&set, id))
+            fail("an ID was not found", id);
+        if (idset_has(&set, id + 1) != member(sorted, n, id + 1))
+            fail("the next ID was looked up wrong", id + 1);
+        if (idset_has(&set, id - 1) != member(sorted, n, id - 1))
+            fail("the previous ID was looked up wrong", id - 1);
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    for (size_t i = 0; i < others; i++) {
+        const uint64_t id = next_random(&state);
+        if (idset_has(&set, id) != member(sorted, n, id))
+            fail("a random ID was looked up wrong", id);
+    }
+    idset_free(&set);
+    free(sorted);
+}
+
+/* Random IDs, with repeats and the smallest and largest IDs */
+static void test_random(void)
+{
+    static const size_t sizes[] = {1, 2, 3, 255, 256, 257, 1000, 100000};
+    uint64_t state = 42;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        const size_t n = sizes[s];
+        uint64_t *ids = malloc(sizeof(uint64_t) * n);
+        for (size_t i = 0; i < n; i++)
+            ids[i] = next_random(&state);
+        if (n > 2) {
+            ids[0] = 0;
+            ids[1] = UINT64_MAX;
+            ids[n - 1] = ids[n / 2];
+        }
+        check_set(ids, n, 10000);
+        free(ids);
+    }
+    check_set((uint64_t[]){0}, 0, 1000);
+}
+
+/* Every ID of a range, which needs no low bits */
+static void test_dense(void)
+{
+    const size_t n = 5000;
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++)
+        ids[i] = i + 3;
+
+    idset_t set;
+    idset_build(&set, ids, n);
+    if (set.low_bits != 0)
+        fail("low bits for a range", set.low_bits);
+    for (uint64_t id = 0; id < 2 * n; id++)
+        if (idset_has(&set, id) != (id >= 3 && id < n + 3))
+            fail("an ID of the range was looked up wrong", id);
+    idset_free(&set);
+    free(ids);
+}
+
+/* IDs bunched together, far apart, and all with the same high bits */
+static void test_bunched(void)
+{
+    const size_t n = 4000;
+    uint64_t *ids = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++)
+        ids[i] = (uint64_t) (i / 500) << 52 | (i % 500) * 977;
+    check_set(ids, n, 10000);
+
+    for (size_t i = 0; i < n; i++)
+        ids[i] = (uint64_t) 1 << 62 | i * i;
+    check_set(ids, n, 10000);
+
+    for (size_t i = 0; i < n; i++)
+        ids[i] = UINT64_MAX - i * 3;
+    check_set(ids, n, 10000);
+    free(ids);
+}
+
+int main(void)
+{
+    test_random();
+    test_dense();
+    test_bunched();
+    puts(failed ? "idset: FAIL" : "idset: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "links.h"
+
+/*
+ * Tests of the links to videos found in free text, with every link that
+ * should be found in order
+ */
+
+#define MAX_LINKS 4
+
+static int failed;
+
+static void fail(const char *what, const char *text)
+{
+    fprintf(stderr, "FAIL: %s: %s\n", what, text);
+    failed = 1;
+}
+
+static const struct {
+    const char *text;
+    const char *links[MAX_LINKS];
+} texts[] = {
+    {"Watch https://www.youtube.com/watch?v=abc and https://youtu.be/xyz.",
+     {"https://www.youtube.com/watch?v=abc", "https://youtu.be/xyz"}},
+    {"\"comment\":\"see https://www.twitch.tv/videos/123\\nthanks\"",
+     {"https://www.twitch.tv/videos/123"}},
+    {"(full run: vimeo.com/76979871)", {"vimeo.com/76979871"}},
+    {"HTTPS://YOUTU.BE/AbC_-1, and BiliBili.com/video/BV1x!?",
+     {"HTTPS://YOUTU.BE/AbC_-1", "BiliBili.com/video/BV1x"}},
+    {"m.youtube.com/watch?v=a <https://youtube-nocookie.com/embed/b>",
+     {"m.youtube.com/watch?v=a", "https://youtube-nocookie.com/embed/b"}},
+    {"youtube.youtu.be/a twitch.twitch.tv/b",
+     {"youtube.youtu.be/a", "twitch.twitch.tv/b"}},
+    {"https://example.com/?u=https://youtu.be/abc",
+     {"https://youtu.be/abc"}},
+    {"https://youtu.be/abc?list=vimeo.com/1 twitch.tv/x/v/2",
+     {"https://youtu.be/abc?list=vimeo.com/1", "twitch.tv/x/v/2"}},
+    {"notyoutube.com/abc youtube.com/ youtu.be youtube.com", {NULL}},
+    {"", {NULL}},
+};
+
+static void test_texts(void)
+{
+    for (size_t i = 0; i < sizeof(texts) / sizeof(*texts); i++) {
+        const char *text = texts[i].text;
+        link_t links[MAX_LINKS];
+        const size_t n = links_find(text, strlen(text), links, MAX_LINKS);
+
+        size_t want = 0;
+        while (want < MAX_LINKS && texts[i].links[want] != NULL)
+            want++;
+        if (n != want) {
+            fail("wrong number of links", text);
+            continue;
+        }
+        for (size_t j = 0; j < n; j++)
+            if (links[j].len != strlen(texts[i].links[j])
+                || memcmp(links[j].ptr, texts[i].links[j], links[j].len) != 0)
+                fail("wrong link", texts[i].links[j]);
+    }
+}
+
+/* No more links are stored than there is room for */
+static void test_max(void)
+{
+    const char *text = "youtu.be/a youtu.be/b youtu.be/c";
+    link_t links[2];
+    if (links_find(text, strlen(text), links, 2) != 2 || links[1].len != 10
+        || memcmp(links[1].ptr, "youtu.be/b", 10) != 0)
+        fail("links past the room for them", text);
+}
+
+int main(void)
+{
+    test_texts();
+    test_max();
+    puts(failed ? "links: FAIL" : "links: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+/*
+ * Tests of the LZ4 blocks, round trips of many kinds of input, a block of
+ * the reference implementation and corrupt blocks
+ */
+
+static int failed;
+
+static void fail(const char *what, const char *input)
+{
+    fprintf(stderr, "FAIL: %s: %s\n", what, input);
+    failed = 1;
+}
+
+/* Two lines of the database */
+static const char lines[] =
+    "https://youtu.be/dQw4w9WgXcQ https://www.speedrun.com/run/y8dwozoj\n"
+    "https://youtu.be/dQw4w9WgXcR https://www.speedrun.com/run/y8dwozok\n";
+
+/* The lines as compressed by the lz4 command */
+static const uint8_t lines_lz4[] = {
+    0xf4, 0x0e, 0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f, 0x79, 0x6f,
+    0x75, 0x74, 0x75, 0x2e, 0x62, 0x65, 0x2f, 0x64, 0x51, 0x77, 0x34, 0x77,
+    0x39, 0x57, 0x67, 0x58, 0x63, 0x51, 0x20, 0x1d, 0x00, 0xf4, 0x0f, 0x77,
+    0x77, 0x77, 0x2e, 0x73, 0x70, 0x65, 0x65, 0x64, 0x72, 0x75, 0x6e, 0x2e,
+    0x63, 0x6f, 0x6d, 0x2f, 0x72, 0x75, 0x6e, 0x2f, 0x79, 0x38, 0x64, 0x77,
+    0x6f, 0x7a, 0x6f, 0x6a, 0x0a, 0x26, 0x00, 0x0f, 0x43, 0x00, 0x00, 0x1f,
+    0x52, 0x43, 0x00, 0x0f, 0x50, 0x6f, 0x7a, 0x6f, 0x6b, 0x0a,
+};
+
+/* Compress `src` and decompress it again, returning the compressed size */
+static size_t round_trip(const uint8_t *src, const size_t len,
+                         const char *input)
+{
+    uint8_t *packed = malloc(lz_bound(len)), *out = malloc(len + 1);
+    const size_t n = lz_compress(src, len, packed);
+    if (n > lz_bound(len))
+        fail("compressed past the bound", input);
+    else if (!lz_decompress(packed, n, out, len) || memcmp(out, src, len) != 0)
+        fail("did not decompress to the input", input);
+    free(packed);
+    free(out);
+    return n;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state = *state * 6364136223846793005u + 1442695040888963407u;
+    return *state >> 33;
+}
+
+static void test_round_trips(void)
+{
+    const size_t size = 200000;
+    uint8_t *buf = malloc(size);
+    uint64_t state = 7;
+
+    /* Every size around the end of the matches */
+    for (size_t i = 0; i < 64; i++)
+        buf[i] = "abcab"[i % 5];
+    for (size_t len = 0; len <= 64; len++)
+        round_trip(buf, len, "short repeats");
+
+    for (size_t i = 0; i < size; i++)
+        buf[i] = next_random(&state);
+    if (round_trip(buf, size, "random bytes") < size)
+        fail("random bytes were compressed", "random bytes");
+
+    /* Matches and literals longer than their token nibbles */
+    memset(buf, 'a', size);
+    if (round_trip(buf, size, "one byte") > size / 200)
+        fail("a repeated byte was not compressed", "one byte");
+    for (size_t i = 0; i < size; i++)
+        buf[i] = i % 1000 < 300 ? next_random(&state) : 'x';
+    round_trip(buf, size, "runs of random bytes");
+
+    /* Lengths that just fill their extra bytes */
+    for (size_t nlit = 268; nlit < 273; nlit++) {
+        for (size_t mlen = 272; mlen < 277; mlen++) {
+            for (size_t i = 0; i < nlit + mlen + 100; i++)
+                buf[i] = next_random(&state);
+            memcpy(buf + nlit, buf, mlen);
+            buf[nlit + mlen] = ~buf[mlen];
+            round_trip(buf, nlit + mlen + 100, "lengths of 255 more");
+        }
+    }
+
+    /* A repeat just within the window, and one just past it */
+    for (size_t i = 0; i < LZ_MAX_DIST + 1; i++)
+        buf[i] = next_random(&state);
+    memcpy(buf + LZ_MAX_DIST, buf, 1000);
+    round_trip(buf, LZ_MAX_DIST + 1000, "a repeat at the largest distance");
+    memcpy(buf + LZ_MAX_DIST + 1, buf, 1000);
+    round_trip(buf, LZ_MAX_DIST + 1001, "a repeat past the largest distance");
+
+    /* Lines of the database, the blocks of the segments */
+    size_t len = 0;
+    for (unsigned int i = 0; len + 80 < size; i++)
+        len += sprintf((char *) buf + len, "https://youtu.be/%011u "
+                       "https://www.speedrun.com/run/%08x\n", i * 7, i);
+    if (round_trip(buf, len, "lines") > len / 2)
+        fail("lines were not compressed", "lines");
+    free(buf);
+}
+
+/* A block of the reference implementation */
+static void test_reference(void)
+{
+    const size_t raw = sizeof(lines) - 1;
+    uint8_t out[sizeof(lines)];
+    if (!lz_decompress(lines_lz4, sizeof(lines_lz4), out, raw)
+        || memcmp(out, lines, raw) != 0)
+        fail("did not decompress a block of lz4", "lines");
+    round_trip((const uint8_t *) lines, raw, "lines");
+}
+
+/* Blocks that would read or write out of bounds are refused */
+static void test_corrupt(void)
+{
+    const size_t raw = sizeof(lines) - 1;
+    uint8_t out[sizeof(lines)], block[sizeof(lines_lz4)];
+
+    for (size_t len = 0; len < sizeof(lines_lz4); len++)
+        if (lz_decompress(lines_lz4, len, out, raw))
+            fail("decompressed a truncated block", "lines");
+    if (lz_decompress(lines_lz4, sizeof(lines_lz4), out, raw - 1)
+        || lz_decompress(lines_lz4, sizeof(lines_lz4), out, raw + 1))
+        fail("decompressed to the wrong size", "lines");
+
+    /* The offset of the first match, 29 bytes back */
+    memcpy(block, lines_lz4, sizeof(block));
+    block[31] = 0;
+    if (lz_decompress(block, sizeof(block), out, raw))
+        fail("decompressed a match at offset 0", "lines");
+    block[31] = 32;
+    if (lz_decompress(block, sizeof(block), out, raw))
+        fail("decompressed a match before the block", "lines");
+
+    /* Literals running past the block */
+    const uint8_t literals[] = {0x50, 'a', 'b', 'c'};
+    if (lz_decompress(literals, sizeof(literals), out, 5))
+        fail("decompressed literals past the block", "abc");
+    block[0] = 0xff;
+    block[1] = 0xff;
+    if (lz_decompress(block, sizeof(block), out, raw))
+        fail("decompressed literals past the output", "lines");
+}
+
+int main(void)
+{
+    test_round_trips();
+    test_reference();
+    test_corrupt();
+    puts(failed ? "lz: FAIL" : "lz: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "meta.h"
+
+/*
+ * Tests of the column store. The mappings it makes are recorded through the
+ * linker, `--wrap=mmap,--wrap=munmap`, so that every unmap can be checked
+ * against the mapping it ends.
+ */
+
+#define MAX_MAPS 64
+
+/* Processes appending to one store at once, and the runs each appends */
+#define WRITERS 4
+#define WRITES  2000
+
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+int __real_munmap(void *addr, size_t len);
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+int __wrap_munmap(void *addr, size_t len);
+
+static struct {
+    void *addr;
+    size_t len;
+} maps[MAX_MAPS];
+static size_t nmaps;
+static int failed;
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failed = 1;
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off)
+{
+    void *ret = __real_mmap(addr, len, prot, flags, fd, off);
+    if (ret != MAP_FAILED && nmaps < MAX_MAPS) {
+        maps[nmaps].addr = ret;
+        maps[nmaps++].len = len;
+    }
+    return ret;
+}
+
+int __wrap_munmap(void *addr, size_t len)
+{
+    size_t i = 0;
+    while (i < nmaps && maps[i].addr != addr)
+        i++;
+    if (i == nmaps)
+        fail("unmapped an address that was not mapped");
+    else if (maps[i].len != len)
+        fail("unmapped a length other than the one mapped");
+    else
+        maps[i] = maps[--nmaps];
+    return __real_munmap(addr, len);
+}
+
+/*
+ * Append the runs with the IDs `first` to `last` - 1, the games and players
+ * are shared by the runs of every `first`
+ */
+static void append(meta_db_t *db, const unsigned int first,
+                   const unsigned int last)
+{
+    for (unsigned int i = first; i < last; i++) {
+        char id[16], game[16], player[16], video[64];
+        snprintf(id, sizeof(id), "%08u", i);
+        snprintf(game, sizeof(game), "g%u", i % 7);
+        snprintf(player, sizeof(player), "p%u", i % 100);
+        snprintf(video, sizeof(video), "https://youtu.be/%011u", i);
+
+        meta_t meta = {
+            .id = {id, strlen(id)},
+            .game = {game, strlen(game)},
+            .category = {"7kjpl1gk", 8},
+            .nplayers = 1,
+            .nvideos = 1,
+            .submitted = 1600000000 + i,
+        };
+        meta.players[0] = (string_t) {player, strlen(player)};
+        meta.videos[0] = (string_t) {video, strlen(video)};
+        if (!meta_append(db, &meta, 0))
+            fail("a new run was not appended");
+    }
+}
+
+/* Columns that grew by more than a page after they were mapped */
+static void test_grow(const char *dir)
+{
+    meta_db_t db;
+    meta_open(&db, dir);
+    append(&db, 0, 1);
+    meta_close(&db);
+
+    meta_open(&db, dir);
+    if (nmaps != NCOLS)
+        fail("not every column was mapped");
+    append(&db, 1, 5000);
+    meta_close(&db);
+    if (nmaps != 0)
+        fail("not every column was unmapped");
+
+    meta_open(&db, dir);
+    if (db.rows != 5000)
+        fail("the rows were not all read back");
+    meta_close(&db);
+}
+
+/* Processes that append to the same store at once, every one new runs */
+static void test_writers(const char *dir)
+{
+    for (unsigned int w = 0; w < WRITERS; w++) {
+        const pid_t pid = fork();
+        if (pid == -1) {
+            fail("fork");
+            return;
+        }
+        if (pid == 0) {
+            meta_db_t db;
+            meta_open(&db, dir);
+            append(&db, w * WRITES, (w + 1) * WRITES);
+            meta_close(&db);
+            _exit(failed);
+        }
+    }
+    for (unsigned int w = 0; w < WRITERS; w++) {
+        int status;
+        if (wait(&status) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+            fail("a writer failed");
+    }
+
+    meta_db_t db;
+    meta_open(&db, dir);
+    if (db.rows != WRITERS * WRITES)
+        fail("runs of the writers were lost");
+    if (db.dicts[DICT_GAME].n != 7 || db.dicts[DICT_PLAYER].n != 100)
+        fail("dictionary entries were lost or added twice");
+
+    /* Every run is stored once, with the game and players it was given */
+    const char *ids = db.map[COL_ID];
+    const uint32_t *games = db.map[COL_GAME],
+                   *players_idx = db.map[COL_PLAYERS_IDX],
+                   *players = db.map[COL_PLAYERS];
+    char *seen = calloc(WRITERS * WRITES, 1);
+    for (size_t r = 0; r < db.rows && seen != NULL; r++) {
+        char id[META_ID_LEN + 1] = {0}, name[16];
+        memcpy(id, ids + r * META_ID_LEN, META_ID_LEN);
+        const unsigned int i = strtoul(id, NULL, 10);
+        if (i >= WRITERS * WRITES || seen[i]++) {
+            fail("a run is unknown or stored twice");
+            break;
+        }
+
+        const dict_t *dict = &db.dicts[DICT_GAME];
+        snprintf(name, sizeof(name), "g%u", i % 7);
+        if (dict_find(dict, name, strlen(name)) != games[r])
+            fail("a run has the game of another run");
+        dict = &db.dicts[DICT_PLAYER];
+        snprintf(name, sizeof(name), "p%u", i % 100);
+        if (players_idx[r] != r + 1
+            || dict_find(dict, name, strlen(name)) != players[r])
+            fail("a run has the players of another run");
+    }
+    free(seen);
+    meta_close(&db);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/drun-test-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/grow", dir);
+    test_grow(path);
+    snprintf(path, sizeof(path), "%s/writers", dir);
+    test_writers(path);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fail("the store could not be removed");
+    puts(failed ? "meta: FAIL" : "meta: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
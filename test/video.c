@@ -0,0 +1,452 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "retime.h"
+#include "video.h"
+
+/*
+ * Tests of the frame timestamps read from MP4 files, which are written box by
+ * box below: sample tables with B-frames, fragments, and damaged files
+ */
+
+static int failed;
+
+static void fail(const char *what, const char *video)
+{
+    fprintf(stderr, "FAIL: %s: %s\n", what, video);
+    failed = 1;
+}
+
+/* An MP4 file being written */
+typedef struct {
+    uint8_t *ptr;
+    size_t len, cap;
+} mp4_t;
+
+static void put(mp4_t *mp4, const void *data, const size_t len)
+{
+    if (mp4->len + len > mp4->cap) {
+        mp4->cap = (mp4->len + len) * 2;
+        mp4->ptr = realloc(mp4->ptr, mp4->cap);
+    }
+    memcpy(mp4->ptr + mp4->len, data, len);
+    mp4->len += len;
+}
+
+static void put32(mp4_t *mp4, const uint32_t n)
+{
+    const uint8_t be[4] = {n >> 24, n >> 16, n >> 8, n};
+    put(mp4, be, 4);
+}
+
+static void put64(mp4_t *mp4, const uint64_t n)
+{
+    put32(mp4, n >> 32);
+    put32(mp4, n);
+}
+
+static void zeros(mp4_t *mp4, size_t n)
+{
+    for (; n > 0; n--)
+        put(mp4, "", 1);
+}
+
+/* Start a box, which is sized by `end()` */
+static size_t box(mp4_t *mp4, const char *type)
+{
+    const size_t start = mp4->len;
+    put32(mp4, 0);
+    put(mp4, type, 4);
+    return start;
+}
+
+static size_t full_box(mp4_t *mp4, const char *type, const uint8_t version,
+                       const uint32_t flags)
+{
+    const size_t start = box(mp4, type);
+    put32(mp4, (uint32_t) version << 24 | flags);
+    return start;
+}
+
+static void end(mp4_t *mp4, const size_t start)
+{
+    const uint32_t size = mp4->len - start;
+    const uint8_t be[4] = {size >> 24, size >> 16, size >> 8, size};
+    memcpy(mp4->ptr + start, be, 4);
+}
+
+static void ftyp(mp4_t *mp4)
+{
+    const size_t b = box(mp4, "ftyp");
+    put(mp4, "isom\0\0\0\0isom", 12);
+    end(mp4, b);
+}
+
+static void mdat(mp4_t *mp4, const size_t len)
+{
+    const size_t b = box(mp4, "mdat");
+    zeros(mp4, len);
+    end(mp4, b);
+}
+
+/* A track of `handler`, with the sample tables in `stbl` if any */
+static void trak(mp4_t *mp4, const char *handler, const uint32_t id,
+                 const uint32_t timescale, const mp4_t *stbl)
+{
+    const size_t t = box(mp4, "trak");
+    size_t b = full_box(mp4, "tkhd", 0, 3);
+    put32(mp4, 0);
+    put32(mp4, 0);
+    put32(mp4, id);
+    zeros(mp4, 68);
+    end(mp4, b);
+
+    const size_t mdia = box(mp4, "mdia");
+    b = full_box(mp4, "mdhd", 0, 0);
+    put32(mp4, 0);
+    put32(mp4, 0);
+    put32(mp4, timescale);
+    zeros(mp4, 8);
+    end(mp4, b);
+    b = full_box(mp4, "hdlr", 0, 0);
+    put32(mp4, 0);
+    put(mp4, handler, 4);
+    zeros(mp4, 14);
+    end(mp4, b);
+
+    const size_t minf = box(mp4, "minf");
+    b = box(mp4, "stbl");
+    if (stbl != NULL)
+        put(mp4, stbl->ptr, stbl->len);
+    end(mp4, b);
+    end(mp4, minf);
+    end(mp4, mdia);
+    end(mp4, t);
+}
+
+/* A table of pairs of 32 bit numbers, like stts and ctts */
+static void table(mp4_t *mp4, const char *type, const uint32_t *pairs,
+                  const uint32_t n)
+{
+    const size_t b = full_box(mp4, type, 0, 0);
+    put32(mp4, n);
+    for (uint32_t i = 0; i < 2 * n; i++)
+        put32(mp4, pairs[i]);
+    end(mp4, b);
+}
+
+/* A moov box of an audio track and a video track */
+static void moov(mp4_t *mp4, const uint32_t timescale, const mp4_t *stbl,
+                 const uint32_t default_duration)
+{
+    const size_t m = box(mp4, "moov");
+    trak(mp4, "soun", 2, 48000, NULL);
+    trak(mp4, "vide", 1, timescale, stbl);
+    if (default_duration > 0) {
+        const size_t mvex = box(mp4, "mvex");
+        const size_t b = full_box(mp4, "trex", 0, 0);
+        put32(mp4, 1);
+        put32(mp4, 1);
+        put32(mp4, default_duration);
+        put32(mp4, 0);
+        put32(mp4, 0);
+        end(mp4, b);
+        end(mp4, mvex);
+    }
+    end(mp4, m);
+}
+
+/* Write the file to `path` */
+static void save(const mp4_t *mp4, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(mp4->ptr, 1, mp4->len, fp) != mp4->len)
+        fail("the video could not be written", path);
+    if (fp != NULL)
+        fclose(fp);
+}
+
+/* Check the timestamps of a video against the ones it should have */
+static void check(const char *path, const uint32_t timescale,
+                  const uint64_t *pts, const size_t frames,
+                  const uint64_t duration, const int vfr)
+{
+    video_t video;
+    video_open(&video, path);
+    if (video.timescale != timescale || video.frames != frames
+        || video.duration != duration || video.vfr != vfr) {
+        fail("wrong timescale, frames, duration or vfr", path);
+    } else {
+        for (size_t i = 0; i < frames; i++) {
+            if (video.pts[i] != pts[i]) {
+                fail("wrong frame time", path);
+                break;
+            }
+        }
+    }
+    video_close(&video);
+}
+
+/* 29.97 FPS with B-frames, the moov before the media data */
+static void test_ntsc(const char *dir)
+{
+    mp4_t stbl = {0}, mp4 = {0};
+    const uint32_t stts[] = {1000, 1001};
+    uint32_t ctts[2 * 1000];
+    for (uint32_t i = 0; i < 999; i++) {
+        ctts[2 * i] = 1;
+        ctts[2 * i + 1] = (uint32_t[]){2002, 0, 1001}[i % 3];
+    }
+    ctts[2 * 999] = 1;
+    ctts[2 * 999 + 1] = 1001;
+    table(&stbl, "stts", stts, 1);
+    table(&stbl, "ctts", ctts, 1000);
+
+    ftyp(&mp4);
+    moov(&mp4, 30000, &stbl, 0);
+    mdat(&mp4, 100);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/ntsc.mp4", dir);
+    save(&mp4, path);
+    uint64_t pts[1000];
+    for (size_t i = 0; i < 1000; i++)
+        pts[i] = i * 1001;
+    check(path, 30000, pts, 1000, 1001000, 0);
+
+    video_t video;
+    video_open(&video, path);
+    if (fabs(video_fps(&video) - 29.97) > 0.001)
+        fail("wrong FPS", path);
+    video_close(&video);
+    free(stbl.ptr);
+    free(mp4.ptr);
+}
+
+/* Frames of three durations, the moov after the media data */
+static void test_vfr(const char *dir)
+{
+    mp4_t stbl = {0}, mp4 = {0};
+    const uint32_t stts[] = {10, 33, 10, 17, 1, 40};
+    table(&stbl, "stts", stts, 3);
+
+    ftyp(&mp4);
+    mdat(&mp4, 100);
+    moov(&mp4, 1000, &stbl, 0);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/vfr.mp4", dir);
+    save(&mp4, path);
+    uint64_t pts[21];
+    for (size_t i = 0; i < 21; i++)
+        pts[i] = i <= 10 ? i * 33 : 330 + (i - 10) * 17;
+    check(path, 1000, pts, 21, 540, 1);
+
+    video_t video;
+    video_open(&video, path);
+    if (video_frame_at(&video, 0.5) != 20 || video_frame_at(&video, 0.49) != 19
+        || video_frame_at(&video, -1) != 0
+        || video_frame_time(&video, 11) != 0.347
+        || video_frame_time(&video, 21) != 0.54)
+        fail("wrong frame at a time or time of a frame", path);
+    video_close(&video);
+    free(stbl.ptr);
+    free(mp4.ptr);
+
+    /* B-frames of two durations, the offset of one of them is negative */
+    stbl.ptr = NULL, mp4.ptr = NULL;
+    stbl.len = stbl.cap = mp4.len = mp4.cap = 0;
+    const uint32_t stts_b[] = {1, 100, 1, 50, 1, 100, 1, 50};
+    const uint32_t ctts[] = {1, 150, 1, 0, 1, -100, 1, 0};
+    table(&stbl, "stts", stts_b, 4);
+    table(&stbl, "ctts", ctts, 4);
+    ftyp(&mp4);
+    moov(&mp4, 1000, &stbl, 0);
+    save(&mp4, path);
+    check(path, 1000, (uint64_t[]){0, 50, 100, 200}, 4, 300, 1);
+    free(stbl.ptr);
+    free(mp4.ptr);
+}
+
+/* Only the last frame may be shorter at a constant FPS */
+static void test_last_frame(const char *dir)
+{
+    mp4_t stbl = {0}, mp4 = {0};
+    const uint32_t stts[] = {9, 100, 1, 50};
+    table(&stbl, "stts", stts, 2);
+
+    /* A moov that runs to the end of the file has size 0 */
+    ftyp(&mp4);
+    mdat(&mp4, 100);
+    const size_t m = mp4.len;
+    moov(&mp4, 600, &stbl, 0);
+    memset(mp4.ptr + m, 0, 4);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/last.mp4", dir);
+    save(&mp4, path);
+    uint64_t pts[10];
+    for (size_t i = 0; i < 10; i++)
+        pts[i] = i * 100;
+    check(path, 600, pts, 10, 950, 0);
+    free(stbl.ptr);
+    free(mp4.ptr);
+}
+
+/*
+ * Fragments of 30 FPS, with frames of the default duration and durations of
+ * their own, then a fragment of B-frames at 15 and 30 FPS behind fields that
+ * are skipped
+ */
+static void test_fragments(const char *dir)
+{
+    mp4_t stbl = {0}, mp4 = {0};
+    table(&stbl, "stts", NULL, 0);
+
+    ftyp(&mp4);
+    moov(&mp4, 90000, &stbl, 3000);
+
+    /* The first fragment also has samples of another track */
+    const uint32_t counts[] = {30, 30, 6}, flags[] = {0, 0x100, 0x905};
+    uint64_t dts = 0;
+    for (int f = 0; f < 3; f++) {
+        const size_t moof = box(&mp4, "moof");
+        size_t b = full_box(&mp4, "mfhd", 0, 0);
+        put32(&mp4, f + 1);
+        end(&mp4, b);
+
+        for (uint32_t id = f == 0 ? 2 : 1; id > 0; id--) {
+            const size_t traf = box(&mp4, "traf");
+            b = full_box(&mp4, "tfhd", 0, 0);
+            put32(&mp4, id);
+            end(&mp4, b);
+            b = full_box(&mp4, "tfdt", f & 1, 0);
+            if (f & 1)
+                put64(&mp4, dts);
+            else
+                put32(&mp4, dts);
+            end(&mp4, b);
+
+            b = full_box(&mp4, "trun", f == 2, flags[f]);
+            put32(&mp4, counts[f]);
+            if (flags[f] & 0x001)
+                put32(&mp4, 0);
+            if (flags[f] & 0x004)
+                put32(&mp4, 0);
+            for (uint32_t i = 0; i < counts[f] && flags[f] != 0; i++) {
+                put32(&mp4, f == 2 ? (uint32_t[]){2000, 4000}[i % 2] : 3000);
+                if (flags[f] & 0x800)
+                    put32(&mp4, (uint32_t[]){4000, -2000, 0}[i % 3]);
+            }
+            end(&mp4, b);
+            end(&mp4, traf);
+        }
+        end(&mp4, moof);
+        mdat(&mp4, 10);
+        dts += 30 * 3000;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/frag.mp4", dir);
+    save(&mp4, path);
+    uint64_t pts[66] = {[60] = 180000, 184000, 186000, 190000, 192000, 194000};
+    for (size_t i = 0; i < 60; i++)
+        pts[i] = i * 3000;
+    check(path, 90000, pts, 66, 198000, 1);
+    free(stbl.ptr);
+    free(mp4.ptr);
+}
+
+/* Whether reading the video at `path` ends retime with BAD_VIDEO */
+static bool rejected(const char *path)
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        video_t video;
+        video_open(&video, path);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    return pid != -1 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+           && WEXITSTATUS(status) == BAD_VIDEO;
+}
+
+/* Files that are damaged or have no video are refused */
+static void test_bad(const char *dir)
+{
+    mp4_t stbl = {0}, mp4 = {0};
+    const uint32_t stts[] = {10, 100};
+    table(&stbl, "stts", stts, 1);
+    ftyp(&mp4);
+    const size_t m = mp4.len;
+    moov(&mp4, 600, &stbl, 0);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/bad.mp4", dir);
+    if (!rejected(path))
+        fail("a missing file was not refused", path);
+
+    /* A moov larger than the file, with a 64 bit size */
+    mp4_t big = {0};
+    ftyp(&big);
+    put32(&big, 1);
+    put(&big, "moov", 4);
+    put64(&big, (uint64_t) 1 << 40);
+    put(&big, mp4.ptr + m + 8, mp4.len - m - 8);
+    save(&big, path);
+    if (!rejected(path))
+        fail("a moov larger than the file was not refused", path);
+    free(big.ptr);
+
+    /* A box larger than the moov it is in */
+    memcpy(mp4.ptr + m + 8, mp4.ptr + m, 4);
+    save(&mp4, path);
+    if (!rejected(path))
+        fail("a box larger than its parent was not refused", path);
+
+    /* No video track, only the audio track */
+    mp4.len = m;
+    const size_t b = box(&mp4, "moov");
+    trak(&mp4, "soun", 2, 48000, &stbl);
+    end(&mp4, b);
+    save(&mp4, path);
+    if (!rejected(path))
+        fail("a file without a video track was not refused", path);
+
+    save(&(mp4_t){(uint8_t *) "not a video", 11, 11}, path);
+    if (!rejected(path))
+        fail("a file that is no MP4 was not refused", path);
+    free(stbl.ptr);
+    free(mp4.ptr);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/drun-test-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    test_ntsc(dir);
+    test_vfr(dir);
+    test_last_frame(dir);
+    test_fragments(dir);
+    test_bad(dir);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fail("the videos could not be removed", dir);
+    puts(failed ? "video: FAIL" : "video: ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}